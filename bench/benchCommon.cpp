@@ -0,0 +1,68 @@
+#include "benchUtils.h"
+#include "fakeEnet.h"
+#include <cstdlib>
+#include <new>
+
+// Benchmarks are single threaded, a thread-local counter keeps the count itself off the timings.
+static thread_local uint64_t numAllocations = 0;
+static uint64_t numSentBytes = 0;
+static bool captureEnabled = false;
+static std::vector<std::vector<uint8_t>> capturedPackets;
+
+void *operator new(size_t size)
+{
+  numAllocations++;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+uint64_t allocation_count()
+{
+  return numAllocations;
+}
+
+uint64_t sent_bytes_count()
+{
+  return numSentBytes;
+}
+
+static void on_send(ENetPeer *, enet_uint8, const ENetPacket *packet)
+{
+  numSentBytes += packet->dataLength;
+  if (captureEnabled)
+    capturedPackets.emplace_back(packet->data, packet->data + packet->dataLength);
+}
+
+void set_packet_capture(bool enabled)
+{
+  captureEnabled = enabled;
+}
+
+std::vector<std::vector<uint8_t>> take_captured_packets()
+{
+  std::vector<std::vector<uint8_t>> res;
+  res.swap(capturedPackets);
+  return res;
+}
+
+int main(int argc, char **argv)
+{
+  fake_enet_set_send_callback(on_send);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
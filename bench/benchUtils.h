@@ -0,0 +1,63 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include <enet/enet.h>
+#include <cstdint>
+#include <vector>
+
+// Shared helpers of the microbenchmarks. Every benchmark reports, besides
+// ns/op, the bytes handed to enet_peer_send (or decoded) and the heap
+// allocations per iteration, counted by the global operator new in benchCommon.cpp.
+
+uint64_t allocation_count();
+uint64_t sent_bytes_count();
+
+// Bytes of every packet passed to enet_peer_send while capturing is on.
+void set_packet_capture(bool enabled);
+std::vector<std::vector<uint8_t>> take_captured_packets();
+
+// Snapshot of the counters taken right before the timed loop.
+class OpCounters
+{
+  uint64_t allocs = allocation_count();
+  uint64_t bytes = sent_bytes_count();
+
+public:
+  void report(benchmark::State &state, uint64_t extra_bytes_per_op = 0)
+  {
+    uint64_t numAllocs = allocation_count() - allocs;
+    uint64_t numBytes = sent_bytes_count() - bytes + extra_bytes_per_op * state.iterations();
+    state.counters["allocs/op"] = benchmark::Counter(double(numAllocs), benchmark::Counter::kAvgIterations);
+    state.counters["bytes/op"] = benchmark::Counter(double(numBytes), benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(int64_t(numBytes));
+  }
+};
+
+// Times `send(peer)`, the packet goes through the fake ENet and is freed.
+template<typename Send>
+void run_encode(benchmark::State &state, Send send)
+{
+  ENetPeer peer = {};
+  OpCounters counters;
+  for (auto _ : state)
+    send(&peer);
+  counters.report(state);
+}
+
+// Encodes one packet with `send`, then times `decode(packet)` on its bytes.
+template<typename Send, typename Decode>
+void run_decode(benchmark::State &state, Send send, Decode decode)
+{
+  ENetPeer peer = {};
+  set_packet_capture(true);
+  send(&peer);
+  set_packet_capture(false);
+  std::vector<uint8_t> bytes = take_captured_packets().back();
+  ENetPacket packet = {};
+  packet.data = bytes.data();
+  packet.dataLength = bytes.size();
+
+  OpCounters counters;
+  for (auto _ : state)
+    decode(&packet);
+  counters.report(state, bytes.size());
+}
@@ -0,0 +1,149 @@
+#include "benchUtils.h"
+#include "bitstream.h"
+#include <string>
+
+// Each iteration builds a fresh stream with state.range(0) writes, like an
+// encoder does per packet, so allocations/op include the buffer growth.
+
+static void report_stream(benchmark::State &state, OpCounters &counters, size_t bytes_per_op)
+{
+  counters.report(state, bytes_per_op);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_BitStream_WriteBit(benchmark::State &state)
+{
+  size_t size = 0;
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      bs.WriteBit(i & 1);
+    size = bs.GetSizeBytes();
+    benchmark::DoNotOptimize(bs.GetData());
+  }
+  report_stream(state, counters, size);
+}
+BENCHMARK(BM_BitStream_WriteBit)->Arg(8)->Arg(64)->Arg(512);
+
+static void BM_BitStream_WriteBits(benchmark::State &state)
+{
+  size_t size = 0;
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      bs.WriteBits(uint32_t(i * 0x2f3), 11);
+    size = bs.GetSizeBytes();
+    benchmark::DoNotOptimize(bs.GetData());
+  }
+  report_stream(state, counters, size);
+}
+BENCHMARK(BM_BitStream_WriteBits)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_BitStream_WriteBytes(benchmark::State &state)
+{
+  const uint8_t chunk[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  size_t size = 0;
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      bs.WriteBytes(chunk, sizeof(chunk));
+    size = bs.GetSizeBytes();
+    benchmark::DoNotOptimize(bs.GetData());
+  }
+  report_stream(state, counters, size);
+}
+BENCHMARK(BM_BitStream_WriteBytes)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_BitStream_WriteString(benchmark::State &state)
+{
+  const std::string name = "player_with_a_name";
+  size_t size = 0;
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      bs.Write(name);
+    size = bs.GetSizeBytes();
+    benchmark::DoNotOptimize(bs.GetData());
+  }
+  report_stream(state, counters, size);
+}
+BENCHMARK(BM_BitStream_WriteString)->Arg(1)->Arg(8);
+
+static void BM_BitStream_WriteBoolArray(benchmark::State &state)
+{
+  std::vector<bool> bools(state.range(0));
+  for (size_t i = 0; i < bools.size(); ++i)
+    bools[i] = i % 3 == 0;
+  size_t size = 0;
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs;
+    bs.WriteBoolArray(bools);
+    size = bs.GetSizeBytes();
+    benchmark::DoNotOptimize(bs.GetData());
+  }
+  report_stream(state, counters, size);
+}
+BENCHMARK(BM_BitStream_WriteBoolArray)->Arg(8)->Arg(64)->Arg(512);
+
+// Read side: the stream constructor copies the packet, as every deserialize_* does.
+
+static void BM_BitStream_ReadBits(benchmark::State &state)
+{
+  BitStream src;
+  for (int64_t i = 0; i < state.range(0); ++i)
+    src.WriteBits(uint32_t(i * 0x2f3), 11);
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs(src.GetData(), src.GetSizeBytes());
+    uint32_t sum = 0;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      sum += bs.ReadBits(11);
+    benchmark::DoNotOptimize(sum);
+  }
+  report_stream(state, counters, src.GetSizeBytes());
+}
+BENCHMARK(BM_BitStream_ReadBits)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_BitStream_ReadString(benchmark::State &state)
+{
+  BitStream src;
+  for (int64_t i = 0; i < state.range(0); ++i)
+    src.Write(std::string("player_with_a_name"));
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs(src.GetData(), src.GetSizeBytes());
+    std::string s;
+    for (int64_t i = 0; i < state.range(0); ++i)
+      bs.Read(s);
+    benchmark::DoNotOptimize(s.data());
+  }
+  report_stream(state, counters, src.GetSizeBytes());
+}
+BENCHMARK(BM_BitStream_ReadString)->Arg(1)->Arg(8);
+
+static void BM_BitStream_ReadBoolArray(benchmark::State &state)
+{
+  BitStream src;
+  src.WriteBoolArray(std::vector<bool>(state.range(0), true));
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    BitStream bs(src.GetData(), src.GetSizeBytes());
+    std::vector<bool> bools = bs.ReadBoolArray();
+    benchmark::DoNotOptimize(bools.size());
+  }
+  report_stream(state, counters, src.GetSizeBytes());
+}
+BENCHMARK(BM_BitStream_ReadBoolArray)->Arg(8)->Arg(64)->Arg(512);
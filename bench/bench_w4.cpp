@@ -0,0 +1,170 @@
+#include "benchUtils.h"
+#include "protocol.h"
+
+static const Entity sampleEntity = {0x448844ff, 12.5f, -40.f, 7, false, 0.f, 0.f, 18.f, 42};
+
+static void BM_W4_Join_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_join(peer); });
+}
+BENCHMARK(BM_W4_Join_Encode);
+
+static void BM_W4_NewEntity_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); });
+}
+BENCHMARK(BM_W4_NewEntity_Encode);
+
+static void BM_W4_NewEntity_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); },
+    [](ENetPacket *packet)
+    {
+      Entity ent;
+      deserialize_new_entity(packet, ent);
+      benchmark::DoNotOptimize(ent);
+    });
+}
+BENCHMARK(BM_W4_NewEntity_Decode);
+
+static void BM_W4_SetControlled_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 7); });
+}
+BENCHMARK(BM_W4_SetControlled_Encode);
+
+static void BM_W4_SetControlled_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 7); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      deserialize_set_controlled_entity(packet, eid);
+      benchmark::DoNotOptimize(eid);
+    });
+}
+BENCHMARK(BM_W4_SetControlled_Decode);
+
+static void BM_W4_EntityState_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_entity_state(peer, 7, 12.5f, -40.f); });
+}
+BENCHMARK(BM_W4_EntityState_Encode);
+
+static void BM_W4_EntityState_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_entity_state(peer, 7, 12.5f, -40.f); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      float x, y;
+      deserialize_entity_state(packet, eid, x, y);
+      benchmark::DoNotOptimize(eid);
+      benchmark::DoNotOptimize(x);
+      benchmark::DoNotOptimize(y);
+    });
+}
+BENCHMARK(BM_W4_EntityState_Decode);
+
+static void BM_W4_Snapshot_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_snapshot(peer, 7, 12.5f, -40.f, 18.f); });
+}
+BENCHMARK(BM_W4_Snapshot_Encode);
+
+static void BM_W4_Snapshot_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_snapshot(peer, 7, 12.5f, -40.f, 18.f); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      float x, y, size;
+      deserialize_snapshot(packet, eid, x, y, size);
+      benchmark::DoNotOptimize(eid);
+      benchmark::DoNotOptimize(x);
+      benchmark::DoNotOptimize(y);
+      benchmark::DoNotOptimize(size);
+    });
+}
+BENCHMARK(BM_W4_Snapshot_Decode);
+
+static void BM_W4_EntityDevoured_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_entity_devoured(peer, 3, 7, 9.f, 100.f, -100.f); });
+}
+BENCHMARK(BM_W4_EntityDevoured_Encode);
+
+static void BM_W4_EntityDevoured_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_entity_devoured(peer, 3, 7, 9.f, 100.f, -100.f); },
+    [](ENetPacket *packet)
+    {
+      uint16_t devoured, devourer;
+      float size, x, y;
+      deserialize_entity_devoured(packet, devoured, devourer, size, x, y);
+      benchmark::DoNotOptimize(devoured);
+      benchmark::DoNotOptimize(devourer);
+      benchmark::DoNotOptimize(size);
+      benchmark::DoNotOptimize(x);
+      benchmark::DoNotOptimize(y);
+    });
+}
+BENCHMARK(BM_W4_EntityDevoured_Decode);
+
+static void BM_W4_ScoreUpdate_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_score_update(peer, 7, 42); });
+}
+BENCHMARK(BM_W4_ScoreUpdate_Encode);
+
+static void BM_W4_ScoreUpdate_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_score_update(peer, 7, 42); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      int score;
+      deserialize_score_update(packet, eid, score);
+      benchmark::DoNotOptimize(eid);
+      benchmark::DoNotOptimize(score);
+    });
+}
+BENCHMARK(BM_W4_ScoreUpdate_Decode);
+
+static void BM_W4_GameTime_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_game_time(peer, 59); });
+}
+BENCHMARK(BM_W4_GameTime_Encode);
+
+static void BM_W4_GameTime_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_game_time(peer, 59); },
+    [](ENetPacket *packet)
+    {
+      int seconds;
+      deserialize_game_time(packet, seconds);
+      benchmark::DoNotOptimize(seconds);
+    });
+}
+BENCHMARK(BM_W4_GameTime_Decode);
+
+static void BM_W4_GameOver_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_game_over(peer, 7, 42); });
+}
+BENCHMARK(BM_W4_GameOver_Encode);
+
+static void BM_W4_GameOver_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_game_over(peer, 7, 42); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      int score;
+      deserialize_game_over(packet, eid, score);
+      benchmark::DoNotOptimize(eid);
+      benchmark::DoNotOptimize(score);
+    });
+}
+BENCHMARK(BM_W4_GameOver_Decode);
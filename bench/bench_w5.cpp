@@ -0,0 +1,119 @@
+#include "benchUtils.h"
+#include "protocol.h"
+
+static const Entity sampleEntity = {0x448844ff, 10.f, -20.f, 2.f, -30.f, 1.f, 0.5f, 1.f, -1.f, 3};
+static const InputFrame sampleInputs[inputRedundancy] = {{42, 1.f, -1.f}, {41, 1.f, 0.f}, {40, 0.f, 0.f}, {39, -1.f, 1.f}};
+
+static void send_sample_snapshot(ENetPeer *peer)
+{
+  static const TimePoint timestamp = std::chrono::steady_clock::now();
+  send_snapshot(peer, 3, 10.f, -20.f, 1.f, 2.f, -30.f, 0.5f, timestamp, 1234, 1230);
+}
+
+static void BM_W5_Join_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_join(peer); });
+}
+BENCHMARK(BM_W5_Join_Encode);
+
+static void BM_W5_NewEntity_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); });
+}
+BENCHMARK(BM_W5_NewEntity_Encode);
+
+static void BM_W5_NewEntity_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); },
+    [](ENetPacket *packet)
+    {
+      Entity ent;
+      deserialize_new_entity(packet, ent);
+      benchmark::DoNotOptimize(ent);
+    });
+}
+BENCHMARK(BM_W5_NewEntity_Decode);
+
+static void BM_W5_SetControlled_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 3); });
+}
+BENCHMARK(BM_W5_SetControlled_Encode);
+
+static void BM_W5_SetControlled_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 3); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      deserialize_set_controlled_entity(packet, eid);
+      benchmark::DoNotOptimize(eid);
+    });
+}
+BENCHMARK(BM_W5_SetControlled_Decode);
+
+// Arg is the number of redundant inputs in the packet.
+static void BM_W5_EntityInput_Encode(benchmark::State &state)
+{
+  uint8_t count = uint8_t(state.range(0));
+  run_encode(state, [count](ENetPeer *peer) { send_entity_input(peer, 3, sampleInputs, count); });
+}
+BENCHMARK(BM_W5_EntityInput_Encode)->DenseRange(1, inputRedundancy, inputRedundancy - 1);
+
+static void BM_W5_EntityInput_Decode(benchmark::State &state)
+{
+  uint8_t count = uint8_t(state.range(0));
+  run_decode(state, [count](ENetPeer *peer) { send_entity_input(peer, 3, sampleInputs, count); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      InputFrame inputs[inputRedundancy];
+      uint8_t num;
+      deserialize_entity_input(packet, eid, inputs, num);
+      benchmark::DoNotOptimize(inputs);
+      benchmark::DoNotOptimize(num);
+    });
+}
+BENCHMARK(BM_W5_EntityInput_Decode)->DenseRange(1, inputRedundancy, inputRedundancy - 1);
+
+static void BM_W5_Snapshot_Encode(benchmark::State &state)
+{
+  run_encode(state, send_sample_snapshot);
+}
+BENCHMARK(BM_W5_Snapshot_Encode);
+
+static void BM_W5_Snapshot_Decode(benchmark::State &state)
+{
+  run_decode(state, send_sample_snapshot,
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      float x, y, ori, vx, vy, omega;
+      TimePoint timestamp;
+      uint32_t frame, lastInput;
+      deserialize_snapshot(packet, eid, x, y, ori, vx, vy, omega, timestamp, frame, lastInput);
+      benchmark::DoNotOptimize(x);
+      benchmark::DoNotOptimize(omega);
+      benchmark::DoNotOptimize(timestamp);
+      benchmark::DoNotOptimize(lastInput);
+    });
+}
+BENCHMARK(BM_W5_Snapshot_Decode);
+
+static void BM_W5_TimeMsec_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_time_msec(peer, 123456); });
+}
+BENCHMARK(BM_W5_TimeMsec_Encode);
+
+static void BM_W5_TimeMsec_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_time_msec(peer, 123456); },
+    [](ENetPacket *packet)
+    {
+      uint32_t timeMsec;
+      deserialize_time_msec(packet, timeMsec);
+      benchmark::DoNotOptimize(timeMsec);
+    });
+}
+BENCHMARK(BM_W5_TimeMsec_Decode);
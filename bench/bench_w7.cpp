@@ -0,0 +1,176 @@
+#include "benchUtils.h"
+#include "protocol.h"
+#include "quantisation.h"
+#include "shipState.h"
+
+static const Entity sampleEntity = {0x448844ff, false, 10.f, -20.f, 2.f, -30.f, 1.f, 0.f, 1.f, -1.f, 3};
+static const InputFrame sampleInputs[inputRedundancy] = {{42, 1.f, -1.f}, {41, 1.f, 0.f}, {40, 0.f, 0.f}, {39, -1.f, 1.f}};
+
+static void send_sample_snapshot(ENetPeer *peer)
+{
+  send_snapshot(peer, 3, 10.f, -20.f, 1.f, 2.f, -30.f, 1230);
+}
+
+static void BM_W7_Join_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_join(peer); });
+}
+BENCHMARK(BM_W7_Join_Encode);
+
+static void BM_W7_NewEntity_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); });
+}
+BENCHMARK(BM_W7_NewEntity_Encode);
+
+static void BM_W7_NewEntity_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_new_entity(peer, sampleEntity); },
+    [](ENetPacket *packet)
+    {
+      Entity ent;
+      benchmark::DoNotOptimize(deserialize_new_entity(packet, ent));
+      benchmark::DoNotOptimize(ent);
+    });
+}
+BENCHMARK(BM_W7_NewEntity_Decode);
+
+static void BM_W7_SetControlled_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 3); });
+}
+BENCHMARK(BM_W7_SetControlled_Encode);
+
+static void BM_W7_SetControlled_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_set_controlled_entity(peer, 3); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      benchmark::DoNotOptimize(deserialize_set_controlled_entity(packet, eid));
+      benchmark::DoNotOptimize(eid);
+    });
+}
+BENCHMARK(BM_W7_SetControlled_Decode);
+
+// Arg is the number of redundant inputs in the packet.
+static void BM_W7_EntityInput_Encode(benchmark::State &state)
+{
+  uint8_t count = uint8_t(state.range(0));
+  run_encode(state, [count](ENetPeer *peer) { send_entity_input(peer, 3, sampleInputs, count); });
+}
+BENCHMARK(BM_W7_EntityInput_Encode)->DenseRange(1, inputRedundancy, inputRedundancy - 1);
+
+static void BM_W7_EntityInput_Decode(benchmark::State &state)
+{
+  uint8_t count = uint8_t(state.range(0));
+  run_decode(state, [count](ENetPeer *peer) { send_entity_input(peer, 3, sampleInputs, count); },
+    [](ENetPacket *packet)
+    {
+      uint16_t eid;
+      InputFrame inputs[inputRedundancy];
+      uint8_t num;
+      benchmark::DoNotOptimize(deserialize_entity_input(packet, eid, inputs, num));
+      benchmark::DoNotOptimize(inputs);
+    });
+}
+BENCHMARK(BM_W7_EntityInput_Decode)->DenseRange(1, inputRedundancy, inputRedundancy - 1);
+
+static void BM_W7_Snapshot_Encode(benchmark::State &state)
+{
+  run_encode(state, send_sample_snapshot);
+}
+BENCHMARK(BM_W7_Snapshot_Encode);
+
+static void BM_W7_Snapshot_Decode(benchmark::State &state)
+{
+  run_decode(state, send_sample_snapshot,
+    [](ENetPacket *packet)
+    {
+      uint16_t eid, lastInput;
+      float x, y, ori, vx, vy;
+      benchmark::DoNotOptimize(deserialize_snapshot(packet, eid, x, y, ori, vx, vy, lastInput));
+      benchmark::DoNotOptimize(x);
+      benchmark::DoNotOptimize(vy);
+    });
+}
+BENCHMARK(BM_W7_Snapshot_Decode);
+
+static void BM_W7_TimeMsec_Encode(benchmark::State &state)
+{
+  run_encode(state, [](ENetPeer *peer) { send_time_msec(peer, 123456); });
+}
+BENCHMARK(BM_W7_TimeMsec_Encode);
+
+static void BM_W7_TimeMsec_Decode(benchmark::State &state)
+{
+  run_decode(state, [](ENetPeer *peer) { send_time_msec(peer, 123456); },
+    [](ENetPacket *packet)
+    {
+      uint32_t timeMsec;
+      benchmark::DoNotOptimize(deserialize_time_msec(packet, timeMsec));
+      benchmark::DoNotOptimize(timeMsec);
+    });
+}
+BENCHMARK(BM_W7_TimeMsec_Decode);
+
+// Quantisation kernels, items are single floats.
+
+static const float sampleValues[8] = {-1.f, -0.6f, -0.25f, 0.f, 0.1f, 0.5f, 0.75f, 1.f};
+
+static void BM_W7_ControlQuantiser_Pack(benchmark::State &state)
+{
+  OpCounters counters;
+  for (auto _ : state)
+    for (float v : sampleValues)
+      benchmark::DoNotOptimize(ControlQuantiser::pack(v));
+  counters.report(state);
+  state.SetItemsProcessed(state.iterations() * std::size(sampleValues));
+}
+BENCHMARK(BM_W7_ControlQuantiser_Pack);
+
+static void BM_W7_ControlQuantiser_Unpack(benchmark::State &state)
+{
+  OpCounters counters;
+  for (auto _ : state)
+    for (uint8_t c = 0; c < 16; ++c)
+      benchmark::DoNotOptimize(ControlQuantiser::unpack(c));
+  counters.report(state);
+  state.SetItemsProcessed(state.iterations() * 16);
+}
+BENCHMARK(BM_W7_ControlQuantiser_Unpack);
+
+// Arg is the number of ships in the batch.
+static void BM_W7_PackShipStates(benchmark::State &state)
+{
+  std::vector<ShipState> ships(state.range(0));
+  for (size_t i = 0; i < ships.size(); ++i)
+    ships[i] = {float(i % 200) - 100.f, 50.f - float(i % 90), float(i % 6) - 3.f, float(i % 9) - 4.f, float(i % 60) - 30.f};
+  std::vector<uint8_t> packed(ships.size() * packedShipStateSize);
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    pack_ship_states(ships.data(), (PackedShipState*)packed.data(), ships.size());
+    benchmark::DoNotOptimize(packed.data());
+  }
+  counters.report(state, packed.size());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_W7_PackShipStates)->Arg(1)->Arg(64);
+
+static void BM_W7_UnpackShipStates(benchmark::State &state)
+{
+  std::vector<ShipState> ships(state.range(0));
+  std::vector<uint8_t> packed(ships.size() * packedShipStateSize);
+  for (size_t i = 0; i < packed.size(); ++i)
+    packed[i] = uint8_t(i * 37);
+  OpCounters counters;
+  for (auto _ : state)
+  {
+    unpack_ship_states((const PackedShipState*)packed.data(), ships.data(), ships.size());
+    benchmark::DoNotOptimize(ships.data());
+  }
+  counters.report(state, packed.size());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_W7_UnpackShipStates)->Arg(1)->Arg(64);
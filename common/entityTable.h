@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sparse set of entities keyed by their uint16_t `eid` member.
+// Entities live packed in one vector, so iterating them touches only live
+// entities in order, and an eid-indexed table of positions into that vector
+// makes lookups O(1). remove() moves the last entity into the hole, which
+// changes the order (and the indices) of the remaining ones.
+template<typename T>
+class EntityTable
+{
+public:
+  static constexpr uint32_t npos = ~0u;
+
+  // Returns false if an entity with this eid is already there.
+  bool add(const T &ent)
+  {
+    if (ent.eid >= indices.size())
+      indices.resize(size_t(ent.eid) + 1, npos);
+    else if (indices[ent.eid] != npos)
+      return false;
+    indices[ent.eid] = uint32_t(items.size());
+    items.push_back(ent);
+    return true;
+  }
+
+  // Returns false if there is no such entity.
+  bool remove(uint16_t eid)
+  {
+    uint32_t idx = index_of(eid);
+    if (idx == npos)
+      return false;
+    if (idx + 1 != items.size())
+    {
+      items[idx] = items.back();
+      indices[items[idx].eid] = idx;
+    }
+    items.pop_back();
+    indices[eid] = npos;
+    return true;
+  }
+
+  uint32_t index_of(uint16_t eid) const { return eid < indices.size() ? indices[eid] : npos; }
+
+  T *find(uint16_t eid)
+  {
+    uint32_t idx = index_of(eid);
+    return idx != npos ? &items[idx] : nullptr;
+  }
+
+  const T *find(uint16_t eid) const
+  {
+    uint32_t idx = index_of(eid);
+    return idx != npos ? &items[idx] : nullptr;
+  }
+
+  void clear()
+  {
+    items.clear();
+    indices.clear();
+  }
+
+  size_t size() const { return items.size(); }
+  bool empty() const { return items.empty(); }
+
+  T &operator[](size_t idx) { return items[idx]; }
+  const T &operator[](size_t idx) const { return items[idx]; }
+  T &back() { return items.back(); }
+  const T &back() const { return items.back(); }
+  // size() entities stored contiguously
+  const T *data() const { return items.data(); }
+
+  typename std::vector<T>::iterator begin() { return items.begin(); }
+  typename std::vector<T>::iterator end() { return items.end(); }
+  typename std::vector<T>::const_iterator begin() const { return items.begin(); }
+  typename std::vector<T>::const_iterator end() const { return items.end(); }
+
+private:
+  std::vector<T> items;
+  std::vector<uint32_t> indices; // indexed by eid
+};
@@ -0,0 +1,35 @@
+#include "fakeEnet.h"
+#include <cstring>
+
+static FakeEnetSendCallback sendCallback = nullptr;
+
+void fake_enet_set_send_callback(FakeEnetSendCallback callback)
+{
+  sendCallback = callback;
+}
+
+// Two allocations per packet like the real one, so allocation counts carry over.
+ENetPacket *enet_packet_create(const void *data, size_t dataLength, enet_uint32 flags)
+{
+  ENetPacket *packet = new ENetPacket();
+  packet->data = new enet_uint8[dataLength > 0 ? dataLength : 1];
+  packet->dataLength = dataLength;
+  packet->flags = flags;
+  if (data)
+    memcpy(packet->data, data, dataLength);
+  return packet;
+}
+
+void enet_packet_destroy(ENetPacket *packet)
+{
+  delete[] packet->data;
+  delete packet;
+}
+
+int enet_peer_send(ENetPeer *peer, enet_uint8 channelID, ENetPacket *packet)
+{
+  if (sendCallback)
+    sendCallback(peer, channelID, packet);
+  enet_packet_destroy(packet);
+  return 0;
+}
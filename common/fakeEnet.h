@@ -0,0 +1,11 @@
+#pragma once
+#include <enet/enet.h>
+
+// Stand-in for the ENet calls protocol code makes (enet_packet_create,
+// enet_packet_destroy, enet_peer_send) for tools that run encoders and
+// decoders without a network, e.g. fuzz targets and benchmarks.
+// Link fakeEnet.cpp instead of the enet library. enet_peer_send hands the
+// packet to the installed callback, then destroys it.
+typedef void (*FakeEnetSendCallback)(ENetPeer *peer, enet_uint8 channel, const ENetPacket *packet);
+
+void fake_enet_set_send_callback(FakeEnetSendCallback callback);
@@ -0,0 +1,79 @@
+#include "hdrHistogram.h"
+#include <algorithm>
+#include <bit>
+
+static constexpr uint64_t subBucketCount = uint64_t(1) << HdrHistogram::subBucketBits;
+static constexpr size_t numBlocks = HdrHistogram::maxValueBits - HdrHistogram::subBucketBits + 1;
+static constexpr uint64_t maxTrackedValue = (uint64_t(1) << HdrHistogram::maxValueBits) - 1;
+
+HdrHistogram::HdrHistogram()
+  : counts(numBlocks * subBucketCount, 0)
+{
+}
+
+size_t HdrHistogram::bucket_index(uint64_t value)
+{
+  // block 0 holds [0, subBucketCount) one value per bucket, block b the values with the top bit at b + subBucketBits - 1
+  if (value < subBucketCount)
+    return size_t(value);
+  int topBit = 63 - std::countl_zero(value);
+  int shift = topBit - subBucketBits;
+  size_t block = size_t(shift + 1);
+  return block * subBucketCount + size_t((value >> shift) - subBucketCount);
+}
+
+uint64_t HdrHistogram::bucket_upper_value(size_t index)
+{
+  size_t block = index / subBucketCount;
+  uint64_t offset = index % subBucketCount;
+  if (block == 0)
+    return offset;
+  int shift = int(block) - 1;
+  return ((subBucketCount + offset + 1) << shift) - 1;
+}
+
+void HdrHistogram::record(uint64_t value)
+{
+  value = std::min(value, maxTrackedValue);
+  counts[bucket_index(value)]++;
+  total++;
+  sum += value;
+  minValue = std::min(minValue, value);
+  maxValue = std::max(maxValue, value);
+}
+
+void HdrHistogram::reset()
+{
+  std::fill(counts.begin(), counts.end(), 0);
+  total = 0;
+  sum = 0;
+  minValue = UINT64_MAX;
+  maxValue = 0;
+}
+
+void HdrHistogram::merge(const HdrHistogram &other)
+{
+  for (size_t i = 0; i < counts.size(); ++i)
+    counts[i] += other.counts[i];
+  total += other.total;
+  sum += other.sum;
+  minValue = std::min(minValue, other.minValue);
+  maxValue = std::max(maxValue, other.maxValue);
+}
+
+uint64_t HdrHistogram::value_at_percentile(double percentile) const
+{
+  if (total == 0)
+    return 0;
+  // rank of the sample, 1-based, at least the first one
+  uint64_t rank = uint64_t(percentile / 100.0 * double(total) + 0.5);
+  rank = std::clamp<uint64_t>(rank, 1, total);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); ++i)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(bucket_upper_value(i), maxValue);
+  }
+  return maxValue;
+}
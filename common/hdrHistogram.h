@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// High dynamic range histogram of non-negative integer samples (e.g. nanoseconds).
+// Buckets are log-linear: values below 2^subBucketBits are counted exactly,
+// every power of two above that is split into 2^subBucketBits equal buckets,
+// so any recorded value is reported within 1/128 (0.8%) of itself.
+// Fixed memory, recording never allocates.
+class HdrHistogram
+{
+public:
+  static constexpr int subBucketBits = 7;
+  // samples are clamped to this many bits, 2^40 ns is about 18 minutes
+  static constexpr int maxValueBits = 40;
+
+  HdrHistogram();
+
+  void record(uint64_t value);
+  void reset();
+  void merge(const HdrHistogram &other);
+
+  uint64_t count() const { return total; }
+  uint64_t min() const { return total ? minValue : 0; }
+  uint64_t max() const { return maxValue; }
+  double mean() const { return total ? double(sum) / double(total) : 0.0; }
+  // Smallest recorded value that `percentile` percent of the samples are not above,
+  // reported as the upper end of its bucket.
+  uint64_t value_at_percentile(double percentile) const;
+
+private:
+  static size_t bucket_index(uint64_t value);
+  static uint64_t bucket_upper_value(size_t index);
+
+  std::vector<uint64_t> counts;
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint64_t minValue = UINT64_MAX;
+  uint64_t maxValue = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Entity id plus the generation of its slot when the handle was taken.
+struct EntityHandle
+{
+  uint16_t id = 0xffff;
+  uint16_t generation = 0;
+};
+
+// Dense entity ids with O(1) allocate and free. Freed ids are reused oldest
+// first, which gives packets still naming the old entity the most time to
+// drain before the id means something else. Each id slot counts its
+// generation, free() bumps it, so a handle taken before the id was freed no
+// longer passes is_valid() once the id is reused.
+class IdAllocator
+{
+public:
+  static constexpr uint16_t invalidId = 0xffff; // same as invalid_entity
+
+  // Ids are in [0, max_ids).
+  explicit IdAllocator(uint16_t max_ids = invalidId) : maxIds(max_ids) {}
+
+  // Returns invalidId when every id is in use.
+  uint16_t allocate()
+  {
+    uint16_t id = invalidId;
+    if (!freeIds.empty())
+    {
+      id = freeIds.front();
+      freeIds.pop_front();
+    }
+    else if (generations.size() < maxIds)
+    {
+      id = uint16_t(generations.size());
+      generations.push_back(0);
+      alive.push_back(0);
+    }
+    else
+      return invalidId;
+    alive[id] = 1;
+    numAlive++;
+    return id;
+  }
+
+  // Returns false for ids that are not in use.
+  bool free(uint16_t id)
+  {
+    if (!is_alive(id))
+      return false;
+    alive[id] = 0;
+    generations[id]++;
+    freeIds.push_back(id);
+    numAlive--;
+    return true;
+  }
+
+  bool is_alive(uint16_t id) const { return id < alive.size() && alive[id]; }
+
+  EntityHandle handle(uint16_t id) const
+  {
+    EntityHandle h;
+    if (is_alive(id))
+    {
+      h.id = id;
+      h.generation = generations[id];
+    }
+    return h;
+  }
+
+  bool is_valid(const EntityHandle &h) const { return is_alive(h.id) && generations[h.id] == h.generation; }
+
+  size_t size() const { return numAlive; }
+  // Highest id handed out so far plus one, enough to size per-id arrays.
+  size_t id_bound() const { return generations.size(); }
+
+private:
+  uint16_t maxIds;
+  std::vector<uint16_t> generations;
+  std::vector<uint8_t> alive;
+  std::deque<uint16_t> freeIds;
+  size_t numAlive = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t invalid_input_frame = -1;
+
+// How many of the newest inputs every client input packet repeats.
+// Losing fewer than this many packets in a row loses no input at all.
+constexpr uint8_t inputRedundancy = 4;
+
+struct InputFrame
+{
+  uint32_t frameNumber = invalid_input_frame;
+  float thr = 0.f;
+  float steer = 0.f;
+};
+
+// Per-player jitter buffer on the server.
+// Inputs arrive redundantly and possibly out of order, the server consumes
+// exactly one per tick in client frame order. When the buffer runs dry it
+// waits until `targetDepth` frames are queued again before resuming, so a
+// late burst of packets does not make the player skip ahead. When clock
+// drift or a latency spike leaves more than twice `targetDepth` queued, one
+// frame is dropped per tick until the depth is back, so the extra input
+// latency does not stay for good.
+template<size_t N>
+class InputQueue
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "InputQueue size must be a power of two");
+
+  InputFrame slots[N];
+  uint32_t nextFrame = invalid_input_frame;
+  uint32_t newestFrame = invalid_input_frame;
+  uint32_t lastProcessed = invalid_input_frame;
+  uint32_t targetDepth = 1;
+  bool buffering = true;
+
+  InputFrame &slot(uint32_t frame) { return slots[frame & (N - 1)]; }
+
+public:
+  explicit InputQueue(uint32_t target_depth = 1) : targetDepth(target_depth) {}
+
+  void push(const InputFrame &in)
+  {
+    if (nextFrame == invalid_input_frame)
+      nextFrame = newestFrame = in.frameNumber;
+    if (int32_t(in.frameNumber - nextFrame) < 0)
+      return; // already consumed or skipped, redundant copy
+    if (in.frameNumber - nextFrame >= N)
+    {
+      // client is too far ahead of us (long stall), drop the backlog
+      nextFrame = in.frameNumber - (targetDepth - 1 < N ? targetDepth - 1 : N - 1);
+      buffering = true;
+    }
+    slot(in.frameNumber) = in;
+    if (int32_t(in.frameNumber - newestFrame) > 0)
+      newestFrame = in.frameNumber;
+  }
+
+  // Number of frames between the next one to consume and the newest received.
+  uint32_t depth() const
+  {
+    if (nextFrame == invalid_input_frame || int32_t(newestFrame - nextFrame) < 0)
+      return 0;
+    return newestFrame - nextFrame + 1;
+  }
+
+  // Consumes the input for the next tick, returns false when there is none
+  // and the caller should keep applying the previous input.
+  bool pop(InputFrame &out)
+  {
+    uint32_t available = depth();
+    if (available == 0)
+    {
+      buffering = true;
+      return false;
+    }
+    if (buffering && available < targetDepth)
+      return false;
+    buffering = false;
+
+    if (available > 2 * targetDepth)
+    {
+      nextFrame++;
+      available--;
+    }
+
+    if (slot(nextFrame).frameNumber != nextFrame)
+    {
+      // a gap may still be filled by the next redundant packet, give it a tick
+      if (available <= targetDepth)
+        return false;
+      // otherwise it was lost in more than `inputRedundancy` packets, skip it
+      while (slot(nextFrame).frameNumber != nextFrame && nextFrame != newestFrame)
+        nextFrame++;
+    }
+
+    out = slot(nextFrame);
+    lastProcessed = nextFrame;
+    nextFrame++;
+    return true;
+  }
+
+  uint32_t last_processed_frame() const { return lastProcessed; }
+};
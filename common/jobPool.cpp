@@ -0,0 +1,79 @@
+#include "jobPool.h"
+
+size_t JobPool::default_worker_count()
+{
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw > 1 ? hw - 1 : 0;
+}
+
+JobPool::JobPool(size_t num_workers)
+{
+  workers.reserve(num_workers);
+  for (size_t i = 0; i < num_workers; ++i)
+    workers.emplace_back([this]() { worker_loop(); });
+}
+
+JobPool::~JobPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (std::thread &t : workers)
+    t.join();
+}
+
+void JobPool::run_jobs(std::unique_lock<std::mutex> &lock)
+{
+  // the mutex is released while a job runs
+  while (nextJob < jobCount)
+  {
+    size_t idx = nextJob++;
+    const std::function<void(size_t)> &job = *curJob;
+    lock.unlock();
+    job(idx);
+    lock.lock();
+  }
+}
+
+void JobPool::worker_loop()
+{
+  uint64_t seenGeneration = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    wake.wait(lock, [&]() { return quit || generation != seenGeneration; });
+    if (quit)
+      return;
+    seenGeneration = generation;
+    busyWorkers++;
+    run_jobs(lock);
+    if (--busyWorkers == 0)
+      done.notify_one();
+  }
+}
+
+void JobPool::parallel_for(size_t count, const std::function<void(size_t)> &job)
+{
+  if (count == 0)
+    return;
+  if (workers.empty() || count == 1)
+  {
+    for (size_t i = 0; i < count; ++i)
+      job(i);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  curJob = &job;
+  jobCount = count;
+  nextJob = 0;
+  generation++;
+  wake.notify_all();
+
+  run_jobs(lock);
+  // workers that woke up late find no jobs left and leave right away
+  done.wait(lock, [&]() { return busyWorkers == 0; });
+  curJob = nullptr;
+}
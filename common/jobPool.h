@@ -0,0 +1,47 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel stages of a server tick.
+// parallel_for blocks the caller, which works on the jobs too, until every
+// job is done, so whatever the jobs read stays unchanged for the whole stage.
+// Only one thread may call parallel_for at a time.
+class JobPool
+{
+public:
+  // hardware threads minus the calling one
+  static size_t default_worker_count();
+
+  explicit JobPool(size_t num_workers = default_worker_count());
+  ~JobPool();
+
+  JobPool(const JobPool&) = delete;
+  JobPool &operator=(const JobPool&) = delete;
+
+  // Runs job(i) for every i in [0, count).
+  void parallel_for(size_t count, const std::function<void(size_t)> &job);
+
+  size_t worker_count() const { return workers.size(); }
+
+private:
+  void worker_loop();
+  void run_jobs(std::unique_lock<std::mutex> &lock);
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  uint64_t generation = 0;
+  bool quit = false;
+
+  // current stage, guarded by mutex except for the job index itself
+  const std::function<void(size_t)> *curJob = nullptr;
+  size_t jobCount = 0;
+  size_t nextJob = 0;
+  size_t busyWorkers = 0;
+};
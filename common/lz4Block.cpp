@@ -0,0 +1,147 @@
+#include "lz4Block.h"
+#include <cstring>
+
+constexpr size_t minMatch = 4;
+constexpr size_t lastLiterals = 5;  // the block always ends with this many literals
+constexpr size_t matchStartLimit = 12; // no match may start closer to the end
+constexpr size_t maxOffset = 65535;
+constexpr unsigned hashBits = 12;
+
+static uint32_t read32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash_sequence(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - hashBits);
+}
+
+// Writes the 255-run extension of a length that did not fit its token nibble.
+static bool write_length(uint8_t *dst, size_t capacity, size_t &op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+  {
+    if (op >= capacity)
+      return false;
+    dst[op++] = 255;
+  }
+  if (op >= capacity)
+    return false;
+  dst[op++] = uint8_t(len);
+  return true;
+}
+
+static bool write_sequence(uint8_t *dst, size_t capacity, size_t &op,
+                           const uint8_t *literals, size_t lit_len, size_t offset, size_t match_len)
+{
+  if (op >= capacity)
+    return false;
+  size_t token = op++;
+  dst[token] = uint8_t((lit_len < 15 ? lit_len : 15) << 4);
+  if (lit_len >= 15 && !write_length(dst, capacity, op, lit_len - 15))
+    return false;
+  if (lit_len > capacity - op)
+    return false;
+  if (lit_len)
+    memcpy(dst + op, literals, lit_len);
+  op += lit_len;
+  if (match_len == 0)
+    return true; // the last sequence has literals only
+  if (capacity - op < 2)
+    return false;
+  dst[op++] = uint8_t(offset);
+  dst[op++] = uint8_t(offset >> 8);
+  size_t code = match_len - minMatch;
+  dst[token] |= uint8_t(code < 15 ? code : 15);
+  return code < 15 || write_length(dst, capacity, op, code - 15);
+}
+
+size_t lz4_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity)
+{
+  // positions + 1 of the last occurence of each hashed 4 byte sequence, 0 for none
+  uint32_t table[1 << hashBits] = {};
+  size_t op = 0;
+  size_t anchor = 0;
+  size_t ip = 0;
+  const size_t matchLimit = size > lastLiterals ? size - lastLiterals : 0;
+  while (ip + matchStartLimit <= size)
+  {
+    uint32_t seq = read32(src + ip);
+    uint32_t h = hash_sequence(seq);
+    size_t ref = table[h];
+    table[h] = uint32_t(ip + 1);
+    if (ref == 0 || ip - (ref - 1) > maxOffset || read32(src + ref - 1) != seq)
+    {
+      ip++;
+      continue;
+    }
+    ref--;
+    size_t len = minMatch;
+    while (ip + len < matchLimit && src[ref + len] == src[ip + len])
+      len++;
+    if (!write_sequence(dst, capacity, op, src + anchor, ip - anchor, ip - ref, len))
+      return 0;
+    ip += len;
+    anchor = ip;
+  }
+  if (!write_sequence(dst, capacity, op, src + anchor, size - anchor, 0, 0))
+    return 0;
+  return op;
+}
+
+// Reads a length continued in 255-runs, false if the input ends first.
+static bool read_length(const uint8_t *src, size_t size, size_t &ip, size_t &len)
+{
+  uint8_t b;
+  do
+  {
+    if (ip >= size)
+      return false;
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool lz4_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size)
+{
+  size_t ip = 0;
+  size_t op = 0;
+  while (ip < size)
+  {
+    uint8_t token = src[ip++];
+    size_t litLen = token >> 4;
+    if (litLen == 15 && !read_length(src, size, ip, litLen))
+      return false;
+    if (litLen > size - ip || litLen > dst_size - op)
+      return false;
+    if (litLen)
+      memcpy(dst + op, src + ip, litLen);
+    ip += litLen;
+    op += litLen;
+    if (ip == size)
+      return op == dst_size; // the last sequence has no match
+
+    if (size - ip < 2)
+      return false;
+    size_t offset = src[ip] | (size_t(src[ip + 1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > op)
+      return false;
+    size_t matchLen = token & 15;
+    if (matchLen == 15 && !read_length(src, size, ip, matchLen))
+      return false;
+    matchLen += minMatch;
+    if (matchLen > dst_size - op)
+      return false;
+    // byte by byte, a match may overlap the bytes it produces
+    const uint8_t *match = dst + op - offset;
+    for (size_t i = 0; i < matchLen; ++i)
+      dst[op + i] = match[i];
+    op += matchLen;
+  }
+  return false;
+}
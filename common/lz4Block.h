@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format (no frame header, no checksum), interchangeable with
+// LZ4_compress_default/LZ4_decompress_safe from liblz4. Small enough to keep
+// in tree for compressing bulk messages like the join time world state.
+
+// Worst case compressed size for `size` input bytes.
+constexpr size_t lz4_compress_bound(size_t size) { return size + size / 255 + 16; }
+
+// Returns the compressed size, 0 if `capacity` is too small.
+size_t lz4_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+// Decodes a block that must expand to exactly `dst_size` bytes. Never reads
+// or writes out of bounds, returns false for malformed or truncated input.
+bool lz4_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size);
@@ -0,0 +1,123 @@
+#include "messageStats.h"
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+struct MessageStatsRegistry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<MessageStatsBlock>> blocks;
+};
+}
+
+static MessageStatsRegistry &registry()
+{
+  static MessageStatsRegistry r;
+  return r;
+}
+
+MessageStatsBlock &message_stats_block()
+{
+  // owned by the registry, a thread that exits leaves its counts in the totals
+  thread_local MessageStatsBlock *block = nullptr;
+  if (!block)
+  {
+    MessageStatsRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.push_back(std::make_unique<MessageStatsBlock>());
+    block = r.blocks.back().get();
+  }
+  return *block;
+}
+
+void message_stats_snapshot(std::vector<MessageTypeStats> &out)
+{
+  out.assign(maxMessageTypes, MessageTypeStats());
+  MessageStatsRegistry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const std::unique_ptr<MessageStatsBlock> &block : r.blocks)
+  {
+    for (size_t type = 0; type < maxMessageTypes; ++type)
+    {
+      const std::atomic<uint64_t> *c = block->counters[type];
+      MessageTypeStats &s = out[type];
+      s.sentPackets += c[MessageStatsBlock::SentPackets].load(std::memory_order_relaxed);
+      s.sentBytes += c[MessageStatsBlock::SentBytes].load(std::memory_order_relaxed);
+      s.sentRawBits += c[MessageStatsBlock::SentRawBits].load(std::memory_order_relaxed);
+      s.receivedPackets += c[MessageStatsBlock::ReceivedPackets].load(std::memory_order_relaxed);
+      s.receivedBytes += c[MessageStatsBlock::ReceivedBytes].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Stats per name, the unknown bucket collects every type from its index on.
+static void collect_by_name(const std::vector<const char*> &type_names, std::vector<MessageTypeStats> &out)
+{
+  std::vector<MessageTypeStats> all;
+  message_stats_snapshot(all);
+  size_t unknownIdx = type_names.empty() ? 0 : type_names.size() - 1;
+  out.assign(type_names.size(), MessageTypeStats());
+  for (size_t type = 0; type < all.size() && !out.empty(); ++type)
+  {
+    MessageTypeStats &s = out[type < unknownIdx ? type : unknownIdx];
+    s.sentPackets += all[type].sentPackets;
+    s.sentBytes += all[type].sentBytes;
+    s.sentRawBits += all[type].sentRawBits;
+    s.receivedPackets += all[type].receivedPackets;
+    s.receivedBytes += all[type].receivedBytes;
+  }
+}
+
+void print_message_stats(FILE *out, const std::vector<const char*> &type_names)
+{
+  std::vector<MessageTypeStats> stats;
+  collect_by_name(type_names, stats);
+  fprintf(out, "%-24s %10s %12s %12s %12s %7s %10s %12s\n",
+          "message", "sent", "sent bytes", "raw bits", "wire bits", "ratio", "received", "recv bytes");
+  for (size_t type = 0; type < stats.size(); ++type)
+  {
+    const MessageTypeStats &s = stats[type];
+    if (s.sentPackets == 0 && s.receivedPackets == 0)
+      continue;
+    uint64_t wireBits = s.sentBytes * 8;
+    double ratio = s.sentRawBits ? double(wireBits) / double(s.sentRawBits) : 1.0;
+    fprintf(out, "%-24s %10" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %7.3f %10" PRIu64 " %12" PRIu64 "\n",
+            type_names[type], s.sentPackets, s.sentBytes, s.sentRawBits, wireBits, ratio,
+            s.receivedPackets, s.receivedBytes);
+  }
+}
+
+void write_message_metrics(std::string &out, const char *server_name, const std::vector<const char*> &type_names)
+{
+  std::vector<MessageTypeStats> stats;
+  collect_by_name(type_names, stats);
+  struct Series
+  {
+    const char *name;
+    const char *help;
+    uint64_t MessageTypeStats::*field;
+  };
+  const Series series[] = {
+    {"netserver_messages_sent_total", "Messages built for sending by type.", &MessageTypeStats::sentPackets},
+    {"netserver_message_sent_bytes_total", "Bytes of the messages built for sending by type.", &MessageTypeStats::sentBytes},
+    {"netserver_message_sent_raw_bits_total", "Bits the sent messages take before quantisation and compression.", &MessageTypeStats::sentRawBits},
+    {"netserver_messages_received_total", "Messages dispatched by type.", &MessageTypeStats::receivedPackets},
+    {"netserver_message_received_bytes_total", "Bytes of the dispatched messages by type.", &MessageTypeStats::receivedBytes},
+  };
+  char buf[256];
+  for (const Series &s : series)
+  {
+    snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s counter\n", s.name, s.help, s.name);
+    out += buf;
+    for (size_t type = 0; type < stats.size(); ++type)
+    {
+      uint64_t value = stats[type].*s.field;
+      if (value == 0)
+        continue;
+      snprintf(buf, sizeof(buf), "%s{server=\"%s\",type=\"%s\"} %" PRIu64 "\n", s.name, server_name, type_names[type], value);
+      out += buf;
+    }
+  }
+}
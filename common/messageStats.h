@@ -0,0 +1,78 @@
+#pragma once
+#include <enet/enet.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Process wide traffic counters per message type, kept by the protocol layer:
+// every send_*/create_*_packet counts the packet it built and the receive
+// loops count each packet right before dispatching on get_packet_type(). The
+// type is the first byte of the packet.
+//
+// Each thread counts into its own block, so counting is a few plain adds with
+// no locks or contended cache lines. Blocks live until the process exits and
+// are summed when the stats are read.
+constexpr size_t maxMessageTypes = 32;
+
+struct MessageTypeStats
+{
+  uint64_t sentPackets = 0;
+  uint64_t sentBytes = 0;
+  uint64_t sentRawBits = 0; // what the fields take before quantisation and compression
+  uint64_t receivedPackets = 0;
+  uint64_t receivedBytes = 0;
+};
+
+struct MessageStatsBlock
+{
+  enum Counter { SentPackets, SentBytes, SentRawBits, ReceivedPackets, ReceivedBytes, NumCounters };
+  // written by the owning thread only, atomic so that reading them from another one is no race
+  std::atomic<uint64_t> counters[maxMessageTypes][NumCounters] = {};
+
+  void add(uint8_t type, Counter counter, uint64_t n)
+  {
+    std::atomic<uint64_t> &c = counters[type < maxMessageTypes ? type : maxMessageTypes - 1][counter];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+};
+
+// The calling thread's block, registered on first use.
+MessageStatsBlock &message_stats_block();
+
+// `raw_bits` is the size of the message with every field at full precision
+// and nothing compressed, the packet's own size if nothing is.
+inline void message_stats_sent(const ENetPacket *packet, size_t raw_bits)
+{
+  if (packet->dataLength == 0)
+    return;
+  MessageStatsBlock &block = message_stats_block();
+  block.add(packet->data[0], MessageStatsBlock::SentPackets, 1);
+  block.add(packet->data[0], MessageStatsBlock::SentBytes, packet->dataLength);
+  block.add(packet->data[0], MessageStatsBlock::SentRawBits, raw_bits);
+}
+
+inline void message_stats_sent(const ENetPacket *packet)
+{
+  message_stats_sent(packet, packet->dataLength * 8);
+}
+
+inline void message_stats_received(const ENetPacket *packet)
+{
+  if (packet->dataLength == 0)
+    return;
+  MessageStatsBlock &block = message_stats_block();
+  block.add(packet->data[0], MessageStatsBlock::ReceivedPackets, 1);
+  block.add(packet->data[0], MessageStatsBlock::ReceivedBytes, packet->dataLength);
+}
+
+// Sums the blocks of all threads, indexed by type, maxMessageTypes entries.
+void message_stats_snapshot(std::vector<MessageTypeStats> &out);
+
+// `type_names` has one name per message type plus a last one for unknown
+// types, which gets everything from its index on.
+void print_message_stats(FILE *out, const std::vector<const char*> &type_names);
+// Prometheus text format, process wide counters labelled by type.
+void write_message_metrics(std::string &out, const char *server_name, const std::vector<const char*> &type_names);
@@ -0,0 +1,129 @@
+#include "metricsServer.h"
+#include <cstdio>
+
+// a scraper that has not finished its request by then is dropped
+constexpr enet_uint32 connectionTimeoutMs = 2000;
+constexpr size_t maxConnections = 16;
+constexpr size_t maxRequestSize = 4096;
+
+static void close_socket(ENetSocket socket)
+{
+  enet_socket_shutdown(socket, ENET_SOCKET_SHUTDOWN_READ_WRITE);
+  enet_socket_destroy(socket);
+}
+
+MetricsServer::~MetricsServer()
+{
+  stop();
+}
+
+bool MetricsServer::start(uint16_t port)
+{
+  stop();
+  ENetAddress address;
+  enet_address_set_host(&address, "127.0.0.1");
+  address.port = port;
+  listener = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+  if (listener == ENET_SOCKET_NULL)
+    return false;
+  enet_socket_set_option(listener, ENET_SOCKOPT_REUSEADDR, 1);
+  if (enet_socket_bind(listener, &address) < 0 || enet_socket_listen(listener, int(maxConnections)) < 0 ||
+      enet_socket_set_option(listener, ENET_SOCKOPT_NONBLOCK, 1) < 0)
+  {
+    enet_socket_destroy(listener);
+    listener = ENET_SOCKET_NULL;
+    return false;
+  }
+  return true;
+}
+
+void MetricsServer::stop()
+{
+  for (Connection &conn : connections)
+    close_socket(conn.socket);
+  connections.clear();
+  if (listener != ENET_SOCKET_NULL)
+    enet_socket_destroy(listener);
+  listener = ENET_SOCKET_NULL;
+}
+
+void MetricsServer::respond(Connection &conn)
+{
+  const char *status = "404 Not Found";
+  const std::string *body = nullptr;
+  if (conn.request.compare(0, 13, "GET /metrics ") == 0 || conn.request.compare(0, 13, "GET /metrics?") == 0)
+  {
+    status = "200 OK";
+    body = &metrics;
+  }
+  char header[256];
+  snprintf(header, sizeof(header),
+           "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+           status, body ? body->size() : 0);
+  conn.response = header;
+  if (body)
+    conn.response += *body;
+}
+
+void MetricsServer::poll()
+{
+  if (listener == ENET_SOCKET_NULL)
+    return;
+
+  while (connections.size() < maxConnections)
+  {
+    ENetSocket socket = enet_socket_accept(listener, nullptr);
+    if (socket == ENET_SOCKET_NULL)
+      break;
+    enet_socket_set_option(socket, ENET_SOCKOPT_NONBLOCK, 1);
+    Connection conn;
+    conn.socket = socket;
+    conn.acceptTime = enet_time_get();
+    connections.push_back(std::move(conn));
+  }
+
+  enet_uint32 now = enet_time_get();
+  for (size_t i = 0; i < connections.size();)
+  {
+    Connection &conn = connections[i];
+    bool done = now - conn.acceptTime > connectionTimeoutMs;
+    if (!done && conn.response.empty())
+    {
+      char buf[1024];
+      ENetBuffer buffer;
+      buffer.data = buf;
+      buffer.dataLength = sizeof(buf);
+      int received = enet_socket_receive(conn.socket, nullptr, &buffer, 1);
+      if (received < 0)
+        done = true;
+      else
+        conn.request.append(buf, size_t(received));
+      // only the request line matters, the headers are read and ignored
+      if (conn.request.find("\r\n\r\n") != std::string::npos || conn.request.find("\n\n") != std::string::npos)
+        respond(conn);
+      else if (conn.request.size() > maxRequestSize)
+        done = true;
+    }
+    if (!done && !conn.response.empty())
+    {
+      ENetBuffer buffer;
+      buffer.data = &conn.response[conn.sent];
+      buffer.dataLength = conn.response.size() - conn.sent;
+      int sent = enet_socket_send(conn.socket, nullptr, &buffer, 1);
+      if (sent < 0)
+        done = true;
+      else
+        conn.sent += size_t(sent);
+      done = done || conn.sent == conn.response.size();
+    }
+    if (done)
+    {
+      close_socket(conn.socket);
+      if (i + 1 != connections.size())
+        connections[i] = std::move(connections.back());
+      connections.pop_back();
+    }
+    else
+      ++i;
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal HTTP endpoint for Prometheus scrapes: GET /metrics answers with the
+// last text given to set_metrics(), any other request gets a 404. Listens on
+// loopback only. Non-blocking and single-threaded: poll() it from the server
+// loop, a scrape never stalls a tick. Built on ENet's socket layer, so it
+// runs wherever ENet does.
+class MetricsServer
+{
+public:
+  ~MetricsServer();
+
+  bool start(uint16_t port);
+  void stop();
+
+  void set_metrics(std::string text) { metrics = std::move(text); }
+  // Accepts connections, reads requests and writes responses, as far as it can without blocking.
+  void poll();
+
+private:
+  struct Connection
+  {
+    ENetSocket socket;
+    enet_uint32 acceptTime = 0;
+    std::string request;
+    std::string response;
+    size_t sent = 0;
+  };
+
+  void respond(Connection &conn);
+
+  ENetSocket listener = ENET_SOCKET_NULL;
+  std::vector<Connection> connections;
+  std::string metrics;
+};
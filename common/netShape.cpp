@@ -0,0 +1,339 @@
+#include "netShape.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Real ENet functions, the linker resolves them because of --wrap.
+extern "C" int __real_enet_socket_send(ENetSocket socket, const ENetAddress *address, const ENetBuffer *buffers, size_t buffer_count);
+extern "C" int __real_enet_socket_receive(ENetSocket socket, ENetAddress *address, ENetBuffer *buffers, size_t buffer_count);
+
+// bandwidth limited links drop datagrams that would wait longer than this
+constexpr uint32_t maxQueueDelayMs = 1000;
+constexpr size_t maxDatagramSize = 4096; // ENET_PROTOCOL_MAXIMUM_MTU
+
+namespace
+{
+struct Datagram
+{
+  ENetSocket socket;
+  ENetAddress address;
+  std::vector<uint8_t> data;
+};
+
+struct LinkState
+{
+  uint64_t busyUntil = 0; // when the link finishes transmitting its backlog
+};
+
+// due time and arrival order, equal due times keep FIFO order
+typedef std::pair<uint64_t, uint64_t> QueueKey;
+
+struct NetShape
+{
+  std::mutex mutex;
+  bool initialized = false;
+  NetShapeConfig defaultConfig;
+  std::map<uint64_t, NetShapeConfig> peerConfigs;
+  std::map<uint64_t, LinkState> links; // key of the address, plus a bit for the direction
+  std::map<QueueKey, Datagram> outQueue;
+  std::map<QueueKey, Datagram> inQueue;
+  uint64_t nextSeq = 0;
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  NetShapeStats stats;
+};
+}
+
+static NetShape &shape()
+{
+  static NetShape s;
+  return s;
+}
+
+static uint64_t now_ms()
+{
+  using namespace std::chrono;
+  return uint64_t(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t address_key(const ENetAddress &address)
+{
+  return (uint64_t(address.host) << 16) | address.port;
+}
+
+// splitmix64, small and its sequence is the same on every platform
+static uint64_t next_random(NetShape &s)
+{
+  uint64_t z = (s.rng += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static float next_unit(NetShape &s)
+{
+  return float(next_random(s) >> 40) * (1.f / float(1 << 24));
+}
+
+static void init_from_env(NetShape &s)
+{
+  if (s.initialized)
+    return;
+  s.initialized = true;
+  const char *spec = getenv("NETSHAPE");
+  if (!spec)
+    return;
+  uint64_t seed = 0;
+  if (!netshape_parse(spec, s.defaultConfig, &seed))
+  {
+    printf("netshape: cannot parse NETSHAPE=\"%s\", the link is not shaped\n", spec);
+    s.defaultConfig = NetShapeConfig();
+    return;
+  }
+  if (seed)
+    s.rng = seed;
+  printf("netshape: delay %u ms, jitter %u ms, loss %.1f%%, dup %.1f%%, reorder %.1f%%, bw %u B/s\n",
+         s.defaultConfig.delayMs, s.defaultConfig.jitterMs, s.defaultConfig.loss * 100.f,
+         s.defaultConfig.duplicate * 100.f, s.defaultConfig.reorder * 100.f, s.defaultConfig.bandwidth);
+}
+
+static const NetShapeConfig &config_for(NetShape &s, const ENetAddress &address)
+{
+  auto itf = s.peerConfigs.find(address_key(address));
+  return itf != s.peerConfigs.end() ? itf->second : s.defaultConfig;
+}
+
+static bool is_shaped(const NetShapeConfig &cfg)
+{
+  return cfg.delayMs || cfg.jitterMs || cfg.loss > 0.f || cfg.duplicate > 0.f || cfg.reorder > 0.f || cfg.bandwidth;
+}
+
+// Decides the fate of one datagram and queues its copies.
+static void enqueue(NetShape &s, std::map<QueueKey, Datagram> &queue, const NetShapeConfig &cfg, bool outbound, Datagram &&dgram)
+{
+  s.stats.datagrams++;
+  // the same number of draws per datagram keeps decisions aligned across runs
+  float lossRoll = next_unit(s);
+  float dupRoll = next_unit(s);
+  float reorderRoll = next_unit(s);
+  uint32_t jitter = cfg.jitterMs ? uint32_t(next_random(s) % (cfg.jitterMs + 1)) : 0;
+
+  if (lossRoll < cfg.loss)
+  {
+    s.stats.dropped++;
+    return;
+  }
+
+  uint64_t now = now_ms();
+  uint64_t due = now + cfg.delayMs + jitter;
+  if (reorderRoll < cfg.reorder && (cfg.delayMs || cfg.jitterMs))
+  {
+    due = now;
+    s.stats.reordered++;
+  }
+
+  if (cfg.bandwidth)
+  {
+    LinkState &link = s.links[(address_key(dgram.address) << 1) | (outbound ? 1 : 0)];
+    uint64_t start = std::max(link.busyUntil, now);
+    if (start - now > maxQueueDelayMs)
+    {
+      s.stats.dropped++;
+      return;
+    }
+    link.busyUntil = start + (uint64_t(dgram.data.size()) * 1000 + cfg.bandwidth - 1) / cfg.bandwidth;
+    due = std::max(due, link.busyUntil);
+  }
+
+  if (dupRoll < cfg.duplicate)
+  {
+    s.stats.duplicated++;
+    queue.emplace(QueueKey(due, s.nextSeq++), dgram);
+  }
+  queue.emplace(QueueKey(due, s.nextSeq++), std::move(dgram));
+}
+
+static void flush_outbound(NetShape &s)
+{
+  uint64_t now = now_ms();
+  while (!s.outQueue.empty() && s.outQueue.begin()->first.first <= now)
+  {
+    Datagram &dgram = s.outQueue.begin()->second;
+    ENetBuffer buffer;
+    buffer.data = dgram.data.data();
+    buffer.dataLength = dgram.data.size();
+    // a failed send is a lost datagram, as it would be on the wire
+    __real_enet_socket_send(dgram.socket, &dgram.address, &buffer, 1);
+    s.outQueue.erase(s.outQueue.begin());
+  }
+}
+
+extern "C" int __wrap_enet_socket_send(ENetSocket socket, const ENetAddress *address, const ENetBuffer *buffers, size_t buffer_count)
+{
+  // stream sockets (no address), e.g. the metrics endpoint, are not datagrams to shape
+  if (!address)
+    return __real_enet_socket_send(socket, address, buffers, buffer_count);
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  init_from_env(s);
+  flush_outbound(s);
+  const NetShapeConfig &cfg = config_for(s, *address);
+  if (!cfg.outbound || !is_shaped(cfg))
+    return __real_enet_socket_send(socket, address, buffers, buffer_count);
+
+  Datagram dgram;
+  dgram.socket = socket;
+  dgram.address = *address;
+  for (size_t i = 0; i < buffer_count; ++i)
+  {
+    const uint8_t *data = (const uint8_t*)buffers[i].data;
+    dgram.data.insert(dgram.data.end(), data, data + buffers[i].dataLength);
+  }
+  int size = int(dgram.data.size());
+  enqueue(s, s.outQueue, cfg, true, std::move(dgram));
+  flush_outbound(s);
+  return size;
+}
+
+extern "C" int __wrap_enet_socket_receive(ENetSocket socket, ENetAddress *address, ENetBuffer *buffers, size_t buffer_count)
+{
+  if (!address)
+    return __real_enet_socket_receive(socket, address, buffers, buffer_count);
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  init_from_env(s);
+  flush_outbound(s);
+
+  // move everything the socket has into the queue
+  int realResult = 0;
+  while (true)
+  {
+    Datagram dgram;
+    dgram.socket = socket;
+    dgram.data.resize(maxDatagramSize);
+    ENetBuffer buffer;
+    buffer.data = dgram.data.data();
+    buffer.dataLength = dgram.data.size();
+    realResult = __real_enet_socket_receive(socket, &dgram.address, &buffer, 1);
+    if (realResult <= 0)
+      break;
+    dgram.data.resize(size_t(realResult));
+    const NetShapeConfig &cfg = config_for(s, dgram.address);
+    if (cfg.inbound && is_shaped(cfg))
+      enqueue(s, s.inQueue, cfg, false, std::move(dgram));
+    else
+      s.inQueue.emplace(QueueKey(now_ms(), s.nextSeq++), std::move(dgram));
+  }
+
+  uint64_t now = now_ms();
+  for (auto it = s.inQueue.begin(); it != s.inQueue.end() && it->first.first <= now; ++it)
+  {
+    if (it->second.socket != socket)
+      continue;
+    const std::vector<uint8_t> &data = it->second.data;
+    size_t copied = 0;
+    for (size_t i = 0; i < buffer_count && copied < data.size(); ++i)
+    {
+      size_t n = std::min(buffers[i].dataLength, data.size() - copied);
+      memcpy(buffers[i].data, data.data() + copied, n);
+      copied += n;
+    }
+    if (address)
+      *address = it->second.address;
+    s.inQueue.erase(it);
+    return int(copied);
+  }
+  return realResult < 0 ? realResult : 0;
+}
+
+bool netshape_parse(const char *spec, NetShapeConfig &cfg, uint64_t *seed)
+{
+  NetShapeConfig res = cfg;
+  const char *p = spec;
+  while (*p)
+  {
+    const char *eq = strchr(p, '=');
+    if (!eq)
+      return false;
+    const char *end = strchr(eq, ',');
+    if (!end)
+      end = eq + strlen(eq);
+    std::string key(p, eq);
+    std::string value(eq + 1, end);
+    char *valueEnd = nullptr;
+    double num = strtod(value.c_str(), &valueEnd);
+    bool isNumber = !value.empty() && *valueEnd == '\0' && num >= 0.0;
+
+    if (key == "dir")
+    {
+      if (value != "in" && value != "out" && value != "both")
+        return false;
+      res.inbound = value != "out";
+      res.outbound = value != "in";
+    }
+    else if (!isNumber)
+      return false;
+    else if (key == "delay")
+      res.delayMs = uint32_t(num);
+    else if (key == "jitter")
+      res.jitterMs = uint32_t(num);
+    else if (key == "loss")
+      res.loss = float(num);
+    else if (key == "dup")
+      res.duplicate = float(num);
+    else if (key == "reorder")
+      res.reorder = float(num);
+    else if (key == "bw")
+      res.bandwidth = uint32_t(num);
+    else if (key == "seed" && seed)
+      *seed = uint64_t(num);
+    else
+      return false;
+    p = *end ? end + 1 : end;
+  }
+  if (res.loss > 1.f || res.duplicate > 1.f || res.reorder > 1.f)
+    return false;
+  cfg = res;
+  return true;
+}
+
+void netshape_set_default(const NetShapeConfig &cfg)
+{
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.initialized = true; // explicit configuration wins over NETSHAPE
+  s.defaultConfig = cfg;
+}
+
+void netshape_set_peer(const ENetAddress &remote, const NetShapeConfig &cfg)
+{
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.peerConfigs[address_key(remote)] = cfg;
+}
+
+void netshape_clear_peer(const ENetAddress &remote)
+{
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.peerConfigs.erase(address_key(remote));
+}
+
+void netshape_seed(uint64_t seed)
+{
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.rng = seed;
+}
+
+NetShapeStats netshape_stats()
+{
+  NetShape &s = shape();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  return s.stats;
+}
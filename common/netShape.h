@@ -0,0 +1,53 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+
+// In-process link emulator, the portable counterpart of netshape.sh.
+// Built into a target with add_netshape() in CMake (-DNETWORKED_NETSHAPE=ON),
+// which wraps ENet's enet_socket_send/enet_socket_receive at link time, so
+// every datagram of every host in the process goes through it. Needs GNU ld
+// or lld, nothing changes in the code calling ENet.
+//
+// Datagrams are held in a queue until they are due and released from the next
+// enet_socket_send/enet_socket_receive call, so the host has to be serviced
+// with a zero timeout (as all the clients and servers here do) for the
+// delays to be accurate to the service rate.
+//
+// The default link is configured with the NETSHAPE environment variable,
+// e.g. NETSHAPE="delay=150,jitter=20,loss=0.2,bw=50000,seed=7", and can be
+// overridden for any remote address. All random decisions come from one
+// seeded generator, a run with the same traffic takes the same decisions.
+struct NetShapeConfig
+{
+  uint32_t delayMs = 0;
+  uint32_t jitterMs = 0;   // uniform extra delay in [0, jitterMs]
+  float loss = 0.f;        // probabilities in [0, 1]
+  float duplicate = 0.f;
+  float reorder = 0.f;     // the datagram skips the delay and overtakes the queued ones
+  uint32_t bandwidth = 0;  // bytes per second, 0 for unlimited
+  bool inbound = true;     // shape received datagrams
+  bool outbound = true;    // shape sent datagrams
+};
+
+struct NetShapeStats
+{
+  uint64_t datagrams = 0;
+  uint64_t dropped = 0;     // random loss and bandwidth queue overflow
+  uint64_t duplicated = 0;
+  uint64_t reordered = 0;
+};
+
+/**
+ * Parses a comma separated key=value list, keys: delay, jitter, loss, dup,
+ * reorder, bw, dir (in, out or both) and seed. Keys left out keep their values.
+ * @return false on an unknown key or a malformed value
+ */
+bool netshape_parse(const char *spec, NetShapeConfig &cfg, uint64_t *seed = nullptr);
+
+void netshape_set_default(const NetShapeConfig &cfg);
+// Link to and from one remote host:port, e.g. a single client on the server.
+void netshape_set_peer(const ENetAddress &remote, const NetShapeConfig &cfg);
+void netshape_clear_peer(const ENetAddress &remote);
+void netshape_seed(uint64_t seed);
+
+NetShapeStats netshape_stats();
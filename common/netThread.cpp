@@ -0,0 +1,158 @@
+#include "netThread.h"
+
+// How long one enet_host_service call may block, arriving datagrams wake it up
+// right away, queued outgoing packets wait at most this long.
+constexpr enet_uint32 serviceTimeoutMs = 1;
+constexpr enet_uint32 linkStatsIntervalMs = 1000;
+
+NetThread::NetThread(size_t event_capacity, size_t send_capacity)
+  : events(event_capacity), outgoing(send_capacity)
+{
+}
+
+NetThread::~NetThread()
+{
+  stop();
+}
+
+void NetThread::start(ENetHost *h)
+{
+  host = h;
+  running.store(true, std::memory_order_release);
+  thread = std::thread([this]() { run(); });
+}
+
+void NetThread::stop()
+{
+  replaying = false;
+  if (!thread.joinable())
+    return;
+  running.store(false, std::memory_order_release);
+  thread.join();
+  send_queued();
+  enet_host_flush(host);
+  capture.close();
+}
+
+bool NetThread::open_capture(const char *path, size_t peer_count)
+{
+  captureStartTime = enet_time_get();
+  return capture.open(path, uint16_t(peer_count));
+}
+
+void NetThread::start_replay(ENetHost *h)
+{
+  host = h;
+  replaying = true;
+}
+
+bool NetThread::poll(NetEvent &event)
+{
+  return events.pop(event);
+}
+
+void NetThread::send(ENetPeer *peer, enet_uint8 channel, ENetPacket *packet)
+{
+  if (replaying)
+  {
+    enet_packet_destroy(packet);
+    return;
+  }
+  OutgoingPacket out;
+  out.peer = peer;
+  out.packet = packet;
+  out.channel = channel;
+  // the net thread drains the queue every service call and while it waits for
+  // room in the event queue, a full queue only waits for that
+  while (!outgoing.push(out))
+  {
+    if (!running.load(std::memory_order_acquire))
+    {
+      // stopping, nobody will drain it anymore
+      enet_packet_destroy(packet);
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void NetThread::link_stats(std::vector<PeerLinkStats> &out)
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  out = linkStats;
+}
+
+void NetThread::send_queued()
+{
+  OutgoingPacket out;
+  while (outgoing.pop(out))
+  {
+    if (capture.is_open())
+      capture.write(enet_time_get() - captureStartTime, uint16_t(out.peer - host->peers), CaptureKind::Sent,
+                    out.channel, out.packet->data, out.packet->dataLength);
+    if (enet_peer_send(out.peer, out.channel, out.packet) < 0 && out.packet->referenceCount == 0)
+      enet_packet_destroy(out.packet);
+  }
+}
+
+void NetThread::capture_event(const ENetEvent &event)
+{
+  uint16_t peer = uint16_t(event.peer - host->peers);
+  enet_uint32 time = enet_time_get() - captureStartTime;
+  switch (event.type)
+  {
+  case ENET_EVENT_TYPE_CONNECT:
+    capture.write(time, peer, CaptureKind::Connect, 0, nullptr, 0);
+    break;
+  case ENET_EVENT_TYPE_DISCONNECT:
+    capture.write(time, peer, CaptureKind::Disconnect, 0, nullptr, 0);
+    break;
+  case ENET_EVENT_TYPE_RECEIVE:
+    capture.write(time, peer, CaptureKind::Received, event.channelID, event.packet->data, event.packet->dataLength);
+    break;
+  default:
+    break;
+  };
+}
+
+void NetThread::run()
+{
+  while (running.load(std::memory_order_acquire))
+  {
+    send_queued();
+    enet_uint32 now = enet_time_get();
+    if (now - lastStatsTime >= linkStatsIntervalMs)
+    {
+      lastStatsTime = now;
+      std::lock_guard<std::mutex> lock(statsMutex);
+      capture_link_stats(host, linkStats);
+    }
+    ENetEvent event;
+    if (enet_host_service(host, &event, serviceTimeoutMs) <= 0)
+      continue;
+    do
+    {
+      // before the event is queued, the simulation destroys received packets
+      if (capture.is_open())
+        capture_event(event);
+      NetEvent ev;
+      ev.type = event.type;
+      ev.peer = event.peer;
+      ev.channelID = event.channelID;
+      ev.packet = event.packet;
+      // a simulation that stalls holds the network back instead of losing
+      // events, its sends keep going out so it never waits on us in turn
+      while (!events.push(ev))
+      {
+        if (!running.load(std::memory_order_acquire))
+        {
+          if (ev.packet)
+            enet_packet_destroy(ev.packet);
+          return;
+        }
+        send_queued();
+        std::this_thread::yield();
+      }
+    } while (enet_host_check_events(host, &event) > 0);
+  }
+}
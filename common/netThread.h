@@ -0,0 +1,79 @@
+#pragma once
+#include <enet/enet.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "spscQueue.h"
+#include "peerStats.h"
+#include "packetCapture.h"
+
+struct NetEvent
+{
+  ENetEventType type = ENET_EVENT_TYPE_NONE;
+  ENetPeer *peer = nullptr;
+  enet_uint8 channelID = 0;
+  ENetPacket *packet = nullptr; // owned by the receiver of a RECEIVE event
+};
+
+// Thread that owns an ENetHost and services it continuously, so packets are
+// received as soon as they arrive regardless of the simulation's tick rate.
+// Events reach the simulation thread through one SPSC queue, packets to send
+// come back through another; between start() and stop() no other thread may
+// call ENet on this host. Packet creation and destruction do not touch the
+// host and stay allowed on the simulation thread.
+class NetThread
+{
+public:
+  explicit NetThread(size_t event_capacity = 8192, size_t send_capacity = 65536);
+  ~NetThread();
+
+  NetThread(const NetThread&) = delete;
+  NetThread &operator=(const NetThread&) = delete;
+
+  void start(ENetHost *host);
+  // Sends everything still queued and joins the thread, the host stays alive.
+  void stop();
+
+  // Before start(): the network thread logs every event and every packet it
+  // sends to `path`, see packetCapture.h.
+  bool open_capture(const char *path, size_t peer_count);
+  // Instead of start(): no thread and no traffic. Events come from inject(),
+  // sent packets are dropped, so a capture can drive the simulation offline.
+  void start_replay(ENetHost *host);
+  bool inject(const NetEvent &event) { return events.push(event); }
+
+  // Simulation thread side.
+  bool poll(NetEvent &event);
+  // Queues the packet for enet_peer_send, it is destroyed if the peer is gone.
+  void send(ENetPeer *peer, enet_uint8 channel, ENetPacket *packet);
+  // Link stats of every peer slot, captured by the network thread once a second.
+  void link_stats(std::vector<PeerLinkStats> &out);
+
+private:
+  struct OutgoingPacket
+  {
+    ENetPeer *peer = nullptr;
+    ENetPacket *packet = nullptr;
+    enet_uint8 channel = 0;
+  };
+
+  void run();
+  void send_queued();
+  void capture_event(const ENetEvent &event);
+
+  ENetHost *host = nullptr;
+  SpscQueue<NetEvent> events;
+  SpscQueue<OutgoingPacket> outgoing;
+  std::atomic<bool> running{false};
+  std::thread thread;
+  bool replaying = false;
+
+  // network thread only once started
+  PacketCaptureWriter capture;
+  enet_uint32 captureStartTime = 0;
+
+  std::mutex statsMutex;
+  std::vector<PeerLinkStats> linkStats;
+  enet_uint32 lastStatsTime = 0;
+};
@@ -0,0 +1,295 @@
+#include "packetCapture.h"
+#include "wireFormat.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint8_t captureMagic[4] = {'N', 'C', 'A', 'P'};
+constexpr uint16_t captureVersion = 1;
+constexpr size_t captureHeaderSize = sizeof(captureMagic) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint32_t);
+constexpr size_t recordHeaderSize = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint32_t);
+// the mapping starts at this size and doubles whenever a record does not fit
+constexpr size_t initialCaptureSize = 1 << 20;
+
+#ifdef _WIN32
+
+bool MappedFile::map()
+{
+  DWORD protect = writable ? PAGE_READWRITE : PAGE_READONLY;
+  uint64_t size = writable ? length : 0; // a read-only mapping takes the file's size
+  HANDLE m = CreateFileMappingA((HANDLE)file, nullptr, protect, DWORD(size >> 32), DWORD(size), nullptr);
+  if (!m)
+    return false;
+  void *view = MapViewOfFile(m, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length);
+  if (!view)
+  {
+    CloseHandle(m);
+    return false;
+  }
+  mapping = (intptr_t)m;
+  ptr = (uint8_t*)view;
+  return true;
+}
+
+void MappedFile::unmap()
+{
+  if (ptr)
+    UnmapViewOfFile(ptr);
+  if (mapping)
+    CloseHandle((HANDLE)mapping);
+  ptr = nullptr;
+  mapping = 0;
+}
+
+bool MappedFile::create(const char *path, size_t size)
+{
+  close(length);
+  HANDLE h = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (h == INVALID_HANDLE_VALUE)
+    return false;
+  file = (intptr_t)h;
+  writable = true;
+  length = size; // creating the mapping extends the file
+  if (map())
+    return true;
+  close(0);
+  return false;
+}
+
+bool MappedFile::open_read(const char *path)
+{
+  close(length);
+  HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (h == INVALID_HANDLE_VALUE)
+    return false;
+  file = (intptr_t)h;
+  writable = false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(h, &size) || size.QuadPart == 0)
+  {
+    close(0);
+    return false;
+  }
+  length = size_t(size.QuadPart);
+  if (map())
+    return true;
+  close(0);
+  return false;
+}
+
+bool MappedFile::resize(size_t size)
+{
+  if (!writable || !ptr)
+    return false;
+  unmap();
+  size_t oldLength = length;
+  length = size;
+  if (map())
+    return true;
+  length = oldLength; // keep what is there, the old size still fits
+  map();
+  return false;
+}
+
+void MappedFile::close(size_t final_size)
+{
+  unmap();
+  if (file != -1)
+  {
+    if (writable)
+    {
+      LARGE_INTEGER size;
+      size.QuadPart = LONGLONG(final_size);
+      SetFilePointerEx((HANDLE)file, size, nullptr, FILE_BEGIN);
+      SetEndOfFile((HANDLE)file);
+    }
+    CloseHandle((HANDLE)file);
+  }
+  file = -1;
+  length = 0;
+  writable = false;
+}
+
+#else
+
+bool MappedFile::map()
+{
+  void *view = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, int(file), 0);
+  if (view == MAP_FAILED)
+    return false;
+  ptr = (uint8_t*)view;
+  return true;
+}
+
+void MappedFile::unmap()
+{
+  if (ptr)
+    munmap(ptr, length);
+  ptr = nullptr;
+}
+
+bool MappedFile::create(const char *path, size_t size)
+{
+  close(length);
+  int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  file = fd;
+  writable = true;
+  length = size;
+  if (ftruncate(fd, off_t(size)) == 0 && map())
+    return true;
+  close(0);
+  return false;
+}
+
+bool MappedFile::open_read(const char *path)
+{
+  close(length);
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  file = fd;
+  writable = false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(0);
+    return false;
+  }
+  length = size_t(st.st_size);
+  if (map())
+    return true;
+  close(0);
+  return false;
+}
+
+bool MappedFile::resize(size_t size)
+{
+  if (!writable || !ptr)
+    return false;
+  unmap();
+  if (ftruncate(int(file), off_t(size)) != 0)
+  {
+    map(); // keep what is there, the old size still fits
+    return false;
+  }
+  length = size;
+  return map();
+}
+
+void MappedFile::close(size_t final_size)
+{
+  unmap();
+  if (file != -1)
+  {
+    if (writable && ftruncate(int(file), off_t(final_size)) != 0)
+      perror("capture truncate");
+    ::close(int(file));
+  }
+  file = -1;
+  length = 0;
+  writable = false;
+}
+
+#endif
+
+bool PacketCaptureWriter::open(const char *path, uint16_t peer_count)
+{
+  close();
+  if (!file.create(path, initialCaptureSize))
+    return false;
+  uint8_t *ptr = file.data();
+  memcpy(ptr, captureMagic, sizeof(captureMagic)); ptr += sizeof(captureMagic);
+  store_le<uint16_t>(ptr, captureVersion);
+  store_le<uint16_t>(ptr, peer_count);
+  store_le<uint32_t>(ptr, 0);
+  used = captureHeaderSize;
+  return true;
+}
+
+bool PacketCaptureWriter::write(uint32_t time_ms, uint16_t peer, CaptureKind kind, uint8_t channel, const uint8_t *data, size_t size)
+{
+  if (!is_open() || size > UINT32_MAX)
+    return false;
+  size_t recordSize = recordHeaderSize + size;
+  if (used + recordSize > file.size())
+  {
+    size_t newSize = file.size();
+    while (used + recordSize > newSize)
+      newSize *= 2;
+    if (!file.resize(newSize))
+      return false;
+  }
+  uint8_t *ptr = file.data() + used;
+  store_le<uint32_t>(ptr, time_ms);
+  store_le<uint16_t>(ptr, peer);
+  store_le<uint8_t>(ptr, uint8_t(kind));
+  store_le<uint8_t>(ptr, channel);
+  store_le<uint32_t>(ptr, uint32_t(size));
+  if (size)
+    memcpy(ptr, data, size);
+  used += recordSize;
+  return true;
+}
+
+void PacketCaptureWriter::close()
+{
+  if (is_open())
+    file.close(used);
+  used = 0;
+}
+
+bool PacketCaptureReader::open(const char *path)
+{
+  offset = 0;
+  peerCount = 0;
+  if (!file.open_read(path))
+    return false;
+  const uint8_t *ptr = file.data();
+  if (file.size() < captureHeaderSize || memcmp(ptr, captureMagic, sizeof(captureMagic)) != 0)
+  {
+    close();
+    return false;
+  }
+  ptr += sizeof(captureMagic);
+  if (load_le<uint16_t>(ptr) != captureVersion)
+  {
+    close();
+    return false;
+  }
+  peerCount = load_le<uint16_t>(ptr);
+  offset = captureHeaderSize;
+  return true;
+}
+
+bool PacketCaptureReader::next(CaptureRecord &record)
+{
+  if (!file.data() || file.size() - offset < recordHeaderSize)
+    return false;
+  const uint8_t *ptr = file.data() + offset;
+  CaptureRecord r;
+  r.timeMs = load_le<uint32_t>(ptr);
+  r.peer = load_le<uint16_t>(ptr);
+  uint8_t kind = load_le<uint8_t>(ptr);
+  r.channel = load_le<uint8_t>(ptr);
+  r.size = load_le<uint32_t>(ptr);
+  if (kind == uint8_t(CaptureKind::End) || kind > uint8_t(CaptureKind::Sent) ||
+      file.size() - offset - recordHeaderSize < r.size)
+    return false;
+  r.kind = CaptureKind(kind);
+  r.data = ptr;
+  offset += recordHeaderSize + r.size;
+  record = r;
+  return true;
+}
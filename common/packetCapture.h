@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Binary log of a host's traffic: connects, disconnects and every packet
+// received or sent, per peer slot, for replaying incidents offline.
+// Little-endian, written through a memory mapping that grows as needed:
+//   header  magic "NCAP" | version (uint16) | peer slots (uint16) | reserved (uint32)
+//   record  time ms since capture start (uint32) | peer slot (uint16) |
+//           kind (uint8) | channel (uint8) | payload size (uint32) | payload
+// The mapping is zero filled past the last record, a zero kind ends the log,
+// so a capture cut short by a crash still reads up to its last full record.
+enum class CaptureKind : uint8_t
+{
+  End = 0,
+  Connect,
+  Disconnect,
+  Received,
+  Sent,
+};
+
+struct CaptureRecord
+{
+  uint32_t timeMs = 0;
+  uint16_t peer = 0;
+  CaptureKind kind = CaptureKind::End;
+  uint8_t channel = 0;
+  const uint8_t *data = nullptr; // points into the mapping, valid until the reader closes
+  uint32_t size = 0;
+};
+
+// Read-write or read-only view of a whole file, POSIX mmap or a Win32 file mapping.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(length); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
+
+  bool create(const char *path, size_t size);
+  bool open_read(const char *path);
+  // Remaps the file at `size` bytes, the contents up to the old size are kept.
+  bool resize(size_t size);
+  // Unmaps, a file opened for writing is truncated to `final_size` bytes.
+  void close(size_t final_size);
+
+  uint8_t *data() const { return ptr; }
+  size_t size() const { return length; }
+
+private:
+  bool map();
+  void unmap();
+
+  uint8_t *ptr = nullptr;
+  size_t length = 0;
+  bool writable = false;
+  intptr_t file = -1;   // fd, or HANDLE on Windows
+  intptr_t mapping = 0; // file mapping HANDLE on Windows
+};
+
+class PacketCaptureWriter
+{
+public:
+  ~PacketCaptureWriter() { close(); }
+
+  bool open(const char *path, uint16_t peer_count);
+  bool is_open() const { return file.data() != nullptr; }
+  // Records past what the file system lets the mapping grow to are dropped, false then.
+  bool write(uint32_t time_ms, uint16_t peer, CaptureKind kind, uint8_t channel, const uint8_t *data, size_t size);
+  void close();
+
+  size_t bytes_written() const { return used; }
+
+private:
+  MappedFile file;
+  size_t used = 0;
+};
+
+class PacketCaptureReader
+{
+public:
+  bool open(const char *path);
+  void close() { file.close(0); }
+
+  uint16_t peer_count() const { return peerCount; }
+  // False at the end of the log and at a record cut short.
+  bool next(CaptureRecord &record);
+
+private:
+  MappedFile file;
+  size_t offset = 0;
+  uint16_t peerCount = 0;
+};
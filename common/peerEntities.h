@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "idAllocator.h"
+
+// Entity each peer slot controls, for servers that give every client one
+// entity and remove it when the client disconnects. Slots keep handles, so a
+// slot still naming an eid that was freed and handed out again reads as empty.
+// The removals of a tick go out in one message and their eids are freed only
+// after that, so a join in the same tick cannot reuse an eid the clients still
+// know.
+class PeerEntities
+{
+public:
+  explicit PeerEntities(IdAllocator &ids) : ids(ids) {}
+
+  void resize(size_t peer_count) { slots.assign(peer_count, EntityHandle()); }
+
+  // Eid the peer controls, IdAllocator::invalidId if it has none.
+  uint16_t get(size_t peer_idx) const
+  {
+    const EntityHandle &h = slots[peer_idx];
+    return ids.is_valid(h) ? h.id : IdAllocator::invalidId;
+  }
+
+  void set(size_t peer_idx, uint16_t eid) { slots[peer_idx] = ids.handle(eid); }
+
+  // Empties the slot and queues its entity for removal, returns the eid or
+  // IdAllocator::invalidId if the peer had none.
+  uint16_t despawn(size_t peer_idx)
+  {
+    uint16_t eid = get(peer_idx);
+    slots[peer_idx] = EntityHandle();
+    if (eid != IdAllocator::invalidId)
+      despawnedEids.push_back(eid);
+    return eid;
+  }
+
+  // Eids despawned since the last free_despawned().
+  const std::vector<uint16_t> &despawned() const { return despawnedEids; }
+
+  // Frees the despawned eids, once their removal is sent.
+  void free_despawned()
+  {
+    for (uint16_t eid : despawnedEids)
+      ids.free(eid);
+    despawnedEids.clear();
+  }
+
+private:
+  IdAllocator &ids;
+  std::vector<EntityHandle> slots;
+  std::vector<uint16_t> despawnedEids;
+};
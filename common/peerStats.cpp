@@ -0,0 +1,125 @@
+#include "peerStats.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+
+void capture_link_stats(const ENetHost *host, std::vector<PeerLinkStats> &out)
+{
+  out.resize(host->peerCount);
+  for (size_t i = 0; i < host->peerCount; ++i)
+  {
+    ENetPeer &peer = host->peers[i];
+    PeerLinkStats &s = out[i];
+    s.connected = peer.state == ENET_PEER_STATE_CONNECTED;
+    s.address = peer.address;
+    s.rttMs = peer.roundTripTime;
+    s.rttVarianceMs = peer.roundTripTimeVariance;
+    s.packetLoss = float(peer.packetLoss) / ENET_PEER_PACKET_LOSS_SCALE;
+    s.reliableInFlight = uint32_t(enet_list_size(&peer.sentReliableCommands));
+    s.reliableBytesInFlight = peer.reliableDataInTransit;
+  }
+}
+
+void PeerTrafficStats::resize(size_t num_peers, const std::vector<const char*> &type_names)
+{
+  numTypes = type_names.size();
+  typeNames = type_names;
+  sent.assign(num_peers * numTypes, Counter());
+  received.assign(num_peers * numTypes, Counter());
+}
+
+void PeerTrafficStats::reset_peer(size_t peer_idx)
+{
+  for (size_t type = 0; type < numTypes; ++type)
+  {
+    sent[peer_idx * numTypes + type] = Counter();
+    received[peer_idx * numTypes + type] = Counter();
+  }
+}
+
+static void append(std::string &out, const char *fmt, ...)
+{
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (len > 0)
+    out.append(buf, size_t(len) < sizeof(buf) ? size_t(len) : sizeof(buf) - 1);
+}
+
+static void append_header(std::string &out, const char *name, const char *type, const char *help)
+{
+  append(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void write_peer_metrics(std::string &out, const char *server_name,
+                        const std::vector<PeerLinkStats> &links, const PeerTrafficStats &traffic)
+{
+  // labels of each connected peer, the address is in network byte order
+  std::vector<std::string> labels(links.size());
+  for (size_t i = 0; i < links.size(); ++i)
+  {
+    if (!links[i].connected)
+      continue;
+    const uint8_t *ip = (const uint8_t*)&links[i].address.host;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "server=\"%s\",peer=\"%zu\",address=\"%u.%u.%u.%u:%u\"",
+             server_name, i, ip[0], ip[1], ip[2], ip[3], links[i].address.port);
+    labels[i] = buf;
+  }
+
+  append_header(out, "netserver_peer_rtt_ms", "gauge", "Smoothed round trip time.");
+  for (size_t i = 0; i < links.size(); ++i)
+    if (links[i].connected)
+      append(out, "netserver_peer_rtt_ms{%s} %u\n", labels[i].c_str(), links[i].rttMs);
+  append_header(out, "netserver_peer_rtt_variance_ms", "gauge", "Round trip time variance.");
+  for (size_t i = 0; i < links.size(); ++i)
+    if (links[i].connected)
+      append(out, "netserver_peer_rtt_variance_ms{%s} %u\n", labels[i].c_str(), links[i].rttVarianceMs);
+  append_header(out, "netserver_peer_packet_loss_ratio", "gauge", "Fraction of reliable packets lost.");
+  for (size_t i = 0; i < links.size(); ++i)
+    if (links[i].connected)
+      append(out, "netserver_peer_packet_loss_ratio{%s} %.4f\n", labels[i].c_str(), links[i].packetLoss);
+  append_header(out, "netserver_peer_reliable_in_flight", "gauge", "Reliable commands waiting for an acknowledgement.");
+  for (size_t i = 0; i < links.size(); ++i)
+    if (links[i].connected)
+      append(out, "netserver_peer_reliable_in_flight{%s} %u\n", labels[i].c_str(), links[i].reliableInFlight);
+  append_header(out, "netserver_peer_reliable_in_flight_bytes", "gauge", "Reliable bytes waiting for an acknowledgement.");
+  for (size_t i = 0; i < links.size(); ++i)
+    if (links[i].connected)
+      append(out, "netserver_peer_reliable_in_flight_bytes{%s} %u\n", labels[i].c_str(), links[i].reliableBytesInFlight);
+
+  struct Series
+  {
+    const char *name;
+    const char *help;
+    bool isSent;
+    bool isBytes;
+  };
+  const Series series[] = {
+    {"netserver_peer_sent_packets_total", "Packets sent to the peer by message type.", true, false},
+    {"netserver_peer_sent_bytes_total", "Payload bytes sent to the peer by message type.", true, true},
+    {"netserver_peer_received_packets_total", "Packets received from the peer by message type.", false, false},
+    {"netserver_peer_received_bytes_total", "Payload bytes received from the peer by message type.", false, true},
+  };
+  size_t numPeers = std::min(links.size(), traffic.num_peers());
+  for (const Series &s : series)
+  {
+    append_header(out, s.name, "counter", s.help);
+    for (size_t i = 0; i < numPeers; ++i)
+    {
+      if (!links[i].connected)
+        continue;
+      for (size_t type = 0; type < traffic.num_types(); ++type)
+      {
+        const PeerTrafficStats::Counter &c = s.isSent ? traffic.sent_counter(i, type) : traffic.received_counter(i, type);
+        if (c.packets == 0)
+          continue;
+        append(out, "%s{%s,type=\"%s\"} %" PRIu64 "\n", s.name, labels[i].c_str(), traffic.type_name(type),
+               s.isBytes ? c.bytes : c.packets);
+      }
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Link quality of one peer slot as ENet measures it.
+struct PeerLinkStats
+{
+  bool connected = false;
+  ENetAddress address = {};
+  uint32_t rttMs = 0;
+  uint32_t rttVarianceMs = 0;
+  float packetLoss = 0.f;             // ENet's smoothed estimate, fraction of reliable packets lost
+  uint32_t reliableInFlight = 0;      // reliable commands sent and not acknowledged yet
+  uint32_t reliableBytesInFlight = 0;
+};
+
+// Reads every peer slot of the host. ENet updates these fields while it
+// services the host, so this has to run on the thread that does.
+void capture_link_stats(const ENetHost *host, std::vector<PeerLinkStats> &out);
+
+// Packets and bytes each peer sent and received, per message type. The type is
+// the first byte of the packet, anything out of range lands in the last type.
+class PeerTrafficStats
+{
+public:
+  struct Counter
+  {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+  };
+
+  // One name per message type, the last one is used for unknown types.
+  void resize(size_t num_peers, const std::vector<const char*> &type_names);
+  // Called when a peer slot gets a new connection.
+  void reset_peer(size_t peer_idx);
+
+  void on_sent(size_t peer_idx, const ENetPacket *packet) { count(sent, peer_idx, packet); }
+  void on_received(size_t peer_idx, const ENetPacket *packet) { count(received, peer_idx, packet); }
+
+  size_t num_peers() const { return numTypes ? sent.size() / numTypes : 0; }
+  size_t num_types() const { return numTypes; }
+  const char *type_name(size_t type) const { return typeNames[type]; }
+  const Counter &sent_counter(size_t peer_idx, size_t type) const { return sent[peer_idx * numTypes + type]; }
+  const Counter &received_counter(size_t peer_idx, size_t type) const { return received[peer_idx * numTypes + type]; }
+
+private:
+  void count(std::vector<Counter> &counters, size_t peer_idx, const ENetPacket *packet)
+  {
+    size_t type = packet->dataLength > 0 && packet->data[0] < numTypes ? packet->data[0] : numTypes - 1;
+    Counter &c = counters[peer_idx * numTypes + type];
+    c.packets++;
+    c.bytes += packet->dataLength;
+  }
+
+  size_t numTypes = 0;
+  std::vector<const char*> typeNames;
+  std::vector<Counter> sent;     // peer * numTypes + type
+  std::vector<Counter> received;
+};
+
+// Appends both in Prometheus text format, one series per connected peer,
+// labelled with the server name, the peer slot and its address.
+void write_peer_metrics(std::string &out, const char *server_name,
+                        const std::vector<PeerLinkStats> &links, const PeerTrafficStats &traffic);
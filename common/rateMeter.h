@@ -0,0 +1,140 @@
+#pragma once
+#include <enet/enet.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Rate of a running count over the last second, kept in fixed time buckets of
+// a ring: add() and rate() cost at most one pass over the buckets, never
+// allocate, and old samples fall out as the ring turns. Times are in ms from
+// any monotonic clock, the same one for every call.
+class RateMeter
+{
+public:
+  static constexpr size_t numBuckets = 10;
+  static constexpr uint32_t bucketMs = 100;
+  static constexpr uint32_t windowMs = numBuckets * bucketMs;
+
+  void add(uint32_t now_ms, uint64_t amount)
+  {
+    advance(now_ms);
+    buckets[headBucket % numBuckets] += amount;
+    windowSum += amount;
+  }
+
+  // Per second over the window, or over the time since the first sample while
+  // the meter is younger than that.
+  double rate(uint32_t now_ms) const
+  {
+    if (!started)
+      return 0.0;
+    uint32_t bucket = now_ms / bucketMs;
+    uint32_t behind = bucket - headBucket;
+    if (behind >= numBuckets)
+      return 0.0;
+    uint64_t sum = windowSum;
+    for (uint32_t i = 1; i <= behind; ++i)
+      sum -= buckets[(headBucket + i) % numBuckets];
+    // the newest bucket is only partly filled
+    uint32_t span = (numBuckets - 1) * bucketMs + now_ms % bucketMs + 1;
+    uint32_t age = now_ms - startMs + 1;
+    return double(sum) * 1000.0 / double(age < span ? age : span);
+  }
+
+  void reset() { *this = RateMeter(); }
+
+private:
+  // Zeroes the buckets that went out of the window since the last sample.
+  void advance(uint32_t now_ms)
+  {
+    uint32_t bucket = now_ms / bucketMs;
+    if (!started)
+    {
+      started = true;
+      startMs = now_ms;
+      headBucket = bucket;
+      return;
+    }
+    uint32_t ahead = bucket - headBucket;
+    if (ahead >= numBuckets)
+    {
+      buckets.fill(0);
+      windowSum = 0;
+    }
+    else
+    {
+      for (uint32_t i = 1; i <= ahead; ++i)
+      {
+        uint64_t &b = buckets[(headBucket + i) % numBuckets];
+        windowSum -= b;
+        b = 0;
+      }
+    }
+    headBucket = bucket;
+  }
+
+  std::array<uint64_t, numBuckets> buckets = {};
+  uint64_t windowSum = 0;
+  uint32_t headBucket = 0;
+  uint32_t startMs = 0;
+  bool started = false;
+};
+
+// In and out rates of one side of a connection. Wire rates come from the ENet
+// host's totals, headers and acknowledgements included; the per channel ones
+// from the game packets handed to on_sent() and on_received(). Single threaded,
+// every call from the thread that owns the counts.
+class TrafficRates
+{
+public:
+  static constexpr size_t maxChannels = 2;
+
+  struct Direction
+  {
+    RateMeter wireBytes;
+    RateMeter wirePackets;                    // UDP datagrams
+    RateMeter channelBytes[maxChannels];      // game payload
+    RateMeter channelPackets[maxChannels];
+  };
+
+  // Feeds the host's running totals, from the thread that services the host.
+  void update(uint32_t now_ms, const ENetHost *host)
+  {
+    // the totals are 32 bit and wrap, only their differences are used
+    if (hasTotals)
+    {
+      out.wireBytes.add(now_ms, host->totalSentData - lastSentData);
+      out.wirePackets.add(now_ms, host->totalSentPackets - lastSentPackets);
+      in.wireBytes.add(now_ms, host->totalReceivedData - lastReceivedData);
+      in.wirePackets.add(now_ms, host->totalReceivedPackets - lastReceivedPackets);
+    }
+    hasTotals = true;
+    lastSentData = host->totalSentData;
+    lastSentPackets = host->totalSentPackets;
+    lastReceivedData = host->totalReceivedData;
+    lastReceivedPackets = host->totalReceivedPackets;
+  }
+
+  void on_sent(uint32_t now_ms, uint8_t channel, const ENetPacket *packet) { count(out, now_ms, channel, packet); }
+  void on_received(uint32_t now_ms, uint8_t channel, const ENetPacket *packet) { count(in, now_ms, channel, packet); }
+
+  static double kbps(const RateMeter &bytes, uint32_t now_ms) { return bytes.rate(now_ms) * 8.0 / 1000.0; }
+
+  Direction in;
+  Direction out;
+
+private:
+  static void count(Direction &dir, uint32_t now_ms, uint8_t channel, const ENetPacket *packet)
+  {
+    if (channel >= maxChannels)
+      return;
+    dir.channelBytes[channel].add(now_ms, packet->dataLength);
+    dir.channelPackets[channel].add(now_ms, 1);
+  }
+
+  bool hasTotals = false;
+  enet_uint32 lastSentData = 0;
+  enet_uint32 lastSentPackets = 0;
+  enet_uint32 lastReceivedData = 0;
+  enet_uint32 lastReceivedPackets = 0;
+};
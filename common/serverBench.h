@@ -0,0 +1,96 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstddef>
+#include <cstdint>
+#include <stdlib.h>
+#include <string.h>
+
+// Shared pieces of the servers' --bench mode: the server runs a fixed number
+// of ticks back to back against synthetic clients living in the same process
+// and connected over loopback, then prints per-phase tick timings.
+//   <week>_server --bench [peers] [entities] [ticks]
+struct ServerBenchConfig
+{
+  size_t numPeers = 32;
+  size_t numEntities = 100;
+  uint32_t numTicks = 1000;
+};
+
+// Returns false if the first argument is not --bench.
+inline bool parse_server_bench_args(int argc, const char **argv, ServerBenchConfig &cfg)
+{
+  if (argc < 2 || strcmp(argv[1], "--bench") != 0)
+    return false;
+  if (argc > 2)
+    cfg.numPeers = strtoul(argv[2], nullptr, 10);
+  if (argc > 3)
+    cfg.numEntities = strtoul(argv[3], nullptr, 10);
+  if (argc > 4)
+    cfg.numTicks = strtoul(argv[4], nullptr, 10);
+  return true;
+}
+
+// Server host bound to an ephemeral loopback port, no outside client can reach it.
+inline ENetHost *create_loopback_server_host(size_t max_peers)
+{
+  ENetAddress address;
+  enet_address_set_host(&address, "127.0.0.1");
+  address.port = 0;
+  return enet_host_create(&address, max_peers, 2, 0, 0);
+}
+
+// Client peers sharing one host, all connected to the bench server.
+class LoopbackClients
+{
+public:
+  LoopbackClients(const ENetAddress &server_address, size_t num_peers)
+  {
+    host = enet_host_create(nullptr, num_peers, 2, 0, 0);
+    if (!host)
+      return;
+    for (size_t i = 0; i < num_peers; ++i)
+      enet_host_connect(host, &server_address, 2, 0);
+  }
+
+  ~LoopbackClients()
+  {
+    if (host)
+      enet_host_destroy(host);
+  }
+
+  LoopbackClients(const LoopbackClients&) = delete;
+  LoopbackClients &operator=(const LoopbackClients&) = delete;
+
+  bool valid() const { return host != nullptr; }
+  size_t size() const { return host->peerCount; }
+  ENetPeer *peer(size_t idx) { return &host->peers[idx]; }
+
+  // Calls on_connect(idx, peer) for new connections and on_receive(idx, packet)
+  // for every received packet, which is destroyed afterwards.
+  template<typename OnConnect, typename OnReceive>
+  void update(OnConnect on_connect, OnReceive on_receive)
+  {
+    ENetEvent event;
+    while (enet_host_service(host, &event, 0) > 0)
+    {
+      size_t idx = event.peer - host->peers;
+      switch (event.type)
+      {
+      case ENET_EVENT_TYPE_CONNECT:
+        on_connect(idx, event.peer);
+        break;
+      case ENET_EVENT_TYPE_RECEIVE:
+        on_receive(idx, event.packet);
+        enet_packet_destroy(event.packet);
+        break;
+      default:
+        break;
+      };
+    }
+  }
+
+  void flush() { enet_host_flush(host); }
+
+private:
+  ENetHost *host = nullptr;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Capacity is rounded up to a power of two. Each side caches the other
+// side's index and only reloads it when the queue looks full (or empty), so
+// the shared cache lines are touched once per batch, not per element.
+template<typename T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(size_t capacity)
+  {
+    size_t size = 1;
+    while (size < capacity)
+      size <<= 1;
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue &operator=(const SpscQueue&) = delete;
+
+  // Producer side, returns false if the queue is full.
+  bool push(const T &value)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - producerHead > mask)
+    {
+      producerHead = head.load(std::memory_order_acquire);
+      if (t - producerHead > mask)
+        return false;
+    }
+    slots[t & mask] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, returns false if the queue is empty.
+  bool pop(T &value)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == consumerTail)
+    {
+      consumerTail = tail.load(std::memory_order_acquire);
+      if (h == consumerTail)
+        return false;
+    }
+    value = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+private:
+  std::vector<T> slots;
+  size_t mask = 0;
+  // written by the consumer
+  alignas(64) std::atomic<size_t> head{0};
+  size_t consumerTail = 0;
+  // written by the producer
+  alignas(64) std::atomic<size_t> tail{0};
+  size_t producerHead = 0;
+};
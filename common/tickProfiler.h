@@ -0,0 +1,63 @@
+#pragma once
+#include "hdrHistogram.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Per-phase tick timings for the servers' --bench mode.
+// Phases are indices into the names passed to the constructor, every
+// phase and the whole tick get their own nanosecond histogram.
+class TickProfiler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit TickProfiler(std::vector<const char*> phase_names)
+    : names(std::move(phase_names)), phases(names.size())
+  {
+  }
+
+  // Times one phase from construction to destruction.
+  class Scope
+  {
+  public:
+    Scope(TickProfiler &profiler, size_t phase) : owner(profiler), idx(phase), start(Clock::now()) {}
+    ~Scope() { owner.record(idx, Clock::now() - start); }
+    Scope(const Scope&) = delete;
+    Scope &operator=(const Scope&) = delete;
+
+  private:
+    TickProfiler &owner;
+    size_t idx;
+    Clock::time_point start;
+  };
+
+  void begin_tick() { tickStart = Clock::now(); }
+  void end_tick() { tick.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - tickStart).count())); }
+
+  void record(size_t phase, Clock::duration elapsed)
+  {
+    phases[phase].record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+  }
+
+  void print(FILE *out) const
+  {
+    fprintf(out, "%-12s %10s %10s %10s %10s %10s %10s\n", "phase, us", "mean", "p50", "p99", "p999", "max", "samples");
+    for (size_t i = 0; i < phases.size(); ++i)
+      print_row(out, names[i], phases[i]);
+    print_row(out, "tick", tick);
+  }
+
+private:
+  static void print_row(FILE *out, const char *name, const HdrHistogram &h)
+  {
+    fprintf(out, "%-12s %10.1f %10.1f %10.1f %10.1f %10.1f %10llu\n", name, h.mean() * 1e-3,
+            h.value_at_percentile(50.0) * 1e-3, h.value_at_percentile(99.0) * 1e-3,
+            h.value_at_percentile(99.9) * 1e-3, h.max() * 1e-3, (unsigned long long)h.count());
+  }
+
+  std::vector<const char*> names;
+  std::vector<HdrHistogram> phases;
+  HdrHistogram tick;
+  Clock::time_point tickStart;
+};
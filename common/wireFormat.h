@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Explicit little-endian encoding of integers and IEEE-754 floats, so the
+// bytes on the wire depend neither on the host's byte order nor on how the
+// compiler lays out and pads a struct. Both advance `ptr` past the value.
+template<typename T>
+inline void store_le(uint8_t *&ptr, T value)
+{
+  static_assert(std::is_integral_v<T> || std::is_same_v<T, float>, "Only integers and float have a wire encoding");
+  if constexpr (std::is_same_v<T, float>)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    store_le<uint32_t>(ptr, bits);
+  }
+  else
+  {
+    std::make_unsigned_t<T> v = value;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      ptr[i] = uint8_t(v >> (8 * i));
+    ptr += sizeof(T);
+  }
+}
+
+template<typename T>
+inline T load_le(const uint8_t *&ptr)
+{
+  static_assert(std::is_integral_v<T> || std::is_same_v<T, float>, "Only integers and float have a wire encoding");
+  if constexpr (std::is_same_v<T, float>)
+  {
+    uint32_t bits = load_le<uint32_t>(ptr);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+  }
+  else
+  {
+    std::make_unsigned_t<T> v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      v |= std::make_unsigned_t<T>(ptr[i]) << (8 * i);
+    ptr += sizeof(T);
+    return T(v);
+  }
+}
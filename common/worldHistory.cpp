@@ -0,0 +1,102 @@
+#include "worldHistory.h"
+
+static constexpr size_t bytes_per_entity = sizeof(uint16_t) + 2 * sizeof(float);
+static constexpr size_t bytes_per_frame_header = 3 * sizeof(uint32_t);
+
+WorldHistory::WorldHistory(size_t max_entities, uint32_t tick_msec, uint32_t max_rtt_msec, size_t memory_budget_bytes)
+  : maxEntities(max_entities)
+{
+  // one extra frame so that the tick exactly max_rtt_msec old is still there
+  size_t wanted = (max_rtt_msec + tick_msec - 1) / (tick_msec ? tick_msec : 1) + 1;
+  size_t frameBytes = bytes_per_frame_header + maxEntities * bytes_per_entity;
+  size_t affordable = memory_budget_bytes / frameBytes;
+  numFrames = wanted < affordable ? wanted : affordable;
+  if (numFrames == 0)
+    numFrames = 1;
+
+  ticks.assign(numFrames, uint32_t(-1));
+  times.resize(numFrames);
+  counts.resize(numFrames);
+  eids.resize(numFrames * maxEntities);
+  xs.resize(numFrames * maxEntities);
+  ys.resize(numFrames * maxEntities);
+}
+
+void WorldHistory::begin_tick(uint32_t tick, uint32_t time_msec)
+{
+  cur = tick % numFrames;
+  ticks[cur] = tick;
+  times[cur] = time_msec;
+  counts[cur] = 0;
+  if (recordedFrames < numFrames)
+    recordedFrames++;
+}
+
+void WorldHistory::record(uint16_t eid, float x, float y)
+{
+  uint32_t &count = counts[cur];
+  if (count >= maxEntities)
+  {
+    droppedRecords++;
+    return;
+  }
+  size_t idx = cur * maxEntities + count;
+  eids[idx] = eid;
+  xs[idx] = x;
+  ys[idx] = y;
+  count++;
+}
+
+bool WorldHistory::rewind_to(uint32_t tick, Frame &frame) const
+{
+  size_t slot = tick % numFrames;
+  if (recordedFrames == 0 || ticks[slot] != tick)
+    return false;
+  size_t base = slot * maxEntities;
+  frame.tick = tick;
+  frame.timeMsec = times[slot];
+  frame.count = counts[slot];
+  frame.eid = eids.data() + base;
+  frame.x = xs.data() + base;
+  frame.y = ys.data() + base;
+  return true;
+}
+
+uint32_t WorldHistory::tick_at(uint32_t time_msec) const
+{
+  uint32_t tick = ticks[cur];
+  for (size_t i = 1; i < recordedFrames; ++i)
+  {
+    size_t slot = tick % numFrames;
+    if (int32_t(time_msec - times[slot]) >= 0)
+      break;
+    size_t prev = (tick - 1) % numFrames;
+    if (ticks[prev] != tick - 1)
+      break; // gap in recorded ticks, this is the oldest contiguous one
+    tick--;
+  }
+  return tick;
+}
+
+size_t WorldHistory::memory_bytes() const
+{
+  return numFrames * (bytes_per_frame_header + maxEntities * bytes_per_entity);
+}
+
+bool WorldHistory::Frame::find(uint16_t id, size_t hint, float &outX, float &outY) const
+{
+  if (hint < count && eid[hint] == id)
+  {
+    outX = x[hint];
+    outY = y[hint];
+    return true;
+  }
+  for (size_t i = 0; i < count; ++i)
+    if (eid[i] == id)
+    {
+      outX = x[i];
+      outY = y[i];
+      return true;
+    }
+  return false;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Server-side history of entity positions for lag compensation.
+// Every tick stores a compact copy of (eid, x, y) for all entities, laid out
+// as structure of arrays in one preallocated block: the ring is sized to
+// cover the maximum supported round trip, capped by a memory budget, and
+// never allocates after construction.
+class WorldHistory
+{
+public:
+  struct Frame
+  {
+    uint32_t tick = 0;
+    uint32_t timeMsec = 0;
+    size_t count = 0;
+    const uint16_t *eid = nullptr;
+    const float *x = nullptr;
+    const float *y = nullptr;
+
+    /**
+     * Looks up an entity position in this frame.
+     * @param hint Index the entity is expected at (its index in the live entity array), checked first
+     */
+    bool find(uint16_t id, size_t hint, float &outX, float &outY) const;
+  };
+
+  WorldHistory(size_t max_entities, uint32_t tick_msec, uint32_t max_rtt_msec, size_t memory_budget_bytes);
+
+  // Starts recording a new tick, overwriting the oldest one in the ring.
+  void begin_tick(uint32_t tick, uint32_t time_msec);
+  // Appends an entity to the current tick. Entities above max_entities are not
+  // recorded, they only count in dropped_records() and are not rewound.
+  void record(uint16_t eid, float x, float y);
+
+  // Returns false if the tick is too old (already overwritten) or was never recorded.
+  bool rewind_to(uint32_t tick, Frame &frame) const;
+  // Newest recorded tick with a timestamp not later than time_msec, clamped to the oldest kept one.
+  uint32_t tick_at(uint32_t time_msec) const;
+
+  size_t frame_capacity() const { return numFrames; }
+  size_t dropped_records() const { return droppedRecords; }
+  size_t memory_bytes() const;
+
+private:
+  size_t maxEntities = 0;
+  size_t numFrames = 0;
+  size_t recordedFrames = 0;
+  size_t cur = 0;
+  size_t droppedRecords = 0;
+
+  // per frame
+  std::vector<uint32_t> ticks;
+  std::vector<uint32_t> times;
+  std::vector<uint32_t> counts;
+  // per frame * maxEntities
+  std::vector<uint16_t> eids;
+  std::vector<float> xs;
+  std::vector<float> ys;
+};
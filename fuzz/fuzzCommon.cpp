@@ -0,0 +1,56 @@
+#include "fuzzTarget.h"
+#include "fakeEnet.h"
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+static std::vector<FuzzPacket> sentPackets;
+
+static void record_packet(ENetPeer *, enet_uint8, const ENetPacket *packet)
+{
+  sentPackets.emplace_back(packet->data, packet->data + packet->dataLength);
+}
+
+std::vector<FuzzPacket> take_sent_packets()
+{
+  std::vector<FuzzPacket> res;
+  res.swap(sentPackets);
+  return res;
+}
+
+static bool write_corpus(const char *dir)
+{
+  std::vector<FuzzPacket> seeds;
+  fuzz_seed_packets(seeds);
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  for (size_t i = 0; i < seeds.size(); ++i)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "seed_%03zu", i);
+    std::string path = (std::filesystem::path(dir) / name).string();
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+      printf("Cannot write %s\n", path.c_str());
+      return false;
+    }
+    fwrite(seeds[i].data(), 1, seeds[i].size(), f);
+    fclose(f);
+  }
+  printf("Wrote %zu seed packets to %s\n", seeds.size(), dir);
+  return true;
+}
+
+// Called by libFuzzer and the standalone driver before anything else.
+// `-write_corpus=DIR` regenerates the seed corpus and exits, libFuzzer only
+// warns about the flag it does not know.
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  fake_enet_set_send_callback(record_packet);
+  const char *flag = "-write_corpus=";
+  for (int i = 1; i < *argc; ++i)
+    if (strncmp((*argv)[i], flag, strlen(flag)) == 0)
+      exit(write_corpus((*argv)[i] + strlen(flag)) ? 0 : 1);
+  return 0;
+}
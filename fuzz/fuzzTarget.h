@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Shared pieces of the protocol fuzz targets. Each fuzz_<week>.cpp links one
+// week's protocol.cpp against common/fakeEnet.cpp and implements
+// LLVMFuzzerTestOneInput plus fuzz_seed_packets.
+
+typedef std::vector<uint8_t> FuzzPacket;
+
+// Packets the week's send_* functions produce for typical game state,
+// written out by `-write_corpus=DIR` and always mixed into the standalone driver's corpus.
+void fuzz_seed_packets(std::vector<FuzzPacket> &out);
+
+// Contents of every packet passed to enet_peer_send since the last call.
+std::vector<FuzzPacket> take_sent_packets();
+
+// Invariant a successful decode must guarantee, aborts so the engine records the input.
+#define FUZZ_CHECK(cond)                                           \
+  do                                                               \
+  {                                                                \
+    if (!(cond))                                                   \
+    {                                                              \
+      fprintf(stderr, "FUZZ_CHECK failed: %s (%s:%d)\n", #cond,    \
+              __FILE__, __LINE__);                                 \
+      abort();                                                     \
+    }                                                              \
+  } while (false)
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
@@ -0,0 +1,50 @@
+#include "fuzzTarget.h"
+#include "bitstream.h"
+#include <stdexcept>
+
+void fuzz_seed_packets(std::vector<FuzzPacket> &out)
+{
+  // ops matching the layout below: u16, 10 bits, float, u64, string, bool array, bit, align
+  FuzzPacket seed = {2, 1 + 8 * 10, 3, 4, 5, 6, 0, 7};
+  BitStream bs;
+  bs.Write<uint16_t>(3);
+  bs.WriteBits(0x2a5, 10);
+  bs.Write<float>(1.5f);
+  bs.Write<uint64_t>(0x0123456789abcdefull);
+  bs.Write(std::string("mipt"));
+  bs.WriteBoolArray({true, false, true, true});
+  bs.WriteBit(true);
+  seed.insert(seed.end(), bs.GetData(), bs.GetData() + bs.GetSizeBytes());
+  out.push_back(seed);
+}
+
+// The first bytes pick which reads to run against the rest of the buffer.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  constexpr size_t numOps = 8;
+  if (size < numOps)
+    return 0;
+  BitStream bs(data + numOps, size - numOps);
+  try
+  {
+    for (size_t i = 0; i < numOps; ++i)
+    {
+      uint8_t op = data[i];
+      switch (op % 8)
+      {
+      case 0: bs.ReadBit(); break;
+      case 1: bs.ReadBits(uint8_t(op / 8 % 33)); break;
+      case 2: { uint16_t v; bs.Read(v); break; }
+      case 3: { float v; bs.Read(v); break; }
+      case 4: { uint64_t v; bs.Read(v); break; }
+      case 5: { std::string v; bs.Read(v); FUZZ_CHECK(v.size() <= size); break; }
+      case 6: { std::vector<bool> v = bs.ReadBoolArray(); FUZZ_CHECK(v.size() <= size * 8); break; }
+      case 7: bs.AlignRead(); break;
+      }
+    }
+  }
+  catch (const std::out_of_range &)
+  {
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "fuzzTarget.h"
+#include "protocol.h"
+#include <stdexcept>
+
+void fuzz_seed_packets(std::vector<FuzzPacket> &out)
+{
+  ENetPeer peer = {};
+  Entity ent = {0xff4488ff, 120.f, -45.5f, 7, true, 300.f, 200.f, 25.f, 12};
+  send_join(&peer);
+  send_new_entity(&peer, ent);
+  send_set_controlled_entity(&peer, ent.eid);
+  send_entity_state(&peer, ent.eid, ent.x, ent.y);
+  send_snapshot(&peer, ent.eid, ent.x, ent.y, ent.size);
+  send_entity_devoured(&peer, 3, ent.eid, 30.f, -100.f, 50.f);
+  send_score_update(&peer, ent.eid, 1234);
+  send_game_time(&peer, 59);
+  send_game_over(&peer, ent.eid, 4321);
+  const uint16_t destroyed[] = {3, ent.eid, 40};
+  send_destroy_entities(&peer, destroyed, 3);
+  Entity world[] = {ent, ent, ent};
+  world[1].eid = 3;
+  world[2].eid = 40;
+  world[2].x = -300.f;
+  send_world_state(&peer, world, 3);
+  out = take_sent_packets();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // decoders only read, the input is wrapped without a copy
+  ENetPacket packet = {};
+  packet.data = (enet_uint8*)data;
+  packet.dataLength = size;
+
+  Entity ent;
+  uint16_t eid = 0, eid2 = 0;
+  float x = 0.f, y = 0.f, sz = 0.f;
+  int value = 0;
+  std::vector<uint16_t> eids;
+  std::vector<Entity> ents;
+  // BitStream throws on truncated packets, that is the expected rejection
+  try
+  {
+    switch (get_packet_type(&packet))
+    {
+    case E_SERVER_TO_CLIENT_NEW_ENTITY:
+      deserialize_new_entity(&packet, ent);
+      break;
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+      deserialize_set_controlled_entity(&packet, eid);
+      break;
+    case E_CLIENT_TO_SERVER_STATE:
+      deserialize_entity_state(&packet, eid, x, y);
+      break;
+    case E_SERVER_TO_CLIENT_SNAPSHOT:
+      deserialize_snapshot(&packet, eid, x, y, sz);
+      break;
+    case E_SERVER_TO_CLIENT_ENTITY_DEVOURED:
+      deserialize_entity_devoured(&packet, eid, eid2, sz, x, y);
+      break;
+    case E_SERVER_TO_CLIENT_SCORE_UPDATE:
+      deserialize_score_update(&packet, eid, value);
+      break;
+    case E_SERVER_TO_CLIENT_GAME_TIME:
+      deserialize_game_time(&packet, value);
+      break;
+    case E_SERVER_TO_CLIENT_GAME_OVER:
+      deserialize_game_over(&packet, eid, value);
+      break;
+    case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+      deserialize_destroy_entities(&packet, eids);
+      FUZZ_CHECK(eids.size() * sizeof(uint16_t) <= size);
+      break;
+    case E_SERVER_TO_CLIENT_WORLD_STATE:
+      deserialize_world_state(&packet, ents);
+      break;
+    default:
+      break;
+    }
+  }
+  catch (const std::out_of_range &)
+  {
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include "fuzzTarget.h"
+#include "protocol.h"
+#include <cmath>
+#include <stdexcept>
+
+void fuzz_seed_packets(std::vector<FuzzPacket> &out)
+{
+  ENetPeer peer = {};
+  Entity ent;
+  ent.color = 0xff4488ff;
+  ent.x = 3.5f;
+  ent.y = -2.25f;
+  ent.ori = 1.f;
+  ent.vx = 0.5f;
+  ent.eid = 2;
+  InputFrame inputs[inputRedundancy] = {{120, 1.f, -1.f}, {119, 1.f, 0.f}, {118, 0.f, 0.f}, {117, -1.f, 1.f}};
+  send_join(&peer);
+  send_new_entity(&peer, ent);
+  send_set_controlled_entity(&peer, ent.eid);
+  for (uint8_t count = 1; count <= inputRedundancy; ++count)
+    send_entity_input(&peer, ent.eid, inputs, count);
+  send_snapshot(&peer, ent.eid, ent.x, ent.y, ent.ori, ent.vx, ent.vy, ent.omega,
+                TimePoint(std::chrono::milliseconds(123456)), 120, 118);
+  send_time_msec(&peer, 123456);
+  const uint16_t destroyed[] = {3, ent.eid, 40};
+  send_destroy_entities(&peer, destroyed, 3);
+  Entity world[] = {ent, ent, ent};
+  world[1].eid = 3;
+  world[2].eid = 40;
+  world[2].x = -10.f;
+  send_world_state(&peer, world, 3);
+  out = take_sent_packets();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // decoders only read, the input is wrapped without a copy
+  ENetPacket packet = {};
+  packet.data = (enet_uint8*)data;
+  packet.dataLength = size;
+
+  Entity ent;
+  uint16_t eid = 0;
+  InputFrame inputs[inputRedundancy];
+  uint8_t count = 0;
+  float x, y, ori, vx, vy, omega;
+  TimePoint timestamp;
+  uint32_t frame = 0, ack = 0;
+  std::vector<uint16_t> eids;
+  std::vector<Entity> ents;
+  // BitStream throws on truncated packets, that is the expected rejection
+  try
+  {
+    switch (get_packet_type(&packet))
+    {
+    case E_SERVER_TO_CLIENT_NEW_ENTITY:
+      deserialize_new_entity(&packet, ent);
+      break;
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+      deserialize_set_controlled_entity(&packet, eid);
+      break;
+    case E_CLIENT_TO_SERVER_INPUT:
+      if (deserialize_entity_input(&packet, eid, inputs, count))
+        for (uint8_t i = 0; i < count; ++i)
+          FUZZ_CHECK(std::isfinite(inputs[i].thr) && std::isfinite(inputs[i].steer));
+      FUZZ_CHECK(count <= inputRedundancy);
+      break;
+    case E_SERVER_TO_CLIENT_SNAPSHOT:
+      deserialize_snapshot(&packet, eid, x, y, ori, vx, vy, omega, timestamp, frame, ack);
+      break;
+    case E_SERVER_TO_CLIENT_TIME_MSEC:
+      deserialize_time_msec(&packet, frame);
+      break;
+    case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+      deserialize_destroy_entities(&packet, eids);
+      FUZZ_CHECK(eids.size() * sizeof(uint16_t) <= size);
+      break;
+    case E_SERVER_TO_CLIENT_WORLD_STATE:
+      deserialize_world_state(&packet, ents);
+      break;
+    default:
+      break;
+    }
+  }
+  catch (const std::out_of_range &)
+  {
+  }
+  return 0;
+}
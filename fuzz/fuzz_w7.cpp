@@ -0,0 +1,87 @@
+#include "fuzzTarget.h"
+#include "protocol.h"
+#include <cmath>
+
+void fuzz_seed_packets(std::vector<FuzzPacket> &out)
+{
+  ENetPeer peer = {};
+  Entity ent = {0x448844ff, false, 10.f, -20.f, 2.f, -30.f, 1.f, 0.f, 1.f, -1.f, 3};
+  InputFrame inputs[inputRedundancy] = {{42, 1.f, -1.f}, {41, 1.f, 0.f}, {40, 0.f, 0.f}, {39, -1.f, 1.f}};
+  send_join(&peer);
+  send_new_entity(&peer, ent);
+  send_set_controlled_entity(&peer, ent.eid);
+  for (uint8_t count = 1; count <= inputRedundancy; ++count)
+    send_entity_input(&peer, ent.eid, inputs, count);
+  send_snapshot(&peer, ent.eid, ent.x, ent.y, ent.ori, ent.vx, ent.vy, 42);
+  send_snapshot(&peer, ent.eid, -119.f, 119.f, -3.f, 0.f, 0.f, 0xffff);
+  send_time_msec(&peer, 123456);
+  const uint16_t destroyed[] = {3, ent.eid, 40};
+  send_destroy_entities(&peer, destroyed, 3);
+  Entity world[] = {ent, ent, ent};
+  world[1].eid = 3;
+  world[2].eid = 40;
+  world[2].serverControlled = true;
+  send_world_state(&peer, world, 3);
+  out = take_sent_packets();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // decoders only read, the input is wrapped without a copy
+  ENetPacket packet = {};
+  packet.data = (enet_uint8*)data;
+  packet.dataLength = size;
+
+  Entity ent;
+  uint16_t eid = invalid_entity;
+  InputFrame inputs[inputRedundancy];
+  uint8_t count = 0;
+  float x, y, ori, vx, vy;
+  uint16_t ack = 0;
+  uint32_t timeMsec = 0;
+  std::vector<uint16_t> eids;
+  std::vector<Entity> ents;
+  switch (get_packet_type(&packet))
+  {
+  case E_SERVER_TO_CLIENT_NEW_ENTITY:
+    if (deserialize_new_entity(&packet, ent))
+      FUZZ_CHECK(ent.eid != invalid_entity && std::isfinite(ent.x) && std::isfinite(ent.y) && std::isfinite(ent.ori));
+    break;
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+    if (deserialize_set_controlled_entity(&packet, eid))
+      FUZZ_CHECK(eid != invalid_entity);
+    break;
+  case E_CLIENT_TO_SERVER_INPUT:
+    if (deserialize_entity_input(&packet, eid, inputs, count))
+    {
+      FUZZ_CHECK(eid != invalid_entity && count >= 1 && count <= inputRedundancy);
+      for (uint8_t i = 0; i < count; ++i)
+        FUZZ_CHECK(fabsf(inputs[i].thr) <= 1.f && fabsf(inputs[i].steer) <= 1.f);
+    }
+    break;
+  case E_SERVER_TO_CLIENT_SNAPSHOT:
+    if (deserialize_snapshot(&packet, eid, x, y, ori, vx, vy, ack))
+      FUZZ_CHECK(fabsf(x) <= worldSize && fabsf(y) <= worldSize && std::isfinite(ori) &&
+                 std::isfinite(vx) && std::isfinite(vy));
+    break;
+  case E_SERVER_TO_CLIENT_TIME_MSEC:
+    deserialize_time_msec(&packet, timeMsec);
+    break;
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+    if (deserialize_destroy_entities(&packet, eids))
+    {
+      FUZZ_CHECK(!eids.empty() && eids.size() * sizeof(uint16_t) <= size);
+      for (uint16_t id : eids)
+        FUZZ_CHECK(id != invalid_entity);
+    }
+    break;
+  case E_SERVER_TO_CLIENT_WORLD_STATE:
+    if (deserialize_world_state(&packet, ents))
+      for (const Entity &e : ents)
+        FUZZ_CHECK(e.eid != invalid_entity && std::isfinite(e.x) && std::isfinite(e.y) && std::isfinite(e.ori));
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
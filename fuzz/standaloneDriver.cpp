@@ -0,0 +1,157 @@
+// Minimal mutation fuzzer for compilers without libFuzzer.
+// usage: fuzz_<week> [-runs=N] [-seed=S] [-max_len=L] [corpus files or dirs...]
+// Replays the seed packets and every corpus file once, then runs N mutated
+// inputs and reports execs/s. Crashes are left to the sanitizers, the input
+// that caused one is saved to fuzz-crash.bin.
+#include "fuzzTarget.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#if defined(__has_include)
+#if __has_include(<sanitizer/common_interface_defs.h>)
+#include <sanitizer/common_interface_defs.h>
+#define FUZZ_HAS_DEATH_CALLBACK 1
+#endif
+#endif
+
+static FuzzPacket currentInput;
+
+static void save_current_input()
+{
+  FILE *f = fopen("fuzz-crash.bin", "wb");
+  if (!f)
+    return;
+  fwrite(currentInput.data(), 1, currentInput.size(), f);
+  fclose(f);
+  fprintf(stderr, "Input saved to fuzz-crash.bin (%zu bytes)\n", currentInput.size());
+}
+
+static void run_one(const FuzzPacket &input)
+{
+  currentInput = input;
+  LLVMFuzzerTestOneInput(currentInput.data(), currentInput.size());
+}
+
+static bool read_file(const std::filesystem::path &path, FuzzPacket &out)
+{
+  FILE *f = fopen(path.string().c_str(), "rb");
+  if (!f)
+    return false;
+  out.clear();
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static void mutate(FuzzPacket &p, std::mt19937_64 &gen, size_t max_len)
+{
+  static const uint8_t interesting[] = {0x00, 0x01, 0x7f, 0x80, 0xff};
+  // NaN, +Inf, -Inf, denormal, largest finite
+  static const uint32_t specialFloats[] = {0x7fc00000, 0x7f800000, 0xff800000, 0x00000001, 0x7f7fffff};
+  int numMutations = 1 + int(gen() % 4);
+  for (int m = 0; m < numMutations; ++m)
+  {
+    size_t size = p.size();
+    switch (gen() % 8)
+    {
+    case 0: // flip a bit
+      if (size > 0)
+        p[gen() % size] ^= uint8_t(1 << (gen() % 8));
+      break;
+    case 1: // random byte
+      if (size > 0)
+        p[gen() % size] = uint8_t(gen());
+      break;
+    case 2: // boundary byte
+      if (size > 0)
+        p[gen() % size] = interesting[gen() % sizeof(interesting)];
+      break;
+    case 3: // insert
+      if (size < max_len)
+        p.insert(p.begin() + (size ? gen() % (size + 1) : 0), uint8_t(gen()));
+      break;
+    case 4: // erase
+      if (size > 0)
+        p.erase(p.begin() + gen() % size);
+      break;
+    case 5: // truncate
+      if (size > 0)
+        p.resize(gen() % size);
+      break;
+    case 6: // special float at a random offset
+      if (size >= sizeof(uint32_t))
+      {
+        uint32_t v = specialFloats[gen() % (sizeof(specialFloats) / sizeof(specialFloats[0]))];
+        memcpy(p.data() + gen() % (size - sizeof(uint32_t) + 1), &v, sizeof(uint32_t));
+      }
+      break;
+    case 7: // other message type
+      if (size > 0)
+        p[0] = uint8_t(gen() % 16);
+      break;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  LLVMFuzzerInitialize(&argc, &argv);
+#ifdef FUZZ_HAS_DEATH_CALLBACK
+  __sanitizer_set_death_callback(save_current_input);
+#endif
+
+  uint64_t runs = 1000000;
+  uint64_t seed = 1;
+  size_t maxLen = 256;
+  std::vector<FuzzPacket> corpus;
+  fuzz_seed_packets(corpus);
+  size_t numSeeds = corpus.size();
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *arg = argv[i];
+    if (strncmp(arg, "-runs=", 6) == 0)
+      runs = strtoull(arg + 6, nullptr, 10);
+    else if (strncmp(arg, "-seed=", 6) == 0)
+      seed = strtoull(arg + 6, nullptr, 10);
+    else if (strncmp(arg, "-max_len=", 9) == 0)
+      maxLen = strtoull(arg + 9, nullptr, 10);
+    else if (arg[0] == '-')
+      printf("Unknown flag %s ignored\n", arg);
+    else if (std::filesystem::is_directory(arg))
+    {
+      for (const auto &entry : std::filesystem::directory_iterator(arg))
+        if (entry.is_regular_file() && read_file(entry.path(), currentInput))
+          corpus.push_back(currentInput);
+    }
+    else if (read_file(arg, currentInput))
+      corpus.push_back(currentInput);
+    else
+      printf("Cannot read %s\n", arg);
+  }
+  printf("Corpus: %zu seed packets, %zu files\n", numSeeds, corpus.size() - numSeeds);
+
+  for (const FuzzPacket &input : corpus)
+    run_one(input);
+  if (corpus.empty())
+    corpus.emplace_back();
+
+  std::mt19937_64 gen(seed);
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < runs; ++i)
+  {
+    // mutate in place, the buffer keeps its capacity between runs
+    currentInput = corpus[gen() % corpus.size()];
+    mutate(currentInput, gen, maxLen);
+    LLVMFuzzerTestOneInput(currentInput.data(), currentInput.size());
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Done %llu runs in %.2f s: %.0f execs/s\n", (unsigned long long)runs, seconds,
+         seconds > 0.0 ? runs / seconds : 0.0);
+  return 0;
+}
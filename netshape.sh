@@ -1,5 +1,7 @@
 #!/bin/bash
 # https://serverfault.com/questions/725030/traffic-shaping-on-osx-10-10-with-pfctl-and-dnctl
+# Without macOS or root: configure with -DNETWORKED_NETSHAPE=ON and run the binaries with
+#   NETSHAPE="delay=150,loss=0.2,bw=50000" (see common/netShape.h)
 
 # Reset dummynet to default config
 dnctl -f flush
@@ -0,0 +1,466 @@
+#include "crypto.h"
+#include <cstring> // memcpy
+#include <random>
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static inline void store_le32(uint8_t *p, uint32_t v)
+{
+  p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); p[3] = uint8_t(v >> 24);
+}
+
+static inline void store_le64(uint8_t *p, uint64_t v)
+{
+  store_le32(p, uint32_t(v));
+  store_le32(p + 4, uint32_t(v >> 32));
+}
+
+void crypto_random_bytes(uint8_t *out, size_t size)
+{
+  static std::random_device rd;
+  for (size_t i = 0; i < size; i += sizeof(uint32_t))
+  {
+    uint32_t r = rd();
+    for (size_t j = 0; j < sizeof(uint32_t) && i + j < size; ++j)
+      out[i + j] = uint8_t(r >> (8 * j));
+  }
+}
+
+// ChaCha20 ------------------------------------------------------------------
+
+// Four blocks are computed side by side, word i of block l is lane l of row i.
+// With SSE2 (every x86-64 target) a row is one register, elsewhere the lane
+// loops are plain scalar code.
+constexpr int chachaLanes = 4;
+constexpr size_t chachaBlockSize = 64;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+typedef __m128i ChachaRow;
+static inline ChachaRow row_splat(uint32_t v) { return _mm_set1_epi32(int(v)); }
+static inline ChachaRow row_lanes(uint32_t a, uint32_t b, uint32_t c, uint32_t d) { return _mm_setr_epi32(int(a), int(b), int(c), int(d)); }
+static inline ChachaRow row_add(ChachaRow a, ChachaRow b) { return _mm_add_epi32(a, b); }
+static inline ChachaRow row_xor(ChachaRow a, ChachaRow b) { return _mm_xor_si128(a, b); }
+template<int n>
+static inline ChachaRow row_rotl(ChachaRow v) { return _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n)); }
+static inline void row_store(ChachaRow v, uint32_t out[chachaLanes]) { _mm_storeu_si128((__m128i*)out, v); }
+// x86 is little-endian, transposing 4 rows gives 16 bytes of each block.
+static inline void rows_store_blocks(const ChachaRow (&x)[16], uint8_t *out)
+{
+  for (int i = 0; i < 16; i += 4)
+  {
+    __m128i t0 = _mm_unpacklo_epi32(x[i], x[i + 1]);
+    __m128i t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+    __m128i t2 = _mm_unpackhi_epi32(x[i], x[i + 1]);
+    __m128i t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+    _mm_storeu_si128((__m128i*)(out + 0 * chachaBlockSize + 4 * i), _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 1 * chachaBlockSize + 4 * i), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 2 * chachaBlockSize + 4 * i), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(out + 3 * chachaBlockSize + 4 * i), _mm_unpackhi_epi64(t2, t3));
+  }
+}
+#else
+struct ChachaRow { uint32_t v[chachaLanes]; };
+static inline ChachaRow row_splat(uint32_t v) { return {{v, v, v, v}}; }
+static inline ChachaRow row_lanes(uint32_t a, uint32_t b, uint32_t c, uint32_t d) { return {{a, b, c, d}}; }
+static inline ChachaRow row_add(ChachaRow a, ChachaRow b) { for (int l = 0; l < chachaLanes; ++l) a.v[l] += b.v[l]; return a; }
+static inline ChachaRow row_xor(ChachaRow a, ChachaRow b) { for (int l = 0; l < chachaLanes; ++l) a.v[l] ^= b.v[l]; return a; }
+template<int n>
+static inline ChachaRow row_rotl(ChachaRow a) { for (int l = 0; l < chachaLanes; ++l) a.v[l] = (a.v[l] << n) | (a.v[l] >> (32 - n)); return a; }
+static inline void row_store(ChachaRow v, uint32_t out[chachaLanes]) { memcpy(out, v.v, sizeof(v.v)); }
+static inline void rows_store_blocks(const ChachaRow (&x)[16], uint8_t *out)
+{
+  for (int l = 0; l < chachaLanes; ++l)
+    for (int i = 0; i < 16; ++i)
+      store_le32(out + l * chachaBlockSize + 4 * i, x[i].v[l]);
+}
+#endif
+
+static inline void chacha_quarter_round(ChachaRow &a, ChachaRow &b, ChachaRow &c, ChachaRow &d)
+{
+  a = row_add(a, b); d = row_rotl<16>(row_xor(d, a));
+  c = row_add(c, d); b = row_rotl<12>(row_xor(b, c));
+  a = row_add(a, b); d = row_rotl<8>(row_xor(d, a));
+  c = row_add(c, d); b = row_rotl<7>(row_xor(b, c));
+}
+
+// `input` is the last four state words: block counter and nonce.
+static void chacha_init(ChachaRow (&s)[16], const uint8_t key[aeadKeySize], const uint8_t input[16])
+{
+  static const uint32_t sigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+  for (int i = 0; i < 4; ++i)
+    s[i] = row_splat(sigma[i]);
+  for (int i = 0; i < 8; ++i)
+    s[4 + i] = row_splat(load_le32(key + 4 * i));
+  for (int i = 0; i < 4; ++i)
+    s[12 + i] = row_splat(load_le32(input + 4 * i));
+}
+
+static void chacha_rounds(ChachaRow (&x)[16])
+{
+  for (int r = 0; r < 10; ++r)
+  {
+    chacha_quarter_round(x[0], x[4], x[8], x[12]);
+    chacha_quarter_round(x[1], x[5], x[9], x[13]);
+    chacha_quarter_round(x[2], x[6], x[10], x[14]);
+    chacha_quarter_round(x[3], x[7], x[11], x[15]);
+    chacha_quarter_round(x[0], x[5], x[10], x[15]);
+    chacha_quarter_round(x[1], x[6], x[11], x[12]);
+    chacha_quarter_round(x[2], x[7], x[8], x[13]);
+    chacha_quarter_round(x[3], x[4], x[9], x[14]);
+  }
+}
+
+// Keystream blocks counter .. counter + 3.
+static void chacha20_blocks4(uint8_t out[chachaLanes * chachaBlockSize], const uint8_t key[aeadKeySize],
+                             const uint8_t nonce[aeadNonceSize], uint32_t counter)
+{
+  uint8_t input[16];
+  store_le32(input, counter);
+  memcpy(input + 4, nonce, aeadNonceSize);
+  ChachaRow s[16];
+  chacha_init(s, key, input);
+  s[12] = row_lanes(counter, counter + 1, counter + 2, counter + 3);
+
+  ChachaRow x[16];
+  for (int i = 0; i < 16; ++i)
+    x[i] = s[i];
+  chacha_rounds(x);
+  for (int i = 0; i < 16; ++i)
+    x[i] = row_add(x[i], s[i]);
+  rows_store_blocks(x, out);
+}
+
+static inline void xor_bytes(uint8_t *data, const uint8_t *stream, size_t size)
+{
+  for (size_t i = 0; i < size; ++i)
+    data[i] ^= stream[i];
+}
+
+void chacha20_xor(uint8_t *data, size_t size, const uint8_t key[aeadKeySize],
+                  const uint8_t nonce[aeadNonceSize], uint32_t counter)
+{
+  uint8_t stream[chachaLanes * chachaBlockSize];
+  while (size > 0)
+  {
+    chacha20_blocks4(stream, key, nonce, counter);
+    size_t n = size < sizeof(stream) ? size : sizeof(stream);
+    xor_bytes(data, stream, n);
+    data += n;
+    size -= n;
+    counter += chachaLanes;
+  }
+}
+
+void hchacha20(uint8_t out[aeadKeySize], const uint8_t key[aeadKeySize], const uint8_t input[16])
+{
+  ChachaRow x[16];
+  chacha_init(x, key, input);
+  chacha_rounds(x);
+  uint32_t words[chachaLanes];
+  for (int i = 0; i < 4; ++i)
+  {
+    row_store(x[i], words);
+    store_le32(out + 4 * i, words[0]);
+    row_store(x[12 + i], words);
+    store_le32(out + 16 + 4 * i, words[0]);
+  }
+}
+
+// Poly1305, 26-bit limbs so every product fits into 64 bits on any compiler --
+
+struct Poly1305
+{
+  uint32_t r[5];
+  uint32_t h[5] = {0, 0, 0, 0, 0};
+  uint32_t pad[4];
+
+  explicit Poly1305(const uint8_t key[32])
+  {
+    r[0] = (load_le32(key + 0)) & 0x3ffffff;
+    r[1] = (load_le32(key + 3) >> 2) & 0x3ffff03;
+    r[2] = (load_le32(key + 6) >> 4) & 0x3ffc0ff;
+    r[3] = (load_le32(key + 9) >> 6) & 0x3f03fff;
+    r[4] = (load_le32(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 4; ++i)
+      pad[i] = load_le32(key + 16 + 4 * i);
+  }
+
+  // Full 16-byte blocks only, the AEAD construction zero-pads everything it hashes.
+  void blocks(const uint8_t *m, size_t num_blocks)
+  {
+    const uint64_t r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+    const uint64_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+    for (; num_blocks > 0; --num_blocks, m += 16)
+    {
+      h0 += (load_le32(m + 0)) & 0x3ffffff;
+      h1 += (load_le32(m + 3) >> 2) & 0x3ffffff;
+      h2 += (load_le32(m + 6) >> 4) & 0x3ffffff;
+      h3 += (load_le32(m + 9) >> 6) & 0x3ffffff;
+      h4 += (load_le32(m + 12) >> 8) | (1 << 24);
+
+      uint64_t d0 = h0 * r0 + h1 * s4 + h2 * s3 + h3 * s2 + h4 * s1;
+      uint64_t d1 = h0 * r1 + h1 * r0 + h2 * s4 + h3 * s3 + h4 * s2;
+      uint64_t d2 = h0 * r2 + h1 * r1 + h2 * r0 + h3 * s4 + h4 * s3;
+      uint64_t d3 = h0 * r3 + h1 * r2 + h2 * r1 + h3 * r0 + h4 * s4;
+      uint64_t d4 = h0 * r4 + h1 * r3 + h2 * r2 + h3 * r1 + h4 * r0;
+
+      uint32_t c = uint32_t(d0 >> 26); h0 = uint32_t(d0) & 0x3ffffff;
+      d1 += c; c = uint32_t(d1 >> 26); h1 = uint32_t(d1) & 0x3ffffff;
+      d2 += c; c = uint32_t(d2 >> 26); h2 = uint32_t(d2) & 0x3ffffff;
+      d3 += c; c = uint32_t(d3 >> 26); h3 = uint32_t(d3) & 0x3ffffff;
+      d4 += c; c = uint32_t(d4 >> 26); h4 = uint32_t(d4) & 0x3ffffff;
+      h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+      h1 += c;
+    }
+    h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+  }
+
+  void padded(const uint8_t *m, size_t size)
+  {
+    blocks(m, size / 16);
+    if (size_t rem = size % 16)
+    {
+      uint8_t last[16] = {};
+      memcpy(last, m + size - rem, rem);
+      blocks(last, 1);
+    }
+  }
+
+  void finish(uint8_t tag[aeadTagSize])
+  {
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+    uint32_t c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // g = h + 5 - 2^130, pick g when it did not underflow, i.e. h >= p
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    uint32_t w0 = h0 | (h1 << 26);
+    uint32_t w1 = (h1 >> 6) | (h2 << 20);
+    uint32_t w2 = (h2 >> 12) | (h3 << 14);
+    uint32_t w3 = (h3 >> 18) | (h4 << 8);
+    uint64_t f = uint64_t(w0) + pad[0];              store_le32(tag + 0, uint32_t(f));
+    f = uint64_t(w1) + pad[1] + (f >> 32);           store_le32(tag + 4, uint32_t(f));
+    f = uint64_t(w2) + pad[2] + (f >> 32);           store_le32(tag + 8, uint32_t(f));
+    f = uint64_t(w3) + pad[3] + (f >> 32);           store_le32(tag + 12, uint32_t(f));
+  }
+};
+
+// ChaCha20-Poly1305 ----------------------------------------------------------
+
+static void aead_tag(const uint8_t *cipher, size_t size, const uint8_t *aad, size_t aad_size,
+                     const uint8_t poly_key[32], uint8_t tag[aeadTagSize])
+{
+  Poly1305 mac(poly_key);
+  mac.padded(aad, aad_size);
+  mac.padded(cipher, size);
+  uint8_t lengths[16];
+  store_le64(lengths, aad_size);
+  store_le64(lengths + 8, size);
+  mac.blocks(lengths, 1);
+  mac.finish(tag);
+}
+
+// One 4-block call covers the Poly1305 key (block 0) and the first 192 bytes
+// of payload, which is every gameplay packet.
+static void aead_xor(uint8_t *data, size_t size, const uint8_t key[aeadKeySize],
+                     const uint8_t nonce[aeadNonceSize], const uint8_t *head_stream)
+{
+  size_t head = chachaLanes * chachaBlockSize - chachaBlockSize;
+  head = size < head ? size : head;
+  xor_bytes(data, head_stream + chachaBlockSize, head);
+  if (size > head)
+    chacha20_xor(data + head, size - head, key, nonce, chachaLanes);
+}
+
+void aead_seal(uint8_t *data, size_t size, const uint8_t *aad, size_t aad_size,
+               const uint8_t key[aeadKeySize], const uint8_t nonce[aeadNonceSize],
+               uint8_t tag[aeadTagSize])
+{
+  uint8_t stream[chachaLanes * chachaBlockSize];
+  chacha20_blocks4(stream, key, nonce, 0);
+  aead_xor(data, size, key, nonce, stream);
+  aead_tag(data, size, aad, aad_size, stream, tag);
+}
+
+bool aead_open(uint8_t *data, size_t size, const uint8_t *aad, size_t aad_size,
+               const uint8_t key[aeadKeySize], const uint8_t nonce[aeadNonceSize],
+               const uint8_t tag[aeadTagSize])
+{
+  uint8_t stream[chachaLanes * chachaBlockSize];
+  chacha20_blocks4(stream, key, nonce, 0);
+  uint8_t expected[aeadTagSize];
+  aead_tag(data, size, aad, aad_size, stream, expected);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < aeadTagSize; ++i)
+    diff |= expected[i] ^ tag[i];
+  if (diff != 0)
+    return false;
+
+  aead_xor(data, size, key, nonce, stream);
+  return true;
+}
+
+// X25519, 16 limbs of 16 bits in int64 (TweetNaCl layout), constant time -----
+
+typedef int64_t Fe[16];
+
+static void fe_carry(Fe o)
+{
+  for (int i = 0; i < 16; ++i)
+  {
+    o[i] += int64_t(1) << 16;
+    int64_t c = o[i] >> 16;
+    if (i < 15)
+      o[i + 1] += c - 1;
+    else
+      o[0] += 38 * (c - 1);
+    o[i] -= c * (int64_t(1) << 16);
+  }
+}
+
+static void fe_cswap(Fe p, Fe q, int b)
+{
+  int64_t c = ~(int64_t(b) - 1);
+  for (int i = 0; i < 16; ++i)
+  {
+    int64_t t = c & (p[i] ^ q[i]);
+    p[i] ^= t;
+    q[i] ^= t;
+  }
+}
+
+static void fe_pack(uint8_t o[32], const Fe n)
+{
+  Fe m, t;
+  memcpy(t, n, sizeof(Fe));
+  fe_carry(t);
+  fe_carry(t);
+  fe_carry(t);
+  for (int j = 0; j < 2; ++j)
+  {
+    m[0] = t[0] - 0xffed;
+    for (int i = 1; i < 15; ++i)
+    {
+      m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+      m[i - 1] &= 0xffff;
+    }
+    m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+    int b = int((m[15] >> 16) & 1);
+    m[14] &= 0xffff;
+    fe_cswap(t, m, 1 - b);
+  }
+  for (int i = 0; i < 16; ++i)
+  {
+    o[2 * i] = uint8_t(t[i]);
+    o[2 * i + 1] = uint8_t(t[i] >> 8);
+  }
+}
+
+static void fe_unpack(Fe o, const uint8_t n[32])
+{
+  for (int i = 0; i < 16; ++i)
+    o[i] = n[2 * i] + (int64_t(n[2 * i + 1]) << 8);
+  o[15] &= 0x7fff;
+}
+
+static void fe_add(Fe o, const Fe a, const Fe b) { for (int i = 0; i < 16; ++i) o[i] = a[i] + b[i]; }
+static void fe_sub(Fe o, const Fe a, const Fe b) { for (int i = 0; i < 16; ++i) o[i] = a[i] - b[i]; }
+
+static void fe_mul(Fe o, const Fe a, const Fe b)
+{
+  int64_t t[31] = {};
+  for (int i = 0; i < 16; ++i)
+    for (int j = 0; j < 16; ++j)
+      t[i + j] += a[i] * b[j];
+  for (int i = 0; i < 15; ++i)
+    t[i] += 38 * t[i + 16];
+  memcpy(o, t, sizeof(Fe));
+  fe_carry(o);
+  fe_carry(o);
+}
+
+static void fe_sq(Fe o, const Fe a) { fe_mul(o, a, a); }
+
+static void fe_invert(Fe o, const Fe in)
+{
+  Fe c;
+  memcpy(c, in, sizeof(Fe));
+  // in^(p-2), p - 2 = 2^255 - 21
+  for (int a = 253; a >= 0; --a)
+  {
+    fe_sq(c, c);
+    if (a != 2 && a != 4)
+      fe_mul(c, c, in);
+  }
+  memcpy(o, c, sizeof(Fe));
+}
+
+void x25519(uint8_t out[x25519KeySize], const uint8_t scalar[x25519KeySize], const uint8_t point[x25519KeySize])
+{
+  static const Fe a24 = {0xdb41, 1}; // 121665
+  uint8_t z[32];
+  memcpy(z, scalar, sizeof(z));
+  z[31] = (z[31] & 127) | 64;
+  z[0] &= 248;
+
+  Fe x, a = {1}, b, c = {}, d = {1}, e, f;
+  fe_unpack(x, point);
+  memcpy(b, x, sizeof(Fe));
+  // Montgomery ladder, (a : c) = x2, (b : d) = x3
+  for (int i = 254; i >= 0; --i)
+  {
+    int bit = (z[i >> 3] >> (i & 7)) & 1;
+    fe_cswap(a, b, bit);
+    fe_cswap(c, d, bit);
+    fe_add(e, a, c);
+    fe_sub(a, a, c);
+    fe_add(c, b, d);
+    fe_sub(b, b, d);
+    fe_sq(d, e);
+    fe_sq(f, a);
+    fe_mul(a, c, a);
+    fe_mul(c, b, e);
+    fe_add(e, a, c);
+    fe_sub(a, a, c);
+    fe_sq(b, a);
+    fe_sub(c, d, f);
+    fe_mul(a, c, a24);
+    fe_add(a, a, d);
+    fe_mul(c, c, a);
+    fe_mul(a, d, f);
+    fe_mul(d, b, x);
+    fe_sq(b, e);
+    fe_cswap(a, b, bit);
+    fe_cswap(c, d, bit);
+  }
+  fe_invert(c, c);
+  fe_mul(a, a, c);
+  fe_pack(out, a);
+}
+
+void x25519_base(uint8_t out[x25519KeySize], const uint8_t scalar[x25519KeySize])
+{
+  static const uint8_t basepoint[x25519KeySize] = {9};
+  x25519(out, scalar, basepoint);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Self-contained packet crypto for w10: X25519 (RFC 7748) for the handshake,
+// ChaCha20-Poly1305 (RFC 8439) for every packet after it.
+
+constexpr size_t x25519KeySize = 32;
+constexpr size_t aeadKeySize = 32;
+constexpr size_t aeadNonceSize = 12;
+constexpr size_t aeadTagSize = 16;
+
+void crypto_random_bytes(uint8_t *out, size_t size);
+
+// out = scalar * point, all values little-endian 32 bytes.
+void x25519(uint8_t out[x25519KeySize], const uint8_t scalar[x25519KeySize], const uint8_t point[x25519KeySize]);
+// out = scalar * basepoint, i.e. the public key for the secret `scalar`.
+void x25519_base(uint8_t out[x25519KeySize], const uint8_t scalar[x25519KeySize]);
+
+// Raw ChaCha20 keystream XOR starting from block `counter`, data may be in place.
+void chacha20_xor(uint8_t *data, size_t size, const uint8_t key[aeadKeySize],
+                  const uint8_t nonce[aeadNonceSize], uint32_t counter);
+// Derives a subkey from a key and 16 bytes of input without the final feed-forward (XChaCha20 HChaCha20).
+void hchacha20(uint8_t out[aeadKeySize], const uint8_t key[aeadKeySize], const uint8_t input[16]);
+
+// Encrypts `data` in place and writes the tag, `aad` is authenticated but not encrypted.
+void aead_seal(uint8_t *data, size_t size, const uint8_t *aad, size_t aad_size,
+               const uint8_t key[aeadKeySize], const uint8_t nonce[aeadNonceSize],
+               uint8_t tag[aeadTagSize]);
+// Verifies the tag and decrypts `data` in place, returns false (data untouched) on mismatch.
+bool aead_open(uint8_t *data, size_t size, const uint8_t *aad, size_t aad_size,
+               const uint8_t key[aeadKeySize], const uint8_t nonce[aeadNonceSize],
+               const uint8_t tag[aeadTagSize]);
@@ -8,20 +8,29 @@
 #include <vector>
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
+#include "entityTable.h"
 
 
-static std::vector<Entity> entities;
+static EntityTable<Entity> entities;
 static uint16_t my_entity = invalid_entity;
+static CryptoSession session;
 
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
-  deserialize_new_entity(packet, newEntity);
-  // TODO: Direct adressing, of course!
-  for (const Entity &e : entities)
-    if (e.eid == newEntity.eid)
-      return; // don't need to do anything, we already have entity
-  entities.push_back(newEntity);
+  if (!deserialize_new_entity(packet, newEntity))
+    return;
+  entities.add(newEntity); // does nothing if we already have the entity
+}
+
+void on_world_state(ENetPacket *packet)
+{
+  std::vector<Entity> ents;
+  if (!deserialize_world_state(packet, ents))
+    return;
+  for (const Entity &ent : ents)
+    entities.add(ent);
 }
 
 void on_set_controlled_entity(ENetPacket *packet)
@@ -33,20 +42,32 @@ void on_snapshot(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f; float ori = 0.f;
-  deserialize_snapshot(packet, eid, x, y, ori);
-  // TODO: Direct adressing, of course!
-  for (Entity &e : entities)
-    if (e.eid == eid)
-    {
-      e.x = x;
-      e.y = y;
-      e.ori = ori;
-    }
+  if (!deserialize_snapshot(packet, eid, x, y, ori))
+    return;
+  if (Entity *e = entities.find(eid))
+  {
+    e->x = x;
+    e->y = y;
+    e->ori = ori;
+  }
+}
+
+void on_destroy_entities(ENetPacket *packet)
+{
+  std::vector<uint16_t> eids;
+  if (!deserialize_destroy_entities(packet, eids))
+    return;
+  for (uint16_t eid : eids)
+    entities.remove(eid);
 }
 
 void on_key(ENetPacket *packet)
 {
-  deserialize_and_set_key(packet);
+  uint8_t serverKey[x25519KeySize];
+  if (session.established || !deserialize_session_key(packet, serverKey))
+    return;
+  if (!establish_crypto_session(session, serverKey, false))
+    printf("Server sent an invalid session key\n");
 }
 
 int main(int argc, const char **argv)
@@ -74,6 +95,8 @@ int main(int argc, const char **argv)
     printf("Cannot connect to server");
     return 1;
   }
+  start_crypto_session(session);
+  serverPeer->data = &session;
 
   int width = 600;
   int height = 600;
@@ -109,20 +132,32 @@ int main(int argc, const char **argv)
       {
       case ENET_EVENT_TYPE_CONNECT:
         printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        send_join(serverPeer);
+        send_join(serverPeer, session);
         connected = true;
         break;
       case ENET_EVENT_TYPE_RECEIVE:
+        message_stats_received(event.packet);
         switch (get_packet_type(event.packet))
         {
         case E_SERVER_TO_CLIENT_NEW_ENTITY:
-          on_new_entity_packet(event.packet);
+          if (open_packet(event.peer, event.channelID, event.packet))
+            on_new_entity_packet(event.packet);
           break;
         case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
-          on_set_controlled_entity(event.packet);
+          if (open_packet(event.peer, event.channelID, event.packet))
+            on_set_controlled_entity(event.packet);
           break;
         case E_SERVER_TO_CLIENT_SNAPSHOT:
-          on_snapshot(event.packet);
+          if (open_packet(event.peer, event.channelID, event.packet))
+            on_snapshot(event.packet);
+          break;
+        case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+          if (open_packet(event.peer, event.channelID, event.packet))
+            on_destroy_entities(event.packet);
+          break;
+        case E_SERVER_TO_CLIENT_WORLD_STATE:
+          if (open_packet(event.peer, event.channelID, event.packet))
+            on_world_state(event.packet);
           break;
         case E_SERVER_TO_CLIENT_KEY:
           on_key(event.packet);
@@ -139,17 +174,15 @@ int main(int argc, const char **argv)
       bool right = IsKeyDown(KEY_RIGHT);
       bool up = IsKeyDown(KEY_UP);
       bool down = IsKeyDown(KEY_DOWN);
-      // TODO: Direct adressing, of course!
-      for (Entity &e : entities)
-        if (e.eid == my_entity)
-        {
-          // Update
-          float thr = (up ? 1.f : 0.f) + (down ? -1.f : 0.f);
-          float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
+      if (entities.find(my_entity))
+      {
+        // Update
+        float thr = (up ? 1.f : 0.f) + (down ? -1.f : 0.f);
+        float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
 
-          // Send
-          send_entity_input(serverPeer, my_entity, thr, steer);
-        }
+        // Send
+        send_entity_input(serverPeer, my_entity, thr, steer);
+      }
     }
 
     BeginDrawing();
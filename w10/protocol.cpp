@@ -1,63 +1,217 @@
 #include "protocol.h"
 #include "quantisation.h"
+#include "lz4Block.h"
+#include "wireFormat.h"
+#include "messageStats.h"
+#include <cmath>
 #include <cstring> // memcpy
 #include <iostream>
 #include <stdlib.h>
 
-static uint32_t xorCipherKey = 0;
+void start_crypto_session(CryptoSession &session)
+{
+  session = CryptoSession();
+  crypto_random_bytes(session.secretKey, x25519KeySize);
+  x25519_base(session.publicKey, session.secretKey);
+}
 
-void send_join(ENetPeer *peer)
+bool establish_crypto_session(CryptoSession &session, const uint8_t peer_public_key[x25519KeySize], bool is_server)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
-  *packet->data = E_CLIENT_TO_SERVER_JOIN;
+  uint8_t shared[x25519KeySize];
+  x25519(shared, session.secretKey, peer_public_key);
+  uint8_t nonZero = 0;
+  for (uint8_t b : shared)
+    nonZero |= b;
+  if (!nonZero)
+    return false; // low order point, the "secret" would be known to everyone
+
+  // hash the raw shared point, then expand it into one key per direction
+  static const uint8_t kdfInput[16] = {'w', '1', '0', ' ', 's', 'e', 's', 's', 'i', 'o', 'n', ' ', 'k', 'd', 'f', 0};
+  static const uint8_t kdfNonce[aeadNonceSize] = {};
+  uint8_t master[aeadKeySize];
+  hchacha20(master, shared, kdfInput);
+  uint8_t keys[2 * aeadKeySize] = {};
+  chacha20_xor(keys, sizeof(keys), master, kdfNonce, 0);
+  const uint8_t *clientToServer = keys;
+  const uint8_t *serverToClient = keys + aeadKeySize;
+  memcpy(session.sendKey, is_server ? serverToClient : clientToServer, aeadKeySize);
+  memcpy(session.recvKey, is_server ? clientToServer : serverToClient, aeadKeySize);
+  memset(session.secretKey, 0, x25519KeySize);
+  session.established = true;
+  return true;
+}
 
+static void make_nonce(uint8_t (&nonce)[aeadNonceSize], uint8_t channel, uint64_t seq)
+{
+  memset(nonce, 0, sizeof(nonce));
+  nonce[0] = channel;
+  for (size_t i = 0; i < sizeof(uint64_t); ++i)
+    nonce[4 + i] = uint8_t(seq >> (8 * i));
+}
+
+// Payload is written at data + 1 as usual, the extra room is for the seal.
+static ENetPacket *create_packet(size_t size, uint32_t flags)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, size + sealOverhead, flags);
+  packet->dataLength = size;
+  return packet;
+}
+
+// `raw_bits` is what the payload takes before quantisation and compression,
+// 0 if it is sent as is.
+static void send_sealed(ENetPeer *peer, uint8_t channel, ENetPacket *packet, size_t raw_bits = 0)
+{
+  CryptoSession *session = (CryptoSession*)peer->data;
+  if (!session || !session->established || channel >= cryptoChannels)
+  {
+    // no keys yet, game state never goes out in clear
+    enet_packet_destroy(packet);
+    return;
+  }
+  uint64_t seq = ++session->sendSeq[channel];
+  uint32_t seqLow = uint32_t(seq);
+  size_t bodySize = packet->dataLength - sizeof(uint8_t);
+  uint8_t *body = packet->data + sizeof(uint8_t) + sizeof(uint32_t);
+  memmove(body, packet->data + sizeof(uint8_t), bodySize);
+  memcpy(packet->data + sizeof(uint8_t), &seqLow, sizeof(uint32_t));
+
+  uint8_t nonce[aeadNonceSize];
+  make_nonce(nonce, channel, seq);
+  aead_seal(body, bodySize, packet->data, sizeof(uint8_t), session->sendKey, nonce, body + bodySize);
+  packet->dataLength += sealOverhead;
+
+  if (raw_bits)
+    message_stats_sent(packet, raw_bits + sealOverhead * 8);
+  else
+    message_stats_sent(packet);
+  enet_peer_send(peer, channel, packet);
+}
+
+bool open_packet(ENetPeer *peer, uint8_t channel, ENetPacket *packet)
+{
+  CryptoSession *session = (CryptoSession*)peer->data;
+  if (!session || !session->established || channel >= cryptoChannels ||
+      packet->dataLength < sizeof(uint8_t) + sealOverhead)
+    return false;
+
+  // full sequence number is the one closest to the highest accepted so far
+  uint32_t seqLow;
+  memcpy(&seqLow, packet->data + sizeof(uint8_t), sizeof(uint32_t));
+  uint64_t highest = session->recvSeq[channel];
+  uint64_t seq = (highest & ~uint64_t(0xffffffff)) | seqLow;
+  if (seq + 0x80000000ull < highest)
+    seq += uint64_t(1) << 32;
+  else if (seq > highest + 0x80000000ull && seq > 0xffffffffull)
+    seq -= uint64_t(1) << 32;
+
+  uint64_t &window = session->recvWindow[channel];
+  if (seq == 0)
+    return false;
+  if (seq <= highest)
+  {
+    uint64_t age = highest - seq;
+    if (age >= 64 || (window >> age) & 1)
+      return false; // replayed or too old to tell
+  }
+
+  size_t bodySize = packet->dataLength - sizeof(uint8_t) - sealOverhead;
+  uint8_t *body = packet->data + sizeof(uint8_t) + sizeof(uint32_t);
+  uint8_t nonce[aeadNonceSize];
+  make_nonce(nonce, channel, seq);
+  if (!aead_open(body, bodySize, packet->data, sizeof(uint8_t), session->recvKey, nonce, body + bodySize))
+    return false;
+
+  // only authentic packets move the replay window
+  if (seq > highest)
+  {
+    uint64_t shift = seq - highest;
+    window = shift >= 64 ? 0 : window << shift;
+    window |= 1;
+    session->recvSeq[channel] = seq;
+  }
+  else
+    window |= uint64_t(1) << (highest - seq);
+
+  memmove(packet->data + sizeof(uint8_t), body, bodySize);
+  packet->dataLength = sizeof(uint8_t) + bodySize;
+  return true;
+}
+
+void send_join(ENetPeer *peer, const CryptoSession &session)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + x25519KeySize, ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = packet->data;
+  *ptr = E_CLIENT_TO_SERVER_JOIN; ptr += sizeof(uint8_t);
+  memcpy(ptr, session.publicKey, x25519KeySize); ptr += x25519KeySize;
+
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
+// Wire encoding of an Entity in 17 bytes, little-endian:
+//   eid         2 bytes
+//   color       4 bytes
+//   x, y        2x2 bytes  11 and 10 bit codes over the field, the same precision as snapshots
+//   ori         1 byte     8 bit code over [-PI, PI]
+//   speed       4 bytes    float
+//   thr, steer  2x1 byte   signed codes, value * 127, so 0 and +-1 are exact
+constexpr size_t entityWireSize = sizeof(uint16_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(uint8_t) +
+                                  sizeof(float) + 2 * sizeof(uint8_t);
+// the same fields as they are in memory, eid, color and six floats
+constexpr size_t entityRawBits = (sizeof(uint16_t) + sizeof(uint32_t) + 6 * sizeof(float)) * 8;
+
+static void store_entity(uint8_t *&ptr, const Entity &ent)
+{
+  store_le<uint16_t>(ptr, ent.eid);
+  store_le<uint32_t>(ptr, ent.color);
+  store_le<uint16_t>(ptr, pack_float<uint16_t>(ent.x, -16.f, 16.f, 11));
+  store_le<uint16_t>(ptr, pack_float<uint16_t>(ent.y, -8.f, 8.f, 10));
+  store_le<uint8_t>(ptr, pack_float<uint8_t>(ent.ori, -PI, PI, 8));
+  store_le<float>(ptr, ent.speed);
+  store_le<int8_t>(ptr, int8_t(roundf(clamp(ent.thr, -1.f, 1.f) * 127.f)));
+  store_le<int8_t>(ptr, int8_t(roundf(clamp(ent.steer, -1.f, 1.f) * 127.f)));
+}
+
 void send_new_entity(ENetPeer *peer, const Entity &ent)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(Entity),
-                                                   ENET_PACKET_FLAG_RELIABLE);
+  ENetPacket *packet = create_packet(sizeof(uint8_t) + entityWireSize,
+                                     ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
+  store_entity(ptr, ent);
 
-  enet_peer_send(peer, 0, packet);
+  send_sealed(peer, 0, packet, 8 + entityRawBits);
 }
 
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t),
-                                                   ENET_PACKET_FLAG_RELIABLE);
+  ENetPacket *packet = create_packet(sizeof(uint8_t) + sizeof(uint16_t),
+                                     ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
 
-  enet_peer_send(peer, 0, packet);
+  send_sealed(peer, 0, packet);
 }
 
-void send_cipher_key(ENetPeer *peer, uint32_t key)
+void send_session_key(ENetPeer *peer, const CryptoSession &session)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint32_t),
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + x25519KeySize,
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_KEY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &key, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  memcpy(ptr, session.publicKey, x25519KeySize); ptr += x25519KeySize;
 
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
-void fuzz_packet_data(ENetPacket *packet)
-{
-  packet->data[rand() % packet->dataLength] = (uint8_t)rand();
-}
-
 void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float ori)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(float) * 2,
-                                                   //sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
+  ENetPacket *packet = create_packet(sizeof(uint8_t) + sizeof(uint16_t) +
+                                     sizeof(float) * 2,
+                                     //sizeof(uint8_t),
+                                     ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
   *ptr = E_CLIENT_TO_SERVER_INPUT; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
@@ -74,19 +228,16 @@ void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float ori)
   memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
   */
 
-  fuzz_packet_data(packet);
-  cipher_data(packet);
-
-  enet_peer_send(peer, 1, packet);
+  send_sealed(peer, 1, packet);
 }
 
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
+  ENetPacket *packet = create_packet(sizeof(uint8_t) + sizeof(uint16_t) +
+                                     sizeof(uint16_t) +
+                                     sizeof(uint16_t) +
+                                     sizeof(uint8_t),
+                                     ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
@@ -98,83 +249,221 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
   memcpy(ptr, &yPacked, sizeof(uint16_t)); ptr += sizeof(uint16_t);
   memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
 
-  enet_peer_send(peer, 1, packet);
+  send_sealed(peer, 1, packet, (sizeof(uint8_t) + sizeof(uint16_t) + 3 * sizeof(float)) * 8);
+}
+
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count)
+{
+  ENetPacket *packet = create_packet(sizeof(uint8_t) + sizeof(uint16_t) + count * sizeof(uint16_t),
+                                     ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = packet->data;
+  *ptr = E_SERVER_TO_CLIENT_DESTROY_ENTITY; ptr += sizeof(uint8_t);
+  memcpy(ptr, &count, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  memcpy(ptr, eids, count * sizeof(uint16_t)); ptr += count * sizeof(uint16_t);
+
+  send_sealed(peer, 0, packet);
+}
+
+// type | entity count (uint16) | uncompressed size (uint32) | LZ4 block of the encoded entities back to back
+constexpr size_t worldStateHeaderSize = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count)
+{
+  uint16_t num = uint16_t(count);
+  uint32_t rawSize = uint32_t(num * entityWireSize);
+  std::vector<uint8_t> raw(rawSize);
+  uint8_t *rawPtr = raw.data();
+  for (uint16_t i = 0; i < num; ++i)
+    store_entity(rawPtr, ents[i]);
+  // allocated for the worst case, trimmed to what the compressor produced
+  ENetPacket *packet = create_packet(worldStateHeaderSize + lz4_compress_bound(rawSize),
+                                     ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = packet->data;
+  *ptr = E_SERVER_TO_CLIENT_WORLD_STATE; ptr += sizeof(uint8_t);
+  store_le<uint16_t>(ptr, num);
+  store_le<uint32_t>(ptr, rawSize);
+  ptr += lz4_compress(raw.data(), rawSize, ptr, lz4_compress_bound(rawSize));
+  packet->dataLength = ptr - packet->data;
+
+  send_sealed(peer, 0, packet, worldStateHeaderSize * 8 + num * entityRawBits);
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0 || *packet->data >= E_MESSAGE_TYPE_COUNT)
+    return E_MESSAGE_TYPE_COUNT;
   return (MessageType)*packet->data;
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+const char *message_type_name(MessageType type)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  ent = *(Entity*)(ptr); ptr += sizeof(Entity);
+  switch (type)
+  {
+  case E_CLIENT_TO_SERVER_JOIN: return "join";
+  case E_SERVER_TO_CLIENT_NEW_ENTITY: return "new_entity";
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: return "set_controlled_entity";
+  case E_CLIENT_TO_SERVER_INPUT: return "input";
+  case E_SERVER_TO_CLIENT_SNAPSHOT: return "snapshot";
+  case E_SERVER_TO_CLIENT_KEY: return "key";
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY: return "destroy_entity";
+  case E_SERVER_TO_CLIENT_WORLD_STATE: return "world_state";
+  case E_MESSAGE_TYPE_COUNT: break;
+  };
+  return "unknown";
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+// Packet payloads have no alignment guarantees, every load goes through memcpy.
+template<typename T>
+static T load(const uint8_t *&ptr)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  T value;
+  memcpy(&value, ptr, sizeof(T));
+  ptr += sizeof(T);
+  return value;
 }
 
-void xor_packet_data(ENetPacket *packet, uint8_t *key_ptr)
+static bool has_size(const ENetPacket *packet, size_t size)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  uint8_t *end = packet->data + packet->dataLength;
-  for (int i = 0; ptr < end; ++ptr, ++i)
-  {
-    i = i % 4;
-    *ptr ^= key_ptr[i];
-  }
+  return packet->dataLength >= size;
 }
 
-void cipher_data(ENetPacket *packet)
+static bool is_valid_control(float v)
 {
-  xor_packet_data(packet, (uint8_t*)&xorCipherKey);
+  return std::isfinite(v) && v >= -1.f && v <= 1.f;
 }
 
-void decipher_data(ENetPacket *packet, ENetPeer *peer)
+// `ptr` must have entityWireSize bytes left.
+static bool load_entity(const uint8_t *&ptr, Entity &ent)
 {
-  xor_packet_data(packet, (uint8_t*)peer->data);
+  Entity e;
+  e.eid = load_le<uint16_t>(ptr);
+  e.color = load_le<uint32_t>(ptr);
+  // quantised fields, masked to their code width they always decode in range
+  e.x = unpack_float<uint16_t>(load_le<uint16_t>(ptr) & 0x7ff, -16.f, 16.f, 11);
+  e.y = unpack_float<uint16_t>(load_le<uint16_t>(ptr) & 0x3ff, -8.f, 8.f, 10);
+  e.ori = unpack_float<uint8_t>(load_le<uint8_t>(ptr), -PI, PI, 8);
+  e.speed = load_le<float>(ptr);
+  // -128 decodes past -1 and is rejected below
+  e.thr = load_le<int8_t>(ptr) / 127.f;
+  e.steer = load_le<int8_t>(ptr) / 127.f;
+  if (e.eid == invalid_entity || !std::isfinite(e.speed) || !is_valid_control(e.thr) || !is_valid_control(e.steer))
+    return false;
+  ent = e;
+  return true;
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  if (!has_size(packet, sizeof(uint8_t) + entityWireSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  return load_entity(ptr, ent);
+}
 
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  thr = *(float*)(ptr); ptr += sizeof(float);
-  steer = *(float*)(ptr); ptr += sizeof(float);
-  //uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  /*
-  uint8_t thrPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  */
-  /*
-  static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, 4);
-  float4bitsQuantized thrPacked(thrSteerPacked >> 4);
-  float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
-  thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
-  steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
-  */
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+{
+  if (!has_size(packet, sizeof(uint8_t) + sizeof(uint16_t)))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  if (id == invalid_entity)
+    return false;
+  eid = id;
+  return true;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
+bool deserialize_join(ENetPacket *packet, uint8_t (&public_key)[x25519KeySize])
 {
+  if (packet->dataLength < sizeof(uint8_t) + x25519KeySize)
+    return false;
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t xPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t yPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
+  memcpy(public_key, ptr, x25519KeySize); ptr += x25519KeySize;
+  return true;
+}
+
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+{
+  if (!has_size(packet, sizeof(uint8_t) + sizeof(uint16_t) + sizeof(float) * 2))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  float t = load<float>(ptr);
+  float s = load<float>(ptr);
+  // NaN would stick in the simulation forever, larger values are a speed hack
+  if (id == invalid_entity || !is_valid_control(t) || !is_valid_control(s))
+    return false;
+  eid = id;
+  thr = t;
+  steer = s;
+  return true;
+}
+
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
+{
+  if (!has_size(packet, sizeof(uint8_t) + sizeof(uint16_t) * 3 + sizeof(uint8_t)))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  if (id == invalid_entity)
+    return false;
+  // quantised fields, masked to their code width they always decode in range
+  uint16_t xPacked = load<uint16_t>(ptr) & 0x7ff;
+  uint16_t yPacked = load<uint16_t>(ptr) & 0x3ff;
+  uint8_t oriPacked = load<uint8_t>(ptr);
+  eid = id;
   x = unpack_float<uint16_t>(xPacked, -16.f, 16.f, 11);
   y = unpack_float<uint16_t>(yPacked, -8.f, 8.f, 10);
   ori = unpack_float<uint8_t>(oriPacked, -PI, PI, 8);
+  return true;
 }
 
-void deserialize_and_set_key(ENetPacket *packet)
+bool deserialize_session_key(ENetPacket *packet, uint8_t (&public_key)[x25519KeySize])
 {
+  if (packet->dataLength < sizeof(uint8_t) + x25519KeySize)
+    return false;
   uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  xorCipherKey = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  memcpy(public_key, ptr, x25519KeySize); ptr += x25519KeySize;
+  return true;
+}
+
+bool deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids)
+{
+  constexpr size_t headerSize = sizeof(uint8_t) + sizeof(uint16_t);
+  if (!has_size(packet, headerSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t num = load<uint16_t>(ptr);
+  if (num == 0 || !has_size(packet, headerSize + num * sizeof(uint16_t)))
+    return false;
+  std::vector<uint16_t> decoded(num);
+  for (uint16_t i = 0; i < num; ++i)
+  {
+    decoded[i] = load<uint16_t>(ptr);
+    if (decoded[i] == invalid_entity)
+      return false;
+  }
+  eids.swap(decoded);
+  return true;
 }
 
+bool deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents)
+{
+  if (!has_size(packet, worldStateHeaderSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t num = load_le<uint16_t>(ptr);
+  uint32_t rawSize = load_le<uint32_t>(ptr);
+  // the size follows from the count, so a forged header cannot ask for more than a few MB
+  if (rawSize != num * entityWireSize)
+    return false;
+  std::vector<uint8_t> raw(rawSize);
+  if (!lz4_decompress(ptr, packet->dataLength - worldStateHeaderSize, raw.data(), rawSize))
+    return false;
+  std::vector<Entity> decoded(num);
+  const uint8_t *rawPtr = raw.data();
+  for (Entity &e : decoded)
+    if (!load_entity(rawPtr, e))
+      return false;
+  ents.swap(decoded);
+  return true;
+}
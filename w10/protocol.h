@@ -1,7 +1,9 @@
 #pragma once
 #include <enet/enet.h>
 #include <cstdint>
+#include <vector>
 #include "entity.h"
+#include "crypto.h"
 
 enum MessageType : uint8_t
 {
@@ -10,24 +12,70 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
   E_CLIENT_TO_SERVER_INPUT,
   E_SERVER_TO_CLIENT_SNAPSHOT,
-  E_SERVER_TO_CLIENT_KEY
+  E_SERVER_TO_CLIENT_KEY,
+  E_SERVER_TO_CLIENT_DESTROY_ENTITY,
+  E_SERVER_TO_CLIENT_WORLD_STATE,
+  E_MESSAGE_TYPE_COUNT // also returned for empty and unknown packets
 };
 
-void send_join(ENetPeer *peer);
+// Per-peer packet protection, `peer->data` points to it on both sides.
+// The client sends its X25519 public key with E_CLIENT_TO_SERVER_JOIN, the server
+// answers with its own in E_SERVER_TO_CLIENT_KEY and both derive one
+// ChaCha20-Poly1305 key per direction. Every other message is sealed as
+//   type | low 32 bits of seq | ciphertext | tag (16 bytes)
+// with the type byte authenticated in clear and the nonce built from the channel
+// and the 64-bit per-channel sequence number, so no nonce is ever reused.
+// Keys are ephemeral and not signed: this stops eavesdropping, tampering and
+// replays, not an active man in the middle during the handshake.
+constexpr size_t cryptoChannels = 2;
+constexpr size_t sealOverhead = sizeof(uint32_t) + aeadTagSize;
+
+struct CryptoSession
+{
+  uint8_t secretKey[x25519KeySize];
+  uint8_t publicKey[x25519KeySize];
+  uint8_t sendKey[aeadKeySize];
+  uint8_t recvKey[aeadKeySize];
+  uint64_t sendSeq[cryptoChannels] = {};
+  uint64_t recvSeq[cryptoChannels] = {};    // highest accepted sequence number
+  uint64_t recvWindow[cryptoChannels] = {}; // bit i set: recvSeq - i was accepted
+  bool established = false;
+};
+
+// Drops any previous keys and generates a fresh ephemeral key pair.
+void start_crypto_session(CryptoSession &session);
+// Derives the traffic keys from the other side's public key, false for a degenerate key.
+bool establish_crypto_session(CryptoSession &session, const uint8_t peer_public_key[x25519KeySize], bool is_server);
+
+void send_join(ENetPeer *peer, const CryptoSession &session);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_cipher_key(ENetPeer *peer, uint32_t key);
+void send_session_key(ENetPeer *peer, const CryptoSession &session);
 void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori);
+// Entities that left the game, all of a tick's removals go in one message.
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count);
+// Every entity a joining client needs, LZ4 compressed into one reliable message
+// that ENet fragments as needed. At most 65535 entities.
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count);
 
 MessageType get_packet_type(ENetPacket *packet);
+// Short name for stats, "unknown" for E_MESSAGE_TYPE_COUNT.
+const char *message_type_name(MessageType type);
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
-void deserialize_and_set_key(ENetPacket *packet);
+// Every decoder checks the packet length once up front and returns false for
+// truncated packets, non-finite or out-of-range values and invalid eids,
+// leaving the outputs untouched. Sealed packets must be opened first.
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent);
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
+bool deserialize_join(ENetPacket *packet, uint8_t (&public_key)[x25519KeySize]);
+bool deserialize_session_key(ENetPacket *packet, uint8_t (&public_key)[x25519KeySize]);
+bool deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids);
+bool deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents);
 
-void cipher_data(ENetPacket *packet);
-void decipher_data(ENetPacket *packet, ENetPeer *peer);
+// Authenticates and decrypts a sealed packet in place, leaving the usual
+// type | payload layout. Returns false for forged, corrupted or replayed packets.
+bool open_packet(ENetPeer *peer, uint8_t channel, ENetPacket *packet);
 
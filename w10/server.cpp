@@ -2,26 +2,59 @@
 #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
 #include "mathUtils.h"
+#include "idAllocator.h"
+#include "peerEntities.h"
+#include "entityTable.h"
 #include <stdlib.h>
 #include <vector>
-#include <map>
-#include <random>
 
-static std::vector<Entity> entities;
-static std::map<uint16_t, ENetPeer*> controlledMap;
+static EntityTable<Entity> entities;
+static IdAllocator entityIds;
+static std::vector<CryptoSession> sessions; // one per ENet peer slot
+
+// ship of every peer slot, see peerEntities.h
+static PeerEntities peerEntities(entityIds); // indexed like host->peers
+
+static std::vector<const char*> message_type_names()
+{
+  std::vector<const char*> names;
+  for (int type = 0; type <= E_MESSAGE_TYPE_COUNT; ++type)
+    names.push_back(message_type_name(MessageType(type)));
+  return names;
+}
+
+// Process wide message counts of the protocol layer, printed every so often
+constexpr uint32_t messageStatsIntervalMs = 10000;
+static const std::vector<const char*> messageTypeNames = message_type_names();
 
 void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
-  // send all entities
-  for (const Entity &ent : entities)
-    send_new_entity(peer, ent);
-
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
+  CryptoSession *session = (CryptoSession*)peer->data;
+  uint8_t clientKey[x25519KeySize];
+  if (!session || session->established || !deserialize_join(packet, clientKey))
+    return;
+  // a peer controls one ship at most
+  if (peerEntities.get(peer - host->peers) != invalid_entity)
+    return;
+  uint16_t newEid = entityIds.allocate();
+  if (newEid == invalid_entity)
+    return; // every eid is taken
+  start_crypto_session(*session);
+  if (!establish_crypto_session(*session, clientKey, true))
+  {
+    entityIds.free(newEid); // nobody saw it yet, a client retrying must not use up the ids
+    enet_peer_disconnect(peer, 0);
+    return;
+  }
+  // in clear, goes out first on the reliable channel so the client has the keys for everything after it
+  send_session_key(peer, *session);
+
+  // send all entities in one message
+  if (!entities.empty())
+    send_world_state(peer, entities.data(), entities.size());
+
   uint32_t color = 0xff000000 +
                    0x00440000 * (rand() % 5) +
                    0x00004400 * (rand() % 5) +
@@ -29,9 +62,9 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
   float x = (rand() % 4) * 2.f;
   float y = (rand() % 4) * 2.f;
   Entity ent = {color, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, newEid};
-  entities.push_back(ent);
+  entities.add(ent);
 
-  controlledMap[newEid] = peer;
+  peerEntities.set(peer - host->peers, newEid);
 
 
   // send info about new entity to everyone
@@ -39,25 +72,40 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
     send_new_entity(&host->peers[i], ent);
   // send info about controlled entity
   send_set_controlled_entity(peer, newEid);
-  uint32_t *keyPtr = (uint32_t*)peer->data;
-  std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-  std::uniform_int_distribution<uint32_t> distrib(0);
-  *keyPtr = distrib(gen);
-  send_cipher_key(peer, *keyPtr);
 }
 
-void on_input(ENetPacket *packet)
+void on_input(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
   uint16_t eid = invalid_entity;
   float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
-  for (Entity &e : entities)
-    if (e.eid == eid)
-    {
-      e.thr = thr;
-      e.steer = steer;
-    }
+  if (!deserialize_entity_input(packet, eid, thr, steer))
+    return;
+  // a client may only steer its own ship
+  if (eid == invalid_entity || eid != peerEntities.get(peer - host->peers))
+    return;
+  if (Entity *e = entities.find(eid))
+  {
+    e->thr = thr;
+    e->steer = steer;
+  }
+}
+
+static void despawn_peer_entity(size_t peer_idx)
+{
+  uint16_t eid = peerEntities.despawn(peer_idx);
+  if (eid == invalid_entity)
+    return;
+  entities.remove(eid);
+}
+
+static void send_despawns(ENetHost *server)
+{
+  const std::vector<uint16_t> &despawnedEids = peerEntities.despawned();
+  if (despawnedEids.empty())
+    return;
+  for (size_t i = 0; i < server->peerCount; ++i)
+    send_destroy_entities(&server->peers[i], despawnedEids.data(), uint16_t(despawnedEids.size()));
+  peerEntities.free_despawned();
 }
 
 int main(int argc, const char **argv)
@@ -79,8 +127,11 @@ int main(int argc, const char **argv)
     printf("Cannot create ENet server\n");
     return 1;
   }
+  sessions.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
 
   uint32_t lastTime = enet_time_get();
+  uint32_t lastMessageStatsTime = lastTime;
   while (true)
   {
     uint32_t curTime = enet_time_get();
@@ -93,22 +144,25 @@ int main(int argc, const char **argv)
       {
       case ENET_EVENT_TYPE_CONNECT:
         printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        event.peer->data = new uint32_t;
-        *(uint32_t*)event.peer->data = 0;
+        sessions[event.peer - server->peers] = CryptoSession();
+        event.peer->data = &sessions[event.peer - server->peers];
         break;
       case ENET_EVENT_TYPE_DISCONNECT:
         printf("Disconnected %x:%u \n", event.peer->address.host, event.peer->address.port);
-        delete event.peer->data;
+        despawn_peer_entity(event.peer - server->peers);
+        sessions[event.peer - server->peers] = CryptoSession();
+        event.peer->data = nullptr;
         break;
       case ENET_EVENT_TYPE_RECEIVE:
+        message_stats_received(event.packet);
         switch (get_packet_type(event.packet))
         {
           case E_CLIENT_TO_SERVER_JOIN:
             on_join(event.packet, event.peer, server);
             break;
           case E_CLIENT_TO_SERVER_INPUT:
-            decipher_data(event.packet, event.peer);
-            on_input(event.packet);
+            if (open_packet(event.peer, event.channelID, event.packet))
+              on_input(event.packet, event.peer, server);
             break;
         };
         enet_packet_destroy(event.packet);
@@ -117,6 +171,7 @@ int main(int argc, const char **argv)
         break;
       };
     }
+    send_despawns(server);
     static int t = 0;
     for (Entity &e : entities)
     {
@@ -127,10 +182,15 @@ int main(int argc, const char **argv)
       {
         ENetPeer *peer = &server->peers[i];
         // skip this here in this implementation
-        //if (controlledMap[e.eid] != peer)
+        //if (peerEntities.get(i) != e.eid)
         send_snapshot(peer, e.eid, e.x, e.y, e.ori);
       }
     }
+    if (curTime - lastMessageStatsTime >= messageStatsIntervalMs)
+    {
+      print_message_stats(stdout, messageTypeNames);
+      lastMessageStatsTime = curTime;
+    }
     usleep(10000);
   }
 
@@ -119,6 +119,11 @@ void BitStream::Read(std::string& value)
 {
     uint32_t length;
     Read<uint32_t>(length);
+    // check before allocating, a corrupted length must not turn into a 4 GB string
+    if (m_ReadPose / 8 + length > buffer.size())
+    {
+        throw std::out_of_range("Attempting to read beyond buffer");
+    }
     if (length > 0)
     {
         value.resize(length);
@@ -143,6 +148,10 @@ std::vector<bool> BitStream::ReadBoolArray()
 {
     uint32_t size;
     Read<uint32_t>(size);
+    if (m_ReadPose + size > buffer.size() * 8)
+    {
+        throw std::out_of_range("Attempting to read beyond buffer");
+    }
     std::vector<bool> bools(size);
     for (uint32_t i = 0; i < size; ++i)
     {
@@ -8,10 +8,11 @@
 #include "raylib.h"
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
+#include "entityTable.h"
 
 
-static std::vector<Entity> entities;
-static std::unordered_map<uint16_t, size_t> indexMap;
+static EntityTable<Entity> entities;
 static uint16_t my_entity = invalid_entity;
 
 static int game_time_remaining = 60;
@@ -23,11 +24,15 @@ void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
   deserialize_new_entity(packet, newEntity);
-  auto itf = indexMap.find(newEntity.eid);
-  if (itf != indexMap.end())
-    return; // ничего не делаем если есть entity
-  indexMap[newEntity.eid] = entities.size();
-  entities.push_back(newEntity);
+  entities.add(newEntity); // ничего не делаем если есть entity
+}
+
+void on_world_state(ENetPacket *packet)
+{
+  std::vector<Entity> ents;
+  deserialize_world_state(packet, ents);
+  for (const Entity &ent : ents)
+    entities.add(ent);
 }
 
 void on_set_controlled_entity(ENetPacket *packet)
@@ -38,9 +43,8 @@ void on_set_controlled_entity(ENetPacket *packet)
 template<typename Callable>
 static void get_entity(uint16_t eid, Callable c)
 {
-  auto itf = indexMap.find(eid);
-  if (itf != indexMap.end())
-    c(entities[itf->second]);
+  if (Entity *e = entities.find(eid))
+    c(*e);
 }
 
 void on_snapshot(ENetPacket *packet)
@@ -100,6 +104,14 @@ void on_game_time(ENetPacket *packet)
   game_time_remaining = seconds_remaining;
 }
 
+void on_destroy_entities(ENetPacket *packet)
+{
+  std::vector<uint16_t> eids;
+  deserialize_destroy_entities(packet, eids);
+  for (uint16_t eid : eids)
+    entities.remove(eid);
+}
+
 void on_game_over(ENetPacket *packet)
 {
   uint16_t w_eid = invalid_entity;
@@ -182,6 +194,7 @@ int main()
         connected = true;
         break;
       case ENET_EVENT_TYPE_RECEIVE:
+        message_stats_received(event.packet);
         switch (get_packet_type(event.packet))
         {
         case E_SERVER_TO_CLIENT_NEW_ENTITY:
@@ -207,6 +220,12 @@ int main()
         case E_SERVER_TO_CLIENT_GAME_OVER:
           on_game_over(event.packet);
           break;
+        case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+          on_destroy_entities(event.packet);
+          break;
+        case E_SERVER_TO_CLIENT_WORLD_STATE:
+          on_world_state(event.packet);
+          break;
         };
         break;
       default:
@@ -266,7 +285,7 @@ int main()
       DrawRectangle(width - 200, 10, 190, 210, Color{0, 0, 0, 150});
       DrawText("LEADERBOARD", width - 190, 15, 20, YELLOW);
       
-      std::vector<Entity> sortedEntities = entities;
+      std::vector<Entity> sortedEntities(entities.begin(), entities.end());
       std::sort(sortedEntities.begin(), sortedEntities.end(), compareEntityScores);
       
       int maxToShow = std::min(8, (int)sortedEntities.size());
@@ -1,5 +1,7 @@
 #include "protocol.h"
 #include "bitstream.h"
+#include "lz4Block.h"
+#include "messageStats.h"
 #include <cstring>
 #include <unordered_map>
 
@@ -9,14 +11,13 @@ void send_join(ENetPeer *peer)
   bs.Write<uint8_t>(E_CLIENT_TO_SERVER_JOIN);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
-void send_new_entity(ENetPeer *peer, const Entity &ent)
+// Entity fields as they go in new entity and world state messages.
+static void write_entity(BitStream &bs, const Entity &ent)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_NEW_ENTITY);
-  
   bs.Write<uint32_t>(ent.color);
   bs.Write<float>(ent.x);
   bs.Write<float>(ent.y);
@@ -26,8 +27,36 @@ void send_new_entity(ENetPeer *peer, const Entity &ent)
   bs.Write<float>(ent.targetY);
   bs.Write<float>(ent.size);
   bs.Write<int>(ent.score);
+}
+
+static void read_entity(BitStream &bs, Entity &ent)
+{
+  bs.Read<uint32_t>(ent.color);
+  bs.Read<float>(ent.x);
+  bs.Read<float>(ent.y);
+  bs.Read<uint16_t>(ent.eid);
+  // read as a byte, loading anything but 0 or 1 into a bool is undefined
+  uint8_t serverControlled = 0;
+  bs.Read<uint8_t>(serverControlled);
+  ent.serverControlled = serverControlled != 0;
+  bs.Read<float>(ent.targetX);
+  bs.Read<float>(ent.targetY);
+  bs.Read<float>(ent.size);
+  bs.Read<int>(ent.score);
+}
+
+// bytes write_entity produces
+constexpr size_t ENTITY_WIRE_SIZE = sizeof(uint32_t) + 2 * sizeof(float) + sizeof(uint16_t) + sizeof(uint8_t) +
+                                    3 * sizeof(float) + sizeof(int);
+
+void send_new_entity(ENetPeer *peer, const Entity &ent)
+{
+  BitStream bs;
+  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_NEW_ENTITY);
+  write_entity(bs, ent);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -38,6 +67,7 @@ void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
   bs.Write<uint16_t>(eid);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -51,6 +81,7 @@ void send_entity_state(ENetPeer *peer, uint16_t eid, float x, float y)
   bs.Write<float>(y);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
+  message_stats_sent(packet);
   enet_peer_send(peer, 1, packet);
 }
 
@@ -65,29 +96,43 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float size)
   bs.Write<float>(size); 
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
+  message_stats_sent(packet);
   enet_peer_send(peer, 1, packet);
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0 || *packet->data >= E_MESSAGE_TYPE_COUNT)
+    return E_MESSAGE_TYPE_COUNT;
   return (MessageType)*packet->data;
 }
 
+const char *message_type_name(MessageType type)
+{
+  switch (type)
+  {
+  case E_CLIENT_TO_SERVER_JOIN: return "join";
+  case E_SERVER_TO_CLIENT_NEW_ENTITY: return "new_entity";
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: return "set_controlled_entity";
+  case E_CLIENT_TO_SERVER_STATE: return "state";
+  case E_SERVER_TO_CLIENT_SNAPSHOT: return "snapshot";
+  case E_SERVER_TO_CLIENT_ENTITY_DEVOURED: return "entity_devoured";
+  case E_SERVER_TO_CLIENT_SCORE_UPDATE: return "score_update";
+  case E_SERVER_TO_CLIENT_GAME_TIME: return "game_time";
+  case E_SERVER_TO_CLIENT_GAME_OVER: return "game_over";
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY: return "destroy_entity";
+  case E_SERVER_TO_CLIENT_WORLD_STATE: return "world_state";
+  case E_MESSAGE_TYPE_COUNT: break;
+  };
+  return "unknown";
+}
+
 void deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
   BitStream bs(packet->data, packet->dataLength);
   uint8_t type;
-  bs.Read<uint8_t>(type); 
-  
-  bs.Read<uint32_t>(ent.color);
-  bs.Read<float>(ent.x);
-  bs.Read<float>(ent.y);
-  bs.Read<uint16_t>(ent.eid);
-  bs.Read<bool>(ent.serverControlled);
-  bs.Read<float>(ent.targetX);
-  bs.Read<float>(ent.targetY);
-  bs.Read<float>(ent.size);
-  bs.Read<int>(ent.score);
+  bs.Read<uint8_t>(type);
+  read_entity(bs, ent);
 }
 
 void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
@@ -130,6 +175,7 @@ void send_entity_devoured(ENetPeer *peer, uint16_t devoured_eid, uint16_t devour
   bs.Write<float>(new_y);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -153,6 +199,7 @@ void send_score_update(ENetPeer *peer, uint16_t eid, int score)
   bs.Write<int>(score);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -172,6 +219,43 @@ void send_game_time(ENetPeer *peer, int seconds_remaining)
   bs.Write<int>(seconds_remaining);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
+  enet_peer_send(peer, 0, packet);
+}
+
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count)
+{
+  BitStream bs;
+  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_DESTROY_ENTITY);
+  bs.Write<uint16_t>(count);
+  for (uint16_t i = 0; i < count; ++i)
+    bs.Write<uint16_t>(eids[i]);
+
+  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
+  enet_peer_send(peer, 0, packet);
+}
+
+// type | entity count (uint16) | uncompressed size (uint32) | LZ4 block of the serialized entities
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count)
+{
+  uint16_t num = uint16_t(count);
+  BitStream entities;
+  for (uint16_t i = 0; i < num; ++i)
+    write_entity(entities, ents[i]);
+  uint32_t rawSize = uint32_t(entities.GetSizeBytes());
+  std::vector<uint8_t> compressed(lz4_compress_bound(rawSize));
+  compressed.resize(lz4_compress(entities.GetData(), rawSize, compressed.data(), compressed.size()));
+
+  BitStream bs;
+  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_WORLD_STATE);
+  bs.Write<uint16_t>(num);
+  bs.Write<uint32_t>(rawSize);
+  bs.WriteBytes(compressed.data(), compressed.size());
+
+  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  // the entity block as it was before compression
+  message_stats_sent(packet, (packet->dataLength - compressed.size() + rawSize) * 8);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -183,6 +267,7 @@ void send_game_over(ENetPeer *peer, uint16_t winner_eid, int winner_score)
   bs.Write<int>(winner_score);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
@@ -201,4 +286,44 @@ void deserialize_game_time(ENetPacket *packet, int &seconds_remaining)
   uint8_t type;
   bs.Read<uint8_t>(type);
   bs.Read<int>(seconds_remaining);
-}
\ No newline at end of file
+}
+
+void deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids)
+{
+  BitStream bs(packet->data, packet->dataLength);
+  uint8_t type;
+  bs.Read<uint8_t>(type);
+  uint16_t count = 0;
+  bs.Read<uint16_t>(count);
+  // read one by one, a forged count runs out of data before it allocates much
+  eids.clear();
+  for (uint16_t i = 0; i < count; ++i)
+  {
+    uint16_t eid = invalid_entity;
+    bs.Read<uint16_t>(eid);
+    eids.push_back(eid);
+  }
+}
+
+void deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents)
+{
+  constexpr size_t headerSize = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+  BitStream bs(packet->data, packet->dataLength);
+  uint8_t type;
+  bs.Read<uint8_t>(type);
+  uint16_t count = 0;
+  bs.Read<uint16_t>(count);
+  uint32_t rawSize = 0;
+  bs.Read<uint32_t>(rawSize);
+  ents.clear();
+  // the size follows from the count, so a forged header cannot ask for more than a few MB
+  if (rawSize != count * ENTITY_WIRE_SIZE)
+    return;
+  std::vector<uint8_t> raw(rawSize);
+  if (!lz4_decompress(packet->data + headerSize, packet->dataLength - headerSize, raw.data(), rawSize))
+    return;
+  BitStream entities(raw.data(), raw.size());
+  ents.resize(count);
+  for (Entity &ent : ents)
+    read_entity(entities, ent);
+}
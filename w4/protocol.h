@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 #include <enet/enet.h>
 #include "entity.h"
 
@@ -13,7 +14,10 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_ENTITY_DEVOURED,
   E_SERVER_TO_CLIENT_SCORE_UPDATE,
   E_SERVER_TO_CLIENT_GAME_TIME,
-  E_SERVER_TO_CLIENT_GAME_OVER
+  E_SERVER_TO_CLIENT_GAME_OVER,
+  E_SERVER_TO_CLIENT_DESTROY_ENTITY,
+  E_SERVER_TO_CLIENT_WORLD_STATE,
+  E_MESSAGE_TYPE_COUNT // also returned for empty and unknown packets
 };
 
 void send_join(ENetPeer *peer);
@@ -26,8 +30,15 @@ void send_entity_devoured(ENetPeer *peer, uint16_t devoured_eid, uint16_t devour
 void send_score_update(ENetPeer *peer, uint16_t eid, int score);
 void send_game_over(ENetPeer *peer, uint16_t winner_eid, int winner_score);
 void send_game_time(ENetPeer *peer, int seconds_remaining);
+// Entities that left the game, all of a tick's removals go in one message.
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count);
+// Every entity a joining client needs, LZ4 compressed into one reliable message
+// that ENet fragments as needed. At most 65535 entities.
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count);
 
 MessageType get_packet_type(ENetPacket *packet);
+// Short name for stats, "unknown" for E_MESSAGE_TYPE_COUNT.
+const char *message_type_name(MessageType type);
 
 void deserialize_new_entity(ENetPacket *packet, Entity &ent);
 void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
@@ -37,4 +48,7 @@ void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y,
 void deserialize_score_update(ENetPacket *packet, uint16_t &eid, int &score);
 void deserialize_entity_devoured(ENetPacket *packet, uint16_t &devoured_eid, uint16_t &devourer_eid, float &new_size, float &new_x, float &new_y);
 void deserialize_game_over(ENetPacket *packet, uint16_t &winner_eid, int &winner_score);
-void deserialize_game_time(ENetPacket *packet, int &seconds_remaining);
\ No newline at end of file
+void deserialize_game_time(ENetPacket *packet, int &seconds_remaining);
+void deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids);
+// Leaves `ents` empty if the entity block does not decompress.
+void deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents);
\ No newline at end of file
@@ -2,6 +2,13 @@
 // #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
+#include "worldHistory.h"
+#include "idAllocator.h"
+#include "peerEntities.h"
+#include "entityTable.h"
+#include "serverBench.h"
+#include "tickProfiler.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
@@ -9,17 +16,62 @@
 #include <cmath>
 #include <algorithm> // For std::min
 
-static std::vector<Entity> entities;
+static EntityTable<Entity> entities;
+static IdAllocator entityIds;
 static std::map<uint16_t, ENetPeer*> controlledMap;
 
+constexpr size_t MAX_CLIENTS = 32;
+constexpr int numAi = 10;
+
+// lag compensation: positions are kept for the longest round trip we support,
+// for every entity the server can have, one per client plus the AI
+constexpr uint32_t HISTORY_TICK_MS = 10;
+constexpr uint32_t MAX_RTT_MS = 500;
+constexpr size_t MAX_HISTORY_ENTITIES = MAX_CLIENTS + numAi;
+constexpr size_t HISTORY_BUDGET_BYTES = 256 * 1024;
+static WorldHistory worldHistory(MAX_HISTORY_ENTITIES, HISTORY_TICK_MS, MAX_RTT_MS, HISTORY_BUDGET_BYTES);
+
+// entity of every peer slot, despawned when the peer disconnects
+static PeerEntities peerEntities(entityIds); // indexed like host->peers
+
+static std::vector<const char*> message_type_names()
+{
+  std::vector<const char*> names;
+  for (int type = 0; type <= E_MESSAGE_TYPE_COUNT; ++type)
+    names.push_back(message_type_name(MessageType(type)));
+  return names;
+}
+
+// Process wide message counts of the protocol layer, printed every so often
+constexpr uint32_t MESSAGE_STATS_INTERVAL_MS = 10000;
+static const std::vector<const char*> messageTypeNames = message_type_names();
+
+// Position of `target` as the client controlling `viewer` saw it when it sent its own state.
+// Server controlled viewers see the present.
+static void get_seen_position(const Entity &viewer, const Entity &target, size_t targetIdx, uint32_t curTime, float &x, float &y)
+{
+  x = target.x;
+  y = target.y;
+  auto itf = controlledMap.find(viewer.eid);
+  if (itf == controlledMap.end() || !itf->second)
+    return;
+  WorldHistory::Frame frame;
+  uint32_t seenTime = curTime - itf->second->roundTripTime / 2;
+  if (worldHistory.rewind_to(worldHistory.tick_at(seenTime), frame))
+    frame.find(target.eid, targetIdx, x, y);
+}
+
 float random_spawn(const float _max_size = 10.f)
 {
   return (rand() % 100 - 50) * _max_size;
 }
 
+// Returns invalid_entity when every eid is taken, the new entity is entities.back().
 static uint16_t create_random_entity()
 {
-  uint16_t newEid = entities.size();
+  uint16_t newEid = entityIds.allocate();
+  if (newEid == invalid_entity)
+    return invalid_entity;
   uint32_t color = 0xff000000 +
                    0x00440000 * (1 + rand() % 4) +
                    0x00004400 * (1 + rand() % 4) +
@@ -39,21 +91,26 @@ static uint16_t create_random_entity()
   ent.size = size;
   ent.score = 0;
   
-  entities.push_back(ent);
+  entities.add(ent);
   return newEid;
 }
 
 void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
-  // send all entities
-  for (const Entity &ent : entities)
-    send_new_entity(peer, ent);
+  // a peer controls one entity at most
+  if (peerEntities.get(peer - host->peers) != invalid_entity)
+    return;
+  // send all entities in one message
+  if (!entities.empty())
+    send_world_state(peer, entities.data(), entities.size());
 
-  // find max eid
   uint16_t newEid = create_random_entity();
-  const Entity& ent = entities[newEid];
+  if (newEid == invalid_entity)
+    return;
+  const Entity& ent = entities.back();
 
   controlledMap[newEid] = peer;
+  peerEntities.set(peer - host->peers, newEid);
 
 
   // send info about new entity to everyone
@@ -63,49 +120,390 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
   send_set_controlled_entity(peer, newEid);
 }
 
-void on_state(ENetPacket *packet)
+void on_state(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f;
   deserialize_entity_state(packet, eid, x, y);
+  // a client may only move its own entity
+  if (eid == invalid_entity || eid != peerEntities.get(peer - host->peers))
+    return;
+  if (Entity *e = entities.find(eid))
+  {
+    e->x = x;
+    e->y = y;
+  }
+}
+
+static bool created_ai_entities = false;
+static uint32_t lastHistoryTick = 0;
+// off in --bench mode, printing would dominate the timings
+static bool logEvents = true;
+
+static void create_ai_entities(size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint16_t eid = create_random_entity();
+    if (eid == invalid_entity)
+      break;
+    entities.back().serverControlled = true;
+    entities.back().score = 0;
+    controlledMap[eid] = nullptr;
+  }
+  created_ai_entities = true;
+}
+
+static void despawn_peer_entity(size_t peer_idx)
+{
+  uint16_t eid = peerEntities.despawn(peer_idx);
+  if (eid == invalid_entity)
+    return;
+  entities.remove(eid);
+  controlledMap.erase(eid);
+}
+
+static void send_despawns(ENetHost *server)
+{
+  const std::vector<uint16_t> &despawnedEids = peerEntities.despawned();
+  if (despawnedEids.empty())
+    return;
+  for (size_t i = 0; i < server->peerCount; ++i)
+    send_destroy_entities(&server->peers[i], despawnedEids.data(), uint16_t(despawnedEids.size()));
+  peerEntities.free_despawned();
+}
+
+static void update_net(ENetHost *server)
+{
+  ENetEvent event;
+  while (enet_host_service(server, &event, 0) > 0)
+  {
+    switch (event.type)
+    {
+    case ENET_EVENT_TYPE_CONNECT:
+      if (logEvents)
+        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+      
+      if (!created_ai_entities) {
+        printf("Creating AI entities for first client\n");
+        create_ai_entities(numAi);
+      }
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      if (logEvents)
+        printf("Disconnected %x:%u\n", event.peer->address.host, event.peer->address.port);
+      despawn_peer_entity(event.peer - server->peers);
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+      message_stats_received(event.packet);
+      switch (get_packet_type(event.packet))
+      {
+        case E_CLIENT_TO_SERVER_JOIN:
+          on_join(event.packet, event.peer, server);
+          break;
+        case E_CLIENT_TO_SERVER_STATE:
+          on_state(event.packet, event.peer, server);
+          break;
+        case E_SERVER_TO_CLIENT_NEW_ENTITY:
+        case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:  
+        case E_SERVER_TO_CLIENT_SNAPSHOT:
+        case E_SERVER_TO_CLIENT_ENTITY_DEVOURED:
+        case E_SERVER_TO_CLIENT_SCORE_UPDATE:
+        case E_SERVER_TO_CLIENT_GAME_TIME:
+        case E_SERVER_TO_CLIENT_GAME_OVER:
+        case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+        case E_SERVER_TO_CLIENT_WORLD_STATE:
+          printf("Warning: Received server-to-client message on server\n");
+          break;
+        default:
+          break;
+      };
+      enet_packet_destroy(event.packet);
+      break;
+    default:
+      break;
+    };
+  }
+  send_despawns(server);
+}
+
+static void update_ai(float dt)
+{
   for (Entity &e : entities)
-    if (e.eid == eid)
+  {
+    if (e.serverControlled)
+    {
+      const float diffX = e.targetX - e.x;
+      const float diffY = e.targetY - e.y;
+      const float dirX = diffX > 0.f ? 1.f : -1.f;
+      const float dirY = diffY > 0.f ? 1.f : -1.f;
+      constexpr float spd = 50.f;
+      e.x += dirX * spd * dt;
+      e.y += dirY * spd * dt;
+      if (fabsf(diffX) < 10.f && fabsf(diffY) < 10.f)
+      {
+        e.targetX = random_spawn();
+        e.targetY = random_spawn();
+      }
+    }
+  }
+}
+
+static void record_history(uint32_t curTime)
+{
+  uint32_t historyTick = curTime / HISTORY_TICK_MS;
+  if (historyTick != lastHistoryTick)
+  {
+    worldHistory.begin_tick(historyTick, curTime);
+    for (const Entity &e : entities)
+      worldHistory.record(e.eid, e.x, e.y);
+    lastHistoryTick = historyTick;
+  }
+}
+
+// Entities past the history's limit are seen in the present, without lag compensation.
+static void print_history_drops()
+{
+  if (size_t dropped = worldHistory.dropped_records())
+    printf("World history dropped %zu entity records, raise MAX_HISTORY_ENTITIES\n", dropped);
+}
+
+static void resolve_collisions(ENetHost *server, uint32_t curTime)
+{
+  bool collision_occurred = false;
+  for (size_t i = 0; i < entities.size() && !collision_occurred; i++)
+  {
+    for (size_t j = 0; j < entities.size(); j++)
+    {
+      if (i == j) continue;
+      
+      Entity &e1 = entities[i];
+      Entity &e2 = entities[j];
+      
+      if (e1.size <= 0 || e2.size <= 0 || e1.size > 1000 || e2.size > 1000) {
+        continue;
+      }
+      
+      // judge the collision by what the player controlling e1 saw
+      float e2x = e2.x;
+      float e2y = e2.y;
+      get_seen_position(e1, e2, j, curTime, e2x, e2y);
+      float dx = e1.x - e2x;
+      float dy = e1.y - e2y;
+      float distance = sqrt(dx*dx + dy*dy);
+      
+      if (distance < (e1.size + e2.size) && e1.size != e2.size && distance > 0.1f)
+      {
+        if (logEvents)
+          printf("Collision detected between entities %d (size %.1f) and %d (size %.1f)! Distance: %.1f < %.1f\n", 
+                 e1.eid, e1.size, e2.eid, e2.size, distance, (e1.size + e2.size));
+        
+        Entity *devourer = nullptr;
+        Entity *devoured = nullptr;
+        
+        if (e1.size > e2.size)
+        {
+          devourer = &e1;
+          devoured = &e2;
+        }
+        else
+        {
+          devourer = &e2;
+          devoured = &e1;
+        }
+        
+        if (logEvents)
+          printf("Entity %d (size %.1f) devours Entity %d (size %.1f)\n",
+                 devourer->eid, devourer->size, devoured->eid, devoured->size);
+        
+        float size_gain = devoured->size / 2.0f;
+        
+        if (size_gain > 0.0f && size_gain < 50.0f) {
+          const float MAX_SIZE = 100.0f;
+          float newSize = devourer->size + size_gain;
+          devourer->size = std::min(newSize, MAX_SIZE);
+          
+          devoured->size = 5.0f + (rand() % 5); // Random size between 5 and 10
+          
+          if (!devoured->serverControlled) {
+            devoured->score = 0;
+          }
+          
+          if (!devourer->serverControlled)
+          {
+            devourer->score += static_cast<int>(size_gain);
+          }
+          else
+          {
+            devourer->score += static_cast<int>(size_gain);
+          }
+          
+          for (size_t k = 0; k < server->peerCount; ++k)
+          {
+            ENetPeer *peer = &server->peers[k];
+            send_score_update(peer, devourer->eid, devourer->score);
+          }
+          
+          devoured->x = (rand() % 100 - 50) * 10.f;
+          devoured->y = (rand() % 100 - 50) * 10.f;
+          
+          for (size_t k = 0; k < server->peerCount; ++k)
+          {
+            ENetPeer *peer = &server->peers[k];
+            send_entity_devoured(peer, devoured->eid, devourer->eid, 
+                                devourer->size, devoured->x, devoured->y);
+          }
+          
+          collision_occurred = true;
+        } else {
+          printf("Warning: Invalid size gain (%.1f) detected! Skipping this collision.\n", size_gain);
+        }
+        break;
+      }
+    }
+  }
+}
+
+static void send_snapshots(ENetHost *server)
+{
+  for (const Entity &e : entities)
+  {
+    for (size_t i = 0; i < server->peerCount; ++i)
     {
-      e.x = x;
-      e.y = y;
+      ENetPeer *peer = &server->peers[i];
+      if (controlledMap[e.eid] != peer)
+        send_snapshot(peer, e.eid, e.x, e.y, e.size);
     }
+  }
 }
 
-// int main(int argc, const char **argv)
-int main()
+static int run_bench(const ServerBenchConfig &cfg)
+{
+  ENetHost *server = create_loopback_server_host(cfg.numPeers);
+  if (!server)
+  {
+    printf("Cannot create ENet server\n");
+    return 1;
+  }
+  logEvents = false;
+  peerEntities.resize(server->peerCount);
+  worldHistory = WorldHistory(cfg.numPeers + cfg.numEntities, HISTORY_TICK_MS, MAX_RTT_MS, HISTORY_BUDGET_BYTES);
+  create_ai_entities(cfg.numEntities);
+
+  {
+    LoopbackClients clients(server->address, cfg.numPeers);
+    if (!clients.valid())
+    {
+      printf("Cannot create ENet client host\n");
+      enet_host_destroy(server);
+      return 1;
+    }
+    std::vector<uint16_t> clientEids(clients.size(), invalid_entity);
+    auto on_connect = [](size_t, ENetPeer *peer) { send_join(peer); };
+    auto on_receive = [&](size_t idx, ENetPacket *packet)
+    {
+      if (get_packet_type(packet) == E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY)
+        deserialize_set_controlled_entity(packet, clientEids[idx]);
+    };
+
+    // everyone joins before the measurement starts
+    size_t numJoined = 0;
+    for (uint32_t start = enet_time_get(); numJoined < clients.size() && enet_time_get() - start < 10000;)
+    {
+      update_net(server);
+      clients.update(on_connect, on_receive);
+      numJoined = clients.size() - std::count(clientEids.begin(), clientEids.end(), invalid_entity);
+      usleep(1000);
+    }
+
+    constexpr float benchDt = 1.f / 60.f;
+    TickProfiler profiler({"net receive", "simulate", "collision", "serialize", "send"});
+    for (uint32_t tick = 0; tick < cfg.numTicks; ++tick)
+    {
+      // the clients' side is not part of the tick, every player circles around its spawn point
+      for (size_t i = 0; i < clients.size(); ++i)
+      {
+        if (clientEids[i] == invalid_entity)
+          continue;
+        float a = (tick + i * 10) * benchDt;
+        send_entity_state(clients.peer(i), clientEids[i], 200.f * cosf(a), 200.f * sinf(a));
+      }
+      clients.flush();
+
+      uint32_t curTime = enet_time_get();
+      profiler.begin_tick();
+      {
+        TickProfiler::Scope scope(profiler, 0);
+        update_net(server);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 1);
+        update_ai(benchDt);
+        record_history(curTime);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 2);
+        resolve_collisions(server, curTime);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 3);
+        send_snapshots(server);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 4);
+        enet_host_flush(server);
+      }
+      profiler.end_tick();
+
+      clients.update(on_connect, on_receive);
+    }
+
+    printf("w4 server bench: %zu/%zu peers joined, %zu entities, %u ticks\n",
+           numJoined, clients.size(), entities.size(), cfg.numTicks);
+    profiler.print(stdout);
+    print_message_stats(stdout, messageTypeNames);
+    print_history_drops();
+  }
+
+  enet_host_destroy(server);
+  return 0;
+}
+
+int main(int argc, const char **argv)
 {
   if (enet_initialize() != 0)
   {
     printf("Cannot init ENet");
     return 1;
   }
+
+  ServerBenchConfig benchConfig;
+  if (parse_server_bench_args(argc, argv, benchConfig))
+    return run_bench(benchConfig);
+
   ENetAddress address;
 
   address.host = ENET_HOST_ANY;
   address.port = 10131;
 
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  ENetHost *server = enet_host_create(&address, MAX_CLIENTS, 2, 0, 0);
 
   if (!server)
   {
     printf("Cannot create ENet server\n");
     return 1;
   }
-
-  bool created_ai_entities = false;
-  constexpr int numAi = 10;
+  peerEntities.resize(server->peerCount);
 
   const int GAME_DURATION = 60; // game timer
   int game_time_remaining = GAME_DURATION;
   uint32_t last_time_update = 0;
   bool game_over = false;
 
+  printf("World history: %zu ticks, %zu bytes\n", worldHistory.frame_capacity(), worldHistory.memory_bytes());
+
   uint32_t lastTime = enet_time_get();
+  uint32_t lastMessageStatsTime = lastTime;
   while (true)
   {
     uint32_t curTime = enet_time_get();
@@ -148,165 +546,16 @@ int main()
       }
     }
     
-    ENetEvent event;
-    while (enet_host_service(server, &event, 0) > 0)
-    {
-      switch (event.type)
-      {
-      case ENET_EVENT_TYPE_CONNECT:
-        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        
-        if (!created_ai_entities) {
-          printf("Creating AI entities for first client\n");
-          for (int i = 0; i < numAi; ++i)
-          {
-            uint16_t eid = create_random_entity();
-            entities[eid].serverControlled = true;
-            entities[eid].score = 0;
-            controlledMap[eid] = nullptr;
-          }
-          created_ai_entities = true;
-        }
-        break;
-      case ENET_EVENT_TYPE_RECEIVE:
-        switch (get_packet_type(event.packet))
-        {
-          case E_CLIENT_TO_SERVER_JOIN:
-            on_join(event.packet, event.peer, server);
-            break;
-          case E_CLIENT_TO_SERVER_STATE:
-            on_state(event.packet);
-            break;
-          case E_SERVER_TO_CLIENT_NEW_ENTITY:
-          case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:  
-          case E_SERVER_TO_CLIENT_SNAPSHOT:
-          case E_SERVER_TO_CLIENT_ENTITY_DEVOURED:
-          case E_SERVER_TO_CLIENT_SCORE_UPDATE:
-          case E_SERVER_TO_CLIENT_GAME_TIME:
-          case E_SERVER_TO_CLIENT_GAME_OVER:
-            printf("Warning: Received server-to-client message on server\n");
-            break;
-        };
-        enet_packet_destroy(event.packet);
-        break;
-      default:
-        break;
-      };
-    }
-    for (Entity &e : entities)
-    {
-      if (e.serverControlled)
-      {
-        const float diffX = e.targetX - e.x;
-        const float diffY = e.targetY - e.y;
-        const float dirX = diffX > 0.f ? 1.f : -1.f;
-        const float dirY = diffY > 0.f ? 1.f : -1.f;
-        constexpr float spd = 50.f;
-        e.x += dirX * spd * dt;
-        e.y += dirY * spd * dt;
-        if (fabsf(diffX) < 10.f && fabsf(diffY) < 10.f)
-        {
-          e.targetX = random_spawn();
-          e.targetY = random_spawn();
-        }
-      }
-    }
-    
-    bool collision_occurred = false;
-    for (size_t i = 0; i < entities.size() && !collision_occurred; i++)
+    update_net(server);
+    update_ai(dt);
+    record_history(curTime);
+    resolve_collisions(server, curTime);
+    send_snapshots(server);
+    if (curTime - lastMessageStatsTime >= MESSAGE_STATS_INTERVAL_MS)
     {
-      for (size_t j = 0; j < entities.size(); j++)
-      {
-        if (i == j) continue;
-        
-        Entity &e1 = entities[i];
-        Entity &e2 = entities[j];
-        
-        if (e1.size <= 0 || e2.size <= 0 || e1.size > 1000 || e2.size > 1000) {
-          continue;
-        }
-        
-        float dx = e1.x - e2.x;
-        float dy = e1.y - e2.y;
-        float distance = sqrt(dx*dx + dy*dy);
-        
-        if (distance < (e1.size + e2.size) && e1.size != e2.size && distance > 0.1f)
-        {
-          printf("Collision detected between entities %d (size %.1f) and %d (size %.1f)! Distance: %.1f < %.1f\n", 
-                 e1.eid, e1.size, e2.eid, e2.size, distance, (e1.size + e2.size));
-          
-          Entity *devourer = nullptr;
-          Entity *devoured = nullptr;
-          
-          if (e1.size > e2.size)
-          {
-            devourer = &e1;
-            devoured = &e2;
-          }
-          else
-          {
-            devourer = &e2;
-            devoured = &e1;
-          }
-          
-          printf("Entity %d (size %.1f) devours Entity %d (size %.1f)\n",
-                 devourer->eid, devourer->size, devoured->eid, devoured->size);
-          
-          float size_gain = devoured->size / 2.0f;
-          
-          if (size_gain > 0.0f && size_gain < 50.0f) {
-            const float MAX_SIZE = 100.0f;
-            float newSize = devourer->size + size_gain;
-            devourer->size = std::min(newSize, MAX_SIZE);
-            
-            devoured->size = 5.0f + (rand() % 5); // Random size between 5 and 10
-            
-            if (!devoured->serverControlled) {
-              devoured->score = 0;
-            }
-            
-            if (!devourer->serverControlled)
-            {
-              devourer->score += static_cast<int>(size_gain);
-            }
-            else
-            {
-              devourer->score += static_cast<int>(size_gain);
-            }
-            
-            for (size_t k = 0; k < server->peerCount; ++k)
-            {
-              ENetPeer *peer = &server->peers[k];
-              send_score_update(peer, devourer->eid, devourer->score);
-            }
-            
-            devoured->x = (rand() % 100 - 50) * 10.f;
-            devoured->y = (rand() % 100 - 50) * 10.f;
-            
-            for (size_t k = 0; k < server->peerCount; ++k)
-            {
-              ENetPeer *peer = &server->peers[k];
-              send_entity_devoured(peer, devoured->eid, devourer->eid, 
-                                  devourer->size, devoured->x, devoured->y);
-            }
-            
-            collision_occurred = true;
-          } else {
-            printf("Warning: Invalid size gain (%.1f) detected! Skipping this collision.\n", size_gain);
-          }
-          break;
-        }
-      }
-    }
-    
-    for (const Entity &e : entities)
-    {
-      for (size_t i = 0; i < server->peerCount; ++i)
-      {
-        ENetPeer *peer = &server->peers[i];
-        if (controlledMap[e.eid] != peer)
-          send_snapshot(peer, e.eid, e.x, e.y, e.size);
-      }
+      print_message_stats(stdout, messageTypeNames);
+      print_history_drops();
+      lastMessageStatsTime = curTime;
     }
     //usleep(400000);
   }
@@ -1,5 +1,12 @@
 #include "entity.h"
 #include "mathUtils.h"
+#if W5_DETERMINISTIC_SIM
+#include "tableTrig.h"
+#include <cfloat>
+
+// float math has to be evaluated at float precision, with no extended x87 registers
+static_assert(FLT_EVAL_METHOD == 0, "deterministic simulation needs SSE float math");
+#endif
 
 constexpr float worldSize = 30.f;
 
@@ -18,8 +25,14 @@ void simulate_entity(Entity &e, float dt)
   // float accel = isBraking ? 6.f : 1.5f;
   float accel = isBraking ? 12.f : 3.5f;
   float va = clamp(e.thr, -0.3, 3.f) * accel;
+#if W5_DETERMINISTIC_SIM
+  // the same bits on every build, so client prediction replays the server's ticks exactly
+  e.vx += table_cos(e.ori) * va * dt;
+  e.vy += table_sin(e.ori) * va * dt;
+#else
   e.vx += cosf(e.ori) * va * dt;
   e.vy += sinf(e.ori) * va * dt;
+#endif
   e.omega += e.steer * dt * 0.3f;
   e.ori += e.omega * dt;
   e.x += e.vx * dt;
@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t invalid_frame = -1;
+
+// Fixed-size per-frame history addressed by frameNumber % N.
+// Each slot remembers the frame it was written for, so a lookup of a frame
+// that has already been overwritten (or never stored) returns nullptr.
+// Storage is inline, pushing and looking up never allocate.
+template<typename T, size_t N>
+class FrameHistory
+{
+  static_assert(N > 0 && (N & (N - 1)) == 0, "FrameHistory size must be a power of two");
+
+  struct Slot
+  {
+    uint32_t frameNumber = invalid_frame;
+    T value{};
+  };
+
+  std::array<Slot, N> slots;
+  size_t count = 0;
+
+public:
+  static constexpr size_t capacity() { return N; }
+
+  void push(uint32_t frameNumber, const T &value)
+  {
+    Slot &slot = slots[frameNumber & (N - 1)];
+    if (slot.frameNumber == invalid_frame)
+      count++;
+    slot.frameNumber = frameNumber;
+    slot.value = value;
+  }
+
+  T *find(uint32_t frameNumber)
+  {
+    Slot &slot = slots[frameNumber & (N - 1)];
+    return slot.frameNumber == frameNumber && frameNumber != invalid_frame ? &slot.value : nullptr;
+  }
+
+  const T *find(uint32_t frameNumber) const
+  {
+    const Slot &slot = slots[frameNumber & (N - 1)];
+    return slot.frameNumber == frameNumber && frameNumber != invalid_frame ? &slot.value : nullptr;
+  }
+
+  size_t size() const { return count; }
+
+  void clear()
+  {
+    for (Slot &slot : slots)
+      slot.frameNumber = invalid_frame;
+    count = 0;
+  }
+};
@@ -6,13 +6,15 @@
 #include <math.h>
 #include <vector>
 #include <chrono>
-#include <deque>
 #include <cmath>
 #include <unordered_map>
 #include <algorithm>
 
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
+#include "entityTable.h"
+#include "frameHistory.h"
 
 using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
 
@@ -45,35 +47,39 @@ struct Snapshot
     : eid(eid), x(x), y(y), ori(ori), vx(vx), vy(vy), omega(omega), timestamp(timestamp), frameNumber(frameNumber) {}
 };
 
-static std::vector<Entity> entities;
-static std::unordered_map<uint16_t, size_t> indexMap;
+static EntityTable<Entity> entities;
 static uint16_t my_entity = invalid_entity;
 static std::unordered_map<uint16_t, std::vector<Snapshot>> snapshotHistory;
 constexpr std::chrono::milliseconds INTERPOLATION_TIME{200};
 
 // Client prediction
-static std::deque<InputCommand> inputHistory;
+constexpr size_t HISTORY_SIZE = 256; // frames, power of two
+static FrameHistory<InputCommand, HISTORY_SIZE> inputHistory;
+static FrameHistory<EntityState, HISTORY_SIZE> stateHistory;
 static uint32_t clientFrameCounter = 0;
-static uint32_t lastAcknowledgedFrame = 0;
+static uint32_t lastAcknowledgedFrame = invalid_input_frame;
 static bool pendingCorrection = false;
 static Snapshot serverState;
 constexpr float PREDICTION_ERROR_THRESHOLD = 0.5f;
-
-std::deque<EntityState> stateHistory;
-constexpr size_t STATE_HISTORY_LIMIT = 200;
 // static int serverDelay = 0; // на будущее
 
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
   deserialize_new_entity(packet, newEntity);
-  auto itf = indexMap.find(newEntity.eid);
-  if (itf != indexMap.end())
+  if (!entities.add(newEntity))
     return; // don't need to do anything, we already have entity
   
   printf("Received new entity with ID: %u\n", newEntity.eid);
-  indexMap[newEntity.eid] = entities.size();
-  entities.push_back(newEntity);
+}
+
+void on_world_state(ENetPacket *packet)
+{
+  std::vector<Entity> ents;
+  deserialize_world_state(packet, ents);
+  for (const Entity &ent : ents)
+    entities.add(ent);
+  printf("Received world state with %zu entities\n", ents.size());
 }
 
 void on_set_controlled_entity(ENetPacket *packet)
@@ -85,9 +91,8 @@ void on_set_controlled_entity(ENetPacket *packet)
 template<typename Callable>
 static void get_entity(uint16_t eid, Callable c)
 {
-  auto itf = indexMap.find(eid);
-  if (itf != indexMap.end())
-    c(entities[itf->second]);
+  if (Entity *e = entities.find(eid))
+    c(*e);
 }
 
 void on_snapshot(ENetPacket *packet)
@@ -96,27 +101,31 @@ void on_snapshot(ENetPacket *packet)
   float x = 0.f, y = 0.f, ori = 0.f, vx = 0.f, vy = 0.f, omega = 0.f;
   TimePoint timestamp;
   uint32_t frameNumber;
+  uint32_t lastInputFrame = invalid_input_frame;
   
-  deserialize_snapshot(packet, eid, x, y, ori, vx, vy, omega, timestamp, frameNumber);
+  deserialize_snapshot(packet, eid, x, y, ori, vx, vy, omega, timestamp, frameNumber, lastInputFrame);
   
   Snapshot snapshot(eid, x, y, ori, vx, vy, omega, timestamp, frameNumber);
   
-  if (eid == my_entity) {
+  // Сервер подтверждает последнюю обработанную команду, старые и повторные подтверждения пропускаем
+  bool newAck = lastInputFrame != invalid_input_frame &&
+                (lastAcknowledgedFrame == invalid_input_frame || int32_t(lastInputFrame - lastAcknowledgedFrame) > 0);
+  if (eid == my_entity && newAck) {
     serverState = snapshot;
-    lastAcknowledgedFrame = frameNumber;
+    lastAcknowledgedFrame = lastInputFrame;
     
-    while (!inputHistory.empty() && inputHistory.front().frameNumber <= frameNumber) {
-      inputHistory.pop_front();
-    }
-    
-    get_entity(my_entity, [&](Entity& e) {
-      float dx = e.x - x;
-      float dy = e.y - y;
+    // Сравниваем с предсказанием для того же кадра ввода, а не с текущим состоянием
+    const EntityState* predicted = stateHistory.find(lastInputFrame);
+    if (!predicted) {
+      pendingCorrection = true;
+    } else {
+      float dx = predicted->x - x;
+      float dy = predicted->y - y;
       float posError = sqrt(dx*dx + dy*dy);
       if (posError > PREDICTION_ERROR_THRESHOLD) {
         pendingCorrection = true;
       }
-    });
+    }
   }
   
   snapshotHistory[eid].push_back(snapshot);
@@ -215,6 +224,17 @@ void process_snapshot_history(const TimePoint& currentTime)
   }
 }
 
+void on_destroy_entities(ENetPacket *packet)
+{
+  std::vector<uint16_t> eids;
+  deserialize_destroy_entities(packet, eids);
+  for (uint16_t eid : eids)
+  {
+    entities.remove(eid);
+    snapshotHistory.erase(eid);
+  }
+}
+
 static void on_time(ENetPacket *packet, ENetPeer* peer)
 {
   uint32_t timeMsec;
@@ -246,6 +266,7 @@ static void update_net(ENetHost* client, ENetPeer* serverPeer)
       send_join(serverPeer);
       break;
     case ENET_EVENT_TYPE_RECEIVE:
+      message_stats_received(event.packet);
       switch (get_packet_type(event.packet))
       {
       case E_SERVER_TO_CLIENT_NEW_ENTITY:
@@ -260,9 +281,17 @@ static void update_net(ENetHost* client, ENetPeer* serverPeer)
       case E_SERVER_TO_CLIENT_TIME_MSEC:
         on_time(event.packet, event.peer);
         break;
+      case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+        on_destroy_entities(event.packet);
+        break;
+      case E_SERVER_TO_CLIENT_WORLD_STATE:
+        on_world_state(event.packet);
+        break;
       case E_CLIENT_TO_SERVER_JOIN:
       case E_CLIENT_TO_SERVER_INPUT:
         break;
+      default:
+        break;
       };
       enet_packet_destroy(event.packet);
       break;
@@ -290,65 +319,56 @@ static void simulate_world(ENetPeer* serverPeer)
       steer,
       std::chrono::steady_clock::now()
     };
-    inputHistory.push_back(cmd);
-
-    // Не больше 100 команд в истории
-    while (inputHistory.size() > 100) {
-      inputHistory.pop_front();
+    inputHistory.push(clientFrameCounter, cmd);
+
+    // Повторяем последние неподтверждённые команды, чтобы пережить потерю пакетов
+    InputFrame inputs[inputRedundancy];
+    uint8_t inputCount = 0;
+    for (uint32_t frame = clientFrameCounter; inputCount < inputRedundancy && frame != lastAcknowledgedFrame; --frame) {
+      const InputCommand* input = inputHistory.find(frame);
+      if (!input)
+        break;
+      inputs[inputCount++] = {frame, input->thr, input->steer};
     }
-
-    send_entity_input(serverPeer, my_entity, thr, steer);
+    send_entity_input(serverPeer, my_entity, inputs, inputCount);
 
     get_entity(my_entity, [&](Entity& e)
     {
       if (pendingCorrection) {
-        // Найти состояние в истории по frameNumber
-        auto it = std::find_if(stateHistory.begin(), stateHistory.end(),
-          [&](const EntityState& s) { return s.frameNumber == serverState.frameNumber; });
-        if (it != stateHistory.end()) {
-          // Применить дельту к состоянию
-          float dx     = serverState.x   - it->x;
-          float dy     = serverState.y   - it->y;
-          float dvx    = serverState.vx  - it->vx;
-          float dvy    = serverState.vy  - it->vy;
-          float dori   = serverState.ori - it->ori;
-          float domega = serverState.omega - it->omega;
-          // Применить дельту ко всей истории после найденного кадра
-          for (auto jt = it; jt != stateHistory.end(); ++jt) {
-            jt->x     += dx;
-            jt->y     += dy;
-            jt->vx    += dvx;
-            jt->vy    += dvy;
-            jt->ori   += dori;
-            jt->omega += domega;
-          }
-        }
         // Откатить состояние к серверному
+        uint32_t ackFrame = lastAcknowledgedFrame;
         e.x     = serverState.x;
         e.y     = serverState.y;
         e.vx    = serverState.vx;
         e.vy    = serverState.vy;
         e.ori   = serverState.ori;
         e.omega = serverState.omega;
-
-        // Для всех команд в истории применить дельту
-        for (const auto& input : inputHistory) {
-          e.thr = input.thr;
-          e.steer = input.steer;
-          simulate_entity(e, FIXED_DT);
+        stateHistory.push(ackFrame, {e.x, e.y, e.ori, e.vx, e.vy, e.omega, ackFrame});
+
+        // Переиграть только команды после подтверждённого кадра (текущий кадр симулируется ниже)
+        if (ackFrame < clientFrameCounter) {
+          uint32_t firstFrame = ackFrame + 1;
+          if (clientFrameCounter - firstFrame > HISTORY_SIZE - 1)
+            firstFrame = clientFrameCounter - (HISTORY_SIZE - 1);
+          for (uint32_t frame = firstFrame; frame < clientFrameCounter; ++frame) {
+            const InputCommand* input = inputHistory.find(frame);
+            if (!input)
+              continue;
+            e.thr = input->thr;
+            e.steer = input->steer;
+            simulate_entity(e, FIXED_DT);
+            stateHistory.push(frame, {e.x, e.y, e.ori, e.vx, e.vy, e.omega, frame});
+          }
         }
         pendingCorrection = false;
       }
-      else {
-        e.thr = thr;
-        e.steer = steer;
-        simulate_entity(e, FIXED_DT);
-      }
+
+      e.thr = thr;
+      e.steer = steer;
+      simulate_entity(e, FIXED_DT);
 
       // Сохраняем состояние в историю
-      stateHistory.push_back({e.x, e.y, e.ori, e.vx, e.vy, e.omega, clientFrameCounter});
-      if (stateHistory.size() > STATE_HISTORY_LIMIT)
-        stateHistory.pop_front();
+      stateHistory.push(clientFrameCounter, {e.x, e.y, e.ori, e.vx, e.vy, e.omega, clientFrameCounter});
     });
   }
 }
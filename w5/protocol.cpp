@@ -1,18 +1,22 @@
 #include <cstring> // std::memcpy
 #include <chrono>
+#include <cmath>
 
 #include "protocol.h"
 #include "bitstream.h"
+#include "lz4Block.h"
+#include "messageStats.h"
 
 void send_join(ENetPeer *peer)
 {
   BitStream bs;
   bs.Write<uint8_t>(E_CLIENT_TO_SERVER_JOIN);
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
-void send_new_entity(ENetPeer *peer, const Entity &ent)
+ENetPacket *create_new_entity_packet(const Entity &ent)
 {
   BitStream bs;
   bs.Write<uint8_t>(E_SERVER_TO_CLIENT_NEW_ENTITY);y:
@@ -29,32 +33,49 @@ void send_new_entity(ENetPeer *peer, const Entity &ent)
   bs.Write<uint16_t>(ent.eid);
   
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  message_stats_sent(packet);
+  return packet;
+}
 
+void send_new_entity(ENetPeer *peer, const Entity &ent)
+{
+  enet_peer_send(peer, 0, create_new_entity_packet(ent));
 }
 
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+ENetPacket *create_set_controlled_entity_packet(uint16_t eid)
 {
   BitStream bs;
   bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY);
   bs.Write<uint16_t>(eid);
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  message_stats_sent(packet);
+  return packet;
+}
+
+void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+{
+  enet_peer_send(peer, 0, create_set_controlled_entity_packet(eid));
 }
 
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer)
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputFrame *inputs, uint8_t count)
 {
   BitStream bs;
   bs.Write<uint8_t>(E_CLIENT_TO_SERVER_INPUT);
   bs.Write<uint16_t>(eid);
-  bs.Write<float>(thr);
-  bs.Write<float>(steer);
+  bs.Write<uint8_t>(count);
+  bs.Write<uint32_t>(count > 0 ? inputs[0].frameNumber : invalid_input_frame);
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    bs.Write<float>(inputs[i].thr);
+    bs.Write<float>(inputs[i].steer);
+  }
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
+  message_stats_sent(packet);
   enet_peer_send(peer, 1, packet);
 }
 
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber)
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber, uint32_t lastInputFrame)
 {
   auto duration = timestamp.time_since_epoch();
   uint64_t timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
@@ -70,26 +91,136 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, fl
   bs.Write<float>(omega);
   bs.Write<uint64_t>(timestamp_ms);
   bs.Write<uint32_t>(frameNumber);
+  bs.Write<uint32_t>(lastInputFrame);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 1, packet);
+  message_stats_sent(packet);
+  return packet;
 }
 
-void send_time_msec(ENetPeer *peer, uint32_t timeMsec)
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber, uint32_t lastInputFrame)
+{
+  enet_peer_send(peer, 1, create_snapshot_packet(eid, x, y, ori, vx, vy, omega, timestamp, frameNumber, lastInputFrame));
+}
+
+ENetPacket *create_time_msec_packet(uint32_t timeMsec)
 {
   BitStream bs;
   bs.Write<uint8_t>(E_SERVER_TO_CLIENT_TIME_MSEC);
   bs.Write<uint32_t>(timeMsec);
 
   ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  message_stats_sent(packet);
+  return packet;
+}
+
+void send_time_msec(ENetPeer *peer, uint32_t timeMsec)
+{
+  enet_peer_send(peer, 0, create_time_msec_packet(timeMsec));
+}
+
+ENetPacket *create_destroy_entities_packet(const uint16_t *eids, uint16_t count)
+{
+  BitStream bs;
+  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_DESTROY_ENTITY);
+  bs.Write<uint16_t>(count);
+  for (uint16_t i = 0; i < count; ++i)
+    bs.Write<uint16_t>(eids[i]);
+
+  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  message_stats_sent(packet);
+  return packet;
+}
+
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count)
+{
+  enet_peer_send(peer, 0, create_destroy_entities_packet(eids, count));
+}
+
+// Entity fields as they go in world state messages.
+static void write_entity(BitStream &bs, const Entity &ent)
+{
+  bs.Write<uint32_t>(ent.color);
+  bs.Write<float>(ent.x);
+  bs.Write<float>(ent.y);
+  bs.Write<uint16_t>(ent.eid);
+  bs.Write<float>(ent.vx);
+  bs.Write<float>(ent.vy);
+  bs.Write<float>(ent.ori);
+  bs.Write<float>(ent.omega);
+  bs.Write<float>(ent.thr);
+  bs.Write<float>(ent.steer);
+}
+
+static void read_entity(BitStream &bs, Entity &ent)
+{
+  bs.Read<uint32_t>(ent.color);
+  bs.Read<float>(ent.x);
+  bs.Read<float>(ent.y);
+  bs.Read<uint16_t>(ent.eid);
+  bs.Read<float>(ent.vx);
+  bs.Read<float>(ent.vy);
+  bs.Read<float>(ent.ori);
+  bs.Read<float>(ent.omega);
+  bs.Read<float>(ent.thr);
+  bs.Read<float>(ent.steer);
+}
+
+// bytes write_entity produces
+constexpr size_t ENTITY_WIRE_SIZE = sizeof(uint32_t) + 2 * sizeof(float) + sizeof(uint16_t) + 6 * sizeof(float);
+
+// type | entity count (uint16) | uncompressed size (uint32) | LZ4 block of the serialized entities
+ENetPacket *create_world_state_packet(const Entity *ents, size_t count)
+{
+  uint16_t num = uint16_t(count);
+  BitStream entities;
+  for (uint16_t i = 0; i < num; ++i)
+    write_entity(entities, ents[i]);
+  uint32_t rawSize = uint32_t(entities.GetSizeBytes());
+  std::vector<uint8_t> compressed(lz4_compress_bound(rawSize));
+  compressed.resize(lz4_compress(entities.GetData(), rawSize, compressed.data(), compressed.size()));
+
+  BitStream bs;
+  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_WORLD_STATE);
+  bs.Write<uint16_t>(num);
+  bs.Write<uint32_t>(rawSize);
+  bs.WriteBytes(compressed.data(), compressed.size());
+
+  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
+  // the entity block as it was before compression
+  message_stats_sent(packet, (packet->dataLength - compressed.size() + rawSize) * 8);
+  return packet;
+}
+
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count)
+{
+  enet_peer_send(peer, 0, create_world_state_packet(ents, count));
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0 || *packet->data >= E_MESSAGE_TYPE_COUNT)
+    return E_MESSAGE_TYPE_COUNT;
   return (MessageType)*packet->data;
 }
 
+const char *message_type_name(MessageType type)
+{
+  switch (type)
+  {
+  case E_CLIENT_TO_SERVER_JOIN: return "join";
+  case E_SERVER_TO_CLIENT_NEW_ENTITY: return "new_entity";
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: return "set_controlled_entity";
+  case E_CLIENT_TO_SERVER_INPUT: return "input";
+  case E_SERVER_TO_CLIENT_SNAPSHOT: return "snapshot";
+  case E_SERVER_TO_CLIENT_TIME_MSEC: return "time_msec";
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY: return "destroy_entity";
+  case E_SERVER_TO_CLIENT_WORLD_STATE: return "world_state";
+  case E_MESSAGE_TYPE_COUNT: break;
+  };
+  return "unknown";
+}
+
 void deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
   BitStream bs(packet->data, packet->dataLength);
@@ -116,17 +247,38 @@ void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
   bs.Read<uint16_t>(eid);
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+static bool is_valid_control(float v)
+{
+  return std::isfinite(v) && v >= -1.f && v <= 1.f;
+}
+
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputFrame (&inputs)[inputRedundancy], uint8_t &count)
 {
   BitStream bs(packet->data, packet->dataLength);
   uint8_t type;
   bs.Read<uint8_t>(type);
   bs.Read<uint16_t>(eid);
-  bs.Read<float>(thr);
-  bs.Read<float>(steer);
+  bs.Read<uint8_t>(count);
+  uint32_t newestFrame = 0;
+  bs.Read<uint32_t>(newestFrame);
+  if (count > inputRedundancy)
+    count = inputRedundancy;
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    inputs[i].frameNumber = newestFrame - i;
+    bs.Read<float>(inputs[i].thr);
+    bs.Read<float>(inputs[i].steer);
+    // the simulation would carry a NaN or an infinity on forever
+    if (!is_valid_control(inputs[i].thr) || !is_valid_control(inputs[i].steer))
+    {
+      count = 0;
+      return false;
+    }
+  }
+  return true;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, float &omega, TimePoint &timestamp, uint32_t &frameNumber)
+void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, float &omega, TimePoint &timestamp, uint32_t &frameNumber, uint32_t &lastInputFrame)
 {
   BitStream bs(packet->data, packet->dataLength);
   uint8_t type;
@@ -141,7 +293,12 @@ void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y,
   uint64_t timestamp_ms = 0;
   bs.Read<uint64_t>(timestamp_ms);
   bs.Read<uint32_t>(frameNumber);
+  bs.Read<uint32_t>(lastInputFrame);
 
+  // clamp before converting, a garbage value would overflow the clock's nanosecond count
+  constexpr uint64_t maxTimestampMs = uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(TimePoint::duration::max()).count());
+  if (timestamp_ms > maxTimestampMs)
+    timestamp_ms = maxTimestampMs;
   timestamp = TimePoint(std::chrono::milliseconds(timestamp_ms));
 }
 
@@ -153,3 +310,43 @@ void deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec)
   bs.Read<uint32_t>(timeMsec);
 }
 
+
+void deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids)
+{
+  BitStream bs(packet->data, packet->dataLength);
+  uint8_t type;
+  bs.Read<uint8_t>(type);
+  uint16_t count = 0;
+  bs.Read<uint16_t>(count);
+  // read one by one, a forged count runs out of data before it allocates much
+  eids.clear();
+  for (uint16_t i = 0; i < count; ++i)
+  {
+    uint16_t eid = invalid_entity;
+    bs.Read<uint16_t>(eid);
+    eids.push_back(eid);
+  }
+}
+
+void deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents)
+{
+  constexpr size_t headerSize = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+  BitStream bs(packet->data, packet->dataLength);
+  uint8_t type;
+  bs.Read<uint8_t>(type);
+  uint16_t count = 0;
+  bs.Read<uint16_t>(count);
+  uint32_t rawSize = 0;
+  bs.Read<uint32_t>(rawSize);
+  ents.clear();
+  // the size follows from the count, so a forged header cannot ask for more than a few MB
+  if (rawSize != count * ENTITY_WIRE_SIZE)
+    return;
+  std::vector<uint8_t> raw(rawSize);
+  if (!lz4_decompress(packet->data + headerSize, packet->dataLength - headerSize, raw.data(), rawSize))
+    return;
+  BitStream entities(raw.data(), raw.size());
+  ents.resize(count);
+  for (Entity &ent : ents)
+    read_entity(entities, ent);
+}
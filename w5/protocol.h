@@ -2,7 +2,9 @@
 #include <enet/enet.h>
 #include <cstdint>
 #include <chrono>
+#include <vector>
 #include "entity.h"
+#include "inputQueue.h"
 using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
 
 constexpr float FIXED_DT = 1.0f / 10.0f;
@@ -14,21 +16,44 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
   E_CLIENT_TO_SERVER_INPUT,
   E_SERVER_TO_CLIENT_SNAPSHOT,
-  E_SERVER_TO_CLIENT_TIME_MSEC
+  E_SERVER_TO_CLIENT_TIME_MSEC,
+  E_SERVER_TO_CLIENT_DESTROY_ENTITY,
+  E_SERVER_TO_CLIENT_WORLD_STATE,
+  E_MESSAGE_TYPE_COUNT // also returned for empty and unknown packets
 };
 
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber);
+// inputs are ordered newest first and must have consecutive frame numbers
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputFrame *inputs, uint8_t count);
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber, uint32_t lastInputFrame);
+// The create_*_packet functions build the packet without touching any peer, safe to call
+// from worker threads. Reliable messages go on channel 0, unsequenced ones on channel 1.
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori, float vx, float vy, float omega, TimePoint timestamp, uint32_t frameNumber, uint32_t lastInputFrame);
 void send_time_msec(ENetPeer *peer, uint32_t timeMsec);
+ENetPacket *create_new_entity_packet(const Entity &ent);
+ENetPacket *create_set_controlled_entity_packet(uint16_t eid);
+ENetPacket *create_time_msec_packet(uint32_t timeMsec);
+// Entities that left the game, all of a tick's removals go in one message.
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count);
+ENetPacket *create_destroy_entities_packet(const uint16_t *eids, uint16_t count);
+// Every entity a joining client needs, LZ4 compressed into one reliable message
+// that ENet fragments as needed. At most 65535 entities.
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count);
+ENetPacket *create_world_state_packet(const Entity *ents, size_t count);
 
 MessageType get_packet_type(ENetPacket *packet);
+// Short name for stats, "unknown" for E_MESSAGE_TYPE_COUNT.
+const char *message_type_name(MessageType type);
 
 void deserialize_new_entity(ENetPacket *packet, Entity &ent);
 void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, float &omega, TimePoint &timestamp, uint32_t &frameNumber);
+// False, with no inputs, if a control is not a finite value in [-1, 1].
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputFrame (&inputs)[inputRedundancy], uint8_t &count);
+void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, float &omega, TimePoint &timestamp, uint32_t &frameNumber, uint32_t &lastInputFrame);
 void deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec);
+void deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids);
+// Leaves `ents` empty if the entity block does not decompress.
+void deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents);
 
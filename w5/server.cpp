@@ -2,31 +2,99 @@
 #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
 #include "mathUtils.h"
+#include "inputQueue.h"
+#include "idAllocator.h"
+#include "peerEntities.h"
+#include "entityTable.h"
+#include "jobPool.h"
+#include "netThread.h"
+#include "peerStats.h"
+#include "metricsServer.h"
+#include "serverBench.h"
+#include "tickProfiler.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
 #include <chrono>
+#include <algorithm>
 
 uint32_t frameCounter = 0;
 TimePoint serverStartTime;
-constexpr int DELAY = 200000; // 200 ms
 
-static std::vector<Entity> entities;
-static std::map<uint16_t, ENetPeer*> controlledMap;
+static EntityTable<Entity> entities;
+static IdAllocator entityIds;
 
-void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
+// two client input frames are buffered before the server starts consuming them
+using PlayerInputQueue = InputQueue<64>;
+constexpr uint32_t INPUT_JITTER_FRAMES = 2;
+static std::map<uint16_t, PlayerInputQueue> inputQueues;
+
+// off in --bench mode, printing would dominate the timings
+static bool logConnections = true;
+
+// Snapshot stage: workers build every peer's packets in parallel while the
+// world stays unchanged, then the main thread hands them to ENet.
+static JobPool serializePool;
+static std::vector<uint32_t> lastInputFrames; // indexed like entities
+static std::vector<std::vector<ENetPacket*>> peerPackets; // indexed like host->peers
+
+// ENet is serviced on its own thread, so inputs are received between the
+// ticks too. Connection state is tracked from the events, since peer->state
+// belongs to the network thread.
+static NetThread net;
+static std::vector<uint8_t> peerConnected; // indexed like host->peers
+
+// Prometheus metrics, loopback only: per peer traffic by message type plus the
+// link stats of the network thread, published once a second.
+constexpr uint16_t METRICS_PORT = 10132;
+static PeerTrafficStats peerTraffic;
+static std::vector<PeerLinkStats> linkStats;
+static MetricsServer metricsServer;
+// Process wide message counts of the protocol layer, also printed every so often
+static std::vector<const char*> messageTypeNames;
+constexpr uint32_t MESSAGE_STATS_INTERVAL_MS = 10000;
+
+// Every packet to a peer goes through here so its bytes are accounted.
+static void send_to_peer(ENetPeer *peer, enet_uint8 channel, ENetPacket *packet)
 {
-  // send all entities
-  for (const Entity &ent : entities)
+  peerTraffic.on_sent(peer - peer->host->peers, packet);
+  net.send(peer, channel, packet);
+}
+
+static void init_peer_stats(ENetHost *server)
+{
+  messageTypeNames.clear();
+  for (int type = 0; type <= E_MESSAGE_TYPE_COUNT; ++type)
+    messageTypeNames.push_back(message_type_name(MessageType(type)));
+  peerTraffic.resize(server->peerCount, messageTypeNames);
+}
 
-    send_new_entity(peer, ent);
+static void publish_metrics()
+{
+  net.link_stats(linkStats);
+  std::string text;
+  write_peer_metrics(text, "w5", linkStats, peerTraffic);
+  write_message_metrics(text, "w5", messageTypeNames);
+  metricsServer.set_metrics(std::move(text));
+}
+
+// entity of every peer slot, despawned when the peer disconnects
+static PeerEntities peerEntities(entityIds); // indexed like host->peers
+
+void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
+{
+  // a peer controls one entity at most
+  if (peerEntities.get(peer - host->peers) != invalid_entity)
+    return;
+  uint16_t newEid = entityIds.allocate();
+  if (newEid == invalid_entity)
+    return; // every eid is taken
+  // send all entities in one message
+  if (!entities.empty())
+    send_to_peer(peer, 0, create_world_state_packet(entities.data(), entities.size()));
 
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
   uint32_t color = 0xff000000 +
                    0x00440000 * (rand() % 5) +
                    0x00004400 * (rand() % 5) +
@@ -45,48 +113,85 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
   ent.thr = 0.f;
   ent.steer = 0.f;
   ent.eid = newEid;
-  entities.push_back(ent);
+  entities.add(ent);
 
-  controlledMap[newEid] = peer;
+  inputQueues.emplace(newEid, PlayerInputQueue(INPUT_JITTER_FRAMES));
+  peerEntities.set(peer - host->peers, newEid);
 
   // send info about new entity to everyone
   for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+    if (peerConnected[i])
+      send_to_peer(&host->peers[i], 0, create_new_entity_packet(ent));
   // send info about controlled entity
-  send_set_controlled_entity(peer, newEid);
+  send_to_peer(peer, 0, create_set_controlled_entity_packet(newEid));
 }
 
-void on_input(ENetPacket *packet)
+void on_input(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
   uint16_t eid = invalid_entity;
-  float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
-  for (Entity &e : entities)
-    if (e.eid == eid)
-    {
-      e.thr = thr;
-      e.steer = steer;
-    }
+  InputFrame inputs[inputRedundancy];
+  uint8_t count = 0;
+  if (!deserialize_entity_input(packet, eid, inputs, count))
+    return;
+  // a client may only steer its own entity
+  if (eid == invalid_entity || eid != peerEntities.get(peer - host->peers))
+    return;
+  auto itf = inputQueues.find(eid);
+  if (itf == inputQueues.end())
+    return;
+  for (uint8_t i = 0; i < count; ++i)
+    itf->second.push(inputs[i]);
+}
+
+static void despawn_peer_entity(size_t peer_idx)
+{
+  uint16_t eid = peerEntities.despawn(peer_idx);
+  if (eid == invalid_entity)
+    return;
+  entities.remove(eid);
+  inputQueues.erase(eid);
+}
+
+static void send_despawns(ENetHost* server)
+{
+  const std::vector<uint16_t> &despawnedEids = peerEntities.despawned();
+  if (despawnedEids.empty())
+    return;
+  for (size_t i = 0; i < server->peerCount; ++i)
+    if (peerConnected[i])
+      send_to_peer(&server->peers[i], 0, create_destroy_entities_packet(despawnedEids.data(), uint16_t(despawnedEids.size())));
+  peerEntities.free_despawned();
 }
 
 static void update_net(ENetHost* server)
 {
-  ENetEvent event;
-  while (enet_host_service(server, &event, 0) > 0)
+  NetEvent event;
+  while (net.poll(event))
   {
     switch (event.type)
     {
     case ENET_EVENT_TYPE_CONNECT:
-      printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+      if (logConnections)
+        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+      peerConnected[event.peer - server->peers] = 1;
+      peerTraffic.reset_peer(event.peer - server->peers);
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      if (logConnections)
+        printf("Peer %zu disconnected\n", size_t(event.peer - server->peers));
+      peerConnected[event.peer - server->peers] = 0;
+      despawn_peer_entity(event.peer - server->peers);
       break;
     case ENET_EVENT_TYPE_RECEIVE:
+      peerTraffic.on_received(event.peer - server->peers, event.packet);
+      message_stats_received(event.packet);
       switch (get_packet_type(event.packet))
       {
         case E_CLIENT_TO_SERVER_JOIN:
           on_join(event.packet, event.peer, server);
           break;
         case E_CLIENT_TO_SERVER_INPUT:
-          on_input(event.packet);
+          on_input(event.packet, event.peer, server);
           break;
         };
       enet_packet_destroy(event.packet);
@@ -95,22 +200,60 @@ static void update_net(ENetHost* server)
       break;
     };
   }
+  send_despawns(server);
 }
 
-static void simulate_world(ENetHost* server, float dt)
+static void simulate_world(float dt)
 {
-  TimePoint curTime = std::chrono::steady_clock::now();
   for (Entity &e : entities)
   {
+    // consume exactly one buffered input per tick, keep the previous one if none arrived
+    auto itf = inputQueues.find(e.eid);
+    if (itf != inputQueues.end())
+    {
+      InputFrame input;
+      if (itf->second.pop(input))
+      {
+        e.thr = input.thr;
+        e.steer = input.steer;
+      }
+    }
     // simulate
     simulate_entity(e, dt); // 1.f/32.f
-    // send
-    for (size_t i = 0; i < server->peerCount; ++i)
+  }
+}
+
+static void serialize_snapshots(ENetHost* server)
+{
+  TimePoint curTime = std::chrono::steady_clock::now();
+  lastInputFrames.assign(entities.size(), invalid_input_frame);
+  for (size_t i = 0; i < entities.size(); ++i)
+  {
+    auto itf = inputQueues.find(entities[i].eid);
+    if (itf != inputQueues.end())
+      lastInputFrames[i] = itf->second.last_processed_frame();
+  }
+
+  peerPackets.resize(server->peerCount);
+  serializePool.parallel_for(server->peerCount, [&](size_t i)
+  {
+    if (!peerConnected[i])
+      return;
+    for (size_t j = 0; j < entities.size(); ++j)
     {
-      ENetPeer *peer = &server->peers[i];
-      //if (controlledMap[e.eid] != peer)
-      send_snapshot(peer, e.eid, e.x, e.y, e.ori, e.vx, e.vy, e.omega, curTime, frameCounter);
+      const Entity &e = entities[j];
+      peerPackets[i].push_back(create_snapshot_packet(e.eid, e.x, e.y, e.ori, e.vx, e.vy, e.omega, curTime, frameCounter, lastInputFrames[j]));
     }
+  });
+}
+
+static void send_snapshots(ENetHost* server)
+{
+  for (size_t i = 0; i < peerPackets.size(); ++i)
+  {
+    for (ENetPacket *packet : peerPackets[i])
+      send_to_peer(&server->peers[i], 1, packet);
+    peerPackets[i].clear();
   }
 }
 
@@ -118,7 +261,116 @@ static void update_time(ENetHost* server, uint32_t curTime)
 {
   // We can send it less often too
   for (size_t i = 0; i < server->peerCount; ++i)
-    send_time_msec(&server->peers[i], curTime);
+    if (peerConnected[i])
+      send_to_peer(&server->peers[i], 0, create_time_msec_packet(curTime));
+}
+
+// Entities nobody controls, they only coast with their initial velocity.
+static void create_bench_entity()
+{
+  Entity ent;
+  ent.color = 0xff000000 + 0x00440000 * (rand() % 5) + 0x00004400 * (rand() % 5) + 0x00000044 * (rand() % 5);
+  ent.x = (rand() % 200) - 100.f;
+  ent.y = (rand() % 200) - 100.f;
+  ent.vx = (rand() % 11) - 5.f;
+  ent.vy = (rand() % 11) - 5.f;
+  ent.ori = (rand() / (float)RAND_MAX) * 3.141592654f;
+  ent.eid = entityIds.allocate();
+  entities.add(ent);
+}
+
+static int run_bench(const ServerBenchConfig &cfg)
+{
+  ENetHost *server = create_loopback_server_host(cfg.numPeers);
+  if (!server)
+  {
+    printf("Cannot create ENet server\n");
+    return 1;
+  }
+  logConnections = false;
+  serverStartTime = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < cfg.numEntities; ++i)
+    create_bench_entity();
+  // the clients stay on this thread, the server host goes to the network thread
+  peerConnected.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
+  init_peer_stats(server);
+  net.start(server);
+
+  {
+    LoopbackClients clients(server->address, cfg.numPeers);
+    if (!clients.valid())
+    {
+      printf("Cannot create ENet client host\n");
+      net.stop();
+      enet_host_destroy(server);
+      return 1;
+    }
+    std::vector<uint16_t> clientEids(clients.size(), invalid_entity);
+    std::vector<uint32_t> clientFrames(clients.size(), 0);
+    auto on_connect = [](size_t, ENetPeer *peer) { send_join(peer); };
+    auto on_receive = [&](size_t idx, ENetPacket *packet)
+    {
+      if (get_packet_type(packet) == E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY)
+        deserialize_set_controlled_entity(packet, clientEids[idx]);
+    };
+
+    // everyone joins before the measurement starts
+    size_t numJoined = 0;
+    for (uint32_t start = enet_time_get(); numJoined < clients.size() && enet_time_get() - start < 10000;)
+    {
+      update_net(server);
+      clients.update(on_connect, on_receive);
+      numJoined = clients.size() - std::count(clientEids.begin(), clientEids.end(), invalid_entity);
+      usleep(1000);
+    }
+
+    TickProfiler profiler({"net receive", "simulate", "serialize", "send"});
+    for (uint32_t tick = 0; tick < cfg.numTicks; ++tick)
+    {
+      // the clients' side is not part of the tick
+      for (size_t i = 0; i < clients.size(); ++i)
+      {
+        if (clientEids[i] == invalid_entity)
+          continue;
+        InputFrame input = {clientFrames[i]++, 1.f, (tick + i) % 20 < 10 ? 1.f : -1.f};
+        send_entity_input(clients.peer(i), clientEids[i], &input, 1);
+      }
+      clients.flush();
+
+      profiler.begin_tick();
+      {
+        TickProfiler::Scope scope(profiler, 0);
+        update_net(server);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 1);
+        simulate_world(FIXED_DT);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 2);
+        serialize_snapshots(server);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 3);
+        send_snapshots(server);
+        update_time(server, enet_time_get());
+      }
+      profiler.end_tick();
+      frameCounter++;
+
+      clients.update(on_connect, on_receive);
+    }
+
+    printf("w5 server bench: %zu/%zu peers joined, %zu entities, %u ticks\n",
+           numJoined, clients.size(), entities.size(), cfg.numTicks);
+    profiler.print(stdout);
+    print_message_stats(stdout, messageTypeNames);
+  }
+
+  net.stop();
+  enet_host_destroy(server);
+  return 0;
 }
 
 int main(int argc, const char **argv)
@@ -128,6 +380,10 @@ int main(int argc, const char **argv)
     printf("Cannot init ENet");
     return 1;
   }
+
+  ServerBenchConfig benchConfig;
+  if (parse_server_bench_args(argc, argv, benchConfig))
+    return run_bench(benchConfig);
   ENetAddress address;
 
   address.host = ENET_HOST_ANY;
@@ -143,8 +399,18 @@ int main(int argc, const char **argv)
 
   serverStartTime = std::chrono::steady_clock::now();
   frameCounter = 0;
+  peerConnected.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
+  init_peer_stats(server);
+  net.start(server);
+  if (metricsServer.start(METRICS_PORT))
+    printf("Metrics at http://127.0.0.1:%u/metrics\n", METRICS_PORT);
+  else
+    printf("Cannot listen for metrics on port %u\n", METRICS_PORT);
 
   uint32_t lastTime = enet_time_get();
+  uint32_t lastMetricsTime = lastTime;
+  uint32_t lastMessageStatsTime = lastTime;
   float accumulatedTime = 0.0f;
   
   while (true)
@@ -155,9 +421,12 @@ int main(int argc, const char **argv)
     
     accumulatedTime += elapsed;
     
-    if (accumulatedTime >= FIXED_DT * 1000.0f)
+    // catch up on every tick that is due, the client sends an input per FIXED_DT
+    while (accumulatedTime >= FIXED_DT * 1000.0f)
     {
-      simulate_world(server, FIXED_DT);
+      simulate_world(FIXED_DT);
+      serialize_snapshots(server);
+      send_snapshots(server);
       update_net(server);
       update_time(server, curTime);
       
@@ -165,11 +434,24 @@ int main(int argc, const char **argv)
       accumulatedTime -= FIXED_DT * 1000.0f;
       // std::cout << "Frame " << frameCounter << " processed, remaining time: " << accumulatedTime << " ms" << std::endl;
     }
+    if (curTime - lastMetricsTime >= 1000)
+    {
+      publish_metrics();
+      lastMetricsTime = curTime;
+    }
+    if (curTime - lastMessageStatsTime >= MESSAGE_STATS_INTERVAL_MS)
+    {
+      print_message_stats(stdout, messageTypeNames);
+      lastMessageStatsTime = curTime;
+    }
+    metricsServer.poll();
     
-    // usleep(100000);
-    usleep(DELAY); // 200ms
+    // sleep until the next tick is due
+    usleep(useconds_t((FIXED_DT * 1000.0f - accumulatedTime) * 1000.0f));
   }
 
+  metricsServer.stop();
+  net.stop();
   enet_host_destroy(server);
 
   atexit(enet_deinitialize);
@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+// sin/cos from a table built at compile time, for a simulation that has to
+// come out bit for bit the same on the client and the server. libm's sinf and
+// cosf differ between platforms and library versions, while the table is
+// filled with plain double arithmetic during constant evaluation and looked up
+// with +, -, * and floor only, which IEEE rounds exactly the same everywhere.
+// Linear interpolation over 4096 steps a turn stays within 2e-6 of libm for the
+// angles a ship turns through, most of it from reducing the angle to a turn.
+namespace table_trig
+{
+  constexpr size_t steps = 4096; // per turn, power of two so the scaling below is exact
+  constexpr size_t quarter = steps / 4;
+  constexpr double pi = 3.14159265358979323846;
+
+  // Taylor series, only called for x in [0, pi/2] where it converges quickly.
+  constexpr double taylor_sin(double x)
+  {
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 16; ++n)
+    {
+      term *= -x * x / double((2 * n) * (2 * n + 1));
+      sum += term;
+    }
+    return sum;
+  }
+
+  // sin of i / steps turns, one quarter is computed and mirrored so the table
+  // is exactly symmetric. The quarter past a full turn is there for cos.
+  constexpr std::array<float, steps + quarter + 1> make_sin_table()
+  {
+    std::array<float, steps + quarter + 1> table = {};
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+      size_t r = i % quarter;
+      size_t q = (i / quarter) % 4;
+      size_t k = (q & 1) ? quarter - r : r;
+      float v = float(taylor_sin(double(k) * 2.0 * pi / double(steps)));
+      table[i] = q >= 2 ? -v : v;
+    }
+    return table;
+  }
+
+  inline constexpr std::array<float, steps + quarter + 1> sinTable = make_sin_table();
+
+  inline float lookup(float angle, size_t offset)
+  {
+    float turns = angle * float(1.0 / (2.0 * pi));
+    turns -= std::floor(turns);
+    // a tiny negative angle rounds up to a whole turn, and a NaN or an infinite
+    // angle must not index out of the table
+    if (!(turns >= 0.f && turns < 1.f))
+      turns = 0.f;
+    float pos = turns * float(steps); // [0, steps), scaling by a power of two is exact
+    size_t i = size_t(pos);
+    float t = pos - float(i);
+    float a = sinTable[i + offset];
+    float b = sinTable[i + offset + 1];
+    return a + (b - a) * t;
+  }
+}
+
+inline float table_sin(float angle) { return table_trig::lookup(angle, 0); }
+inline float table_cos(float angle) { return table_trig::lookup(angle, table_trig::quarter); }
@@ -0,0 +1,363 @@
+// Headless load generator: opens many connections to w7_server from one
+// process, drives every ship with random or scripted inputs and reports
+// per-bot snapshot rate, input latency and loss.
+//   w7_bots [numBots] [durationSec] [random|script] [host] [port]
+#include <enet/enet.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "entity.h"
+#include "protocol.h"
+#include "messageStats.h"
+
+using Clock = std::chrono::steady_clock;
+
+// same input rate as the windowed client
+constexpr float botTickRate = float(inputFrameRate);
+// ENet caps one host at 4095 peers, bots are spread over several hosts
+constexpr size_t botsPerHost = 512;
+// connection attempts per tick, a burst of thousands of handshakes floods the server
+constexpr size_t connectsPerTick = 16;
+// send times of the last inputs, to match the server's input acks
+constexpr uint32_t inputTimeHistory = 64;
+
+enum class BotMode
+{
+  Random,
+  Script
+};
+
+struct Bot
+{
+  size_t index = 0;
+  ENetPeer *peer = nullptr;
+  uint16_t eid = invalid_entity;
+  bool connected = false;
+  bool failed = false;
+
+  // input
+  float thr = 0.f;
+  float steer = 0.f;
+  uint32_t inputFrame = 0;
+  InputFrame inputHistory[inputRedundancy];
+  Clock::time_point inputSentAt[inputTimeHistory];
+  uint32_t lastAckedFrame = invalid_input_frame;
+
+  // stats
+  Clock::time_point connectedAt;
+  Clock::time_point disconnectedAt;
+  uint32_t snapshots = 0;
+  uint32_t ownSnapshots = 0;
+  uint32_t latencySamples = 0;
+  double latencySumMs = 0.0;
+  double latencyMaxMs = 0.0;
+  uint32_t rttMs = 0;
+  float packetLoss = 0.f;
+};
+
+static void update_input(Bot &bot, BotMode mode)
+{
+  if (mode == BotMode::Random)
+  {
+    // same toggling as the server's AI ships
+    if (rand() % 100 == 0)
+      bot.thr = bot.thr > 0.f ? 0.f : 1.f;
+    if (rand() % 10 == 0)
+      bot.steer = bot.steer != 0.f ? 0.f : ((rand() % 2) * 2.f - 1.f);
+    return;
+  }
+  // full throttle, steering cycles left, straight, right, straight once a second, phase shifted per bot
+  static const float steerCycle[4] = {-1.f, 0.f, 1.f, 0.f};
+  uint32_t phase = (bot.inputFrame + uint32_t(bot.index * 7)) / uint32_t(botTickRate / 4.f);
+  bot.thr = 1.f;
+  bot.steer = steerCycle[phase % 4];
+}
+
+static void send_input(Bot &bot)
+{
+  // newest first, same as the windowed client
+  bot.inputHistory[bot.inputFrame % inputRedundancy] = {bot.inputFrame, bot.thr, bot.steer};
+  InputFrame inputs[inputRedundancy];
+  uint8_t count = 0;
+  for (; count < inputRedundancy && count <= bot.inputFrame; ++count)
+    inputs[count] = bot.inputHistory[(bot.inputFrame - count) % inputRedundancy];
+  send_entity_input(bot.peer, bot.eid, inputs, count);
+  bot.inputSentAt[bot.inputFrame % inputTimeHistory] = Clock::now();
+  bot.inputFrame++;
+}
+
+static void on_input_ack(Bot &bot, uint16_t ack)
+{
+  if (bot.inputFrame == 0)
+    return;
+  // only the low 16 bits are on the wire, take the newest sent frame that matches them
+  uint32_t newest = bot.inputFrame - 1;
+  uint32_t frame = newest - uint16_t(uint16_t(newest) - ack);
+  if (newest - frame >= inputTimeHistory)
+    return;
+  if (bot.lastAckedFrame != invalid_input_frame && frame <= bot.lastAckedFrame)
+    return;
+  bot.lastAckedFrame = frame;
+  double ms = std::chrono::duration<double, std::milli>(Clock::now() - bot.inputSentAt[frame % inputTimeHistory]).count();
+  bot.latencySamples++;
+  bot.latencySumMs += ms;
+  bot.latencyMaxMs = std::max(bot.latencyMaxMs, ms);
+}
+
+static void on_packet(Bot &bot, ENetPacket *packet)
+{
+  message_stats_received(packet);
+  switch (get_packet_type(packet))
+  {
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+    deserialize_set_controlled_entity(packet, bot.eid);
+    break;
+  case E_SERVER_TO_CLIENT_SNAPSHOT:
+  {
+    uint16_t eid = invalid_entity;
+    float x, y, ori, vx, vy;
+    uint16_t lastInputFrame = 0;
+    if (!deserialize_snapshot(packet, eid, x, y, ori, vx, vy, lastInputFrame))
+      break;
+    bot.snapshots++;
+    if (eid == bot.eid)
+    {
+      bot.ownSnapshots++;
+      on_input_ack(bot, lastInputFrame);
+    }
+    break;
+  }
+  default:
+    // new entities and time sync carry nothing the bots measure
+    break;
+  };
+}
+
+static void update_net(ENetHost *host)
+{
+  ENetEvent event;
+  while (enet_host_service(host, &event, 0) > 0)
+  {
+    Bot &bot = *(Bot*)event.peer->data;
+    switch (event.type)
+    {
+    case ENET_EVENT_TYPE_CONNECT:
+      bot.connected = true;
+      bot.connectedAt = Clock::now();
+      send_join(event.peer);
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      if (bot.connected)
+        bot.disconnectedAt = Clock::now();
+      else
+        bot.failed = true;
+      bot.connected = false;
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+      on_packet(bot, event.packet);
+      enet_packet_destroy(event.packet);
+      break;
+    default:
+      break;
+    };
+  }
+}
+
+static void sample_peer_stats(Bot &bot)
+{
+  bot.rttMs = bot.peer->roundTripTime;
+  bot.packetLoss = float(bot.peer->packetLoss) / ENET_PEER_PACKET_LOSS_SCALE;
+}
+
+struct BotReport
+{
+  float connectedSec = 0.f;
+  float snapshotRate = 0.f;
+  float ownSnapshotRate = 0.f;
+  float latencyAvgMs = 0.f;
+  float latencyMaxMs = 0.f;
+  float rttMs = 0.f;
+  float lossPercent = 0.f;
+};
+
+static BotReport make_report(const Bot &bot, Clock::time_point now)
+{
+  BotReport r;
+  Clock::time_point end = bot.connected ? now : bot.disconnectedAt;
+  r.connectedSec = std::chrono::duration<float>(end - bot.connectedAt).count();
+  if (r.connectedSec > 0.f)
+  {
+    r.snapshotRate = bot.snapshots / r.connectedSec;
+    r.ownSnapshotRate = bot.ownSnapshots / r.connectedSec;
+  }
+  if (bot.latencySamples > 0)
+    r.latencyAvgMs = float(bot.latencySumMs / bot.latencySamples);
+  r.latencyMaxMs = float(bot.latencyMaxMs);
+  r.rttMs = float(bot.rttMs);
+  r.lossPercent = bot.packetLoss * 100.f;
+  return r;
+}
+
+static void print_distribution(const char *name, std::vector<BotReport> &reports, float BotReport::*field)
+{
+  std::sort(reports.begin(), reports.end(), [field](const BotReport &a, const BotReport &b) { return a.*field < b.*field; });
+  auto at = [&](float q) { return reports[std::min(reports.size() - 1, size_t(q * reports.size()))].*field; };
+  printf("  %-22s min %8.2f  p50 %8.2f  p99 %8.2f  max %8.2f\n", name, reports.front().*field, at(0.5f), at(0.99f), reports.back().*field);
+}
+
+static void print_report(const std::vector<Bot> &bots)
+{
+  Clock::time_point now = Clock::now();
+  std::vector<BotReport> reports;
+  size_t numFailed = 0;
+  size_t numConnected = 0;
+  for (const Bot &bot : bots)
+  {
+    numFailed += bot.failed ? 1 : 0;
+    numConnected += bot.connected ? 1 : 0;
+    if (bot.eid != invalid_entity)
+      reports.push_back(make_report(bot, now));
+  }
+  printf("%zu bots: %zu joined, %zu still connected, %zu failed to connect\n",
+         bots.size(), reports.size(), numConnected, numFailed);
+
+  // a handful of bots is printed one by one, a load test as distributions over bots
+  constexpr size_t maxListedBots = 16;
+  if (bots.size() <= maxListedBots)
+  {
+    for (size_t i = 0; i < bots.size(); ++i)
+    {
+      if (bots[i].eid == invalid_entity)
+        continue;
+      BotReport r = make_report(bots[i], now);
+      printf("  bot %3zu eid %5u: %7.1f snapshots/s (own %5.1f/s), input latency avg %6.1f ms max %6.1f ms, rtt %4.0f ms, loss %5.2f%%\n",
+             i, bots[i].eid, r.snapshotRate, r.ownSnapshotRate, r.latencyAvgMs, r.latencyMaxMs, r.rttMs, r.lossPercent);
+    }
+  }
+  if (reports.empty())
+    return;
+  print_distribution("snapshots/s", reports, &BotReport::snapshotRate);
+  print_distribution("own snapshots/s", reports, &BotReport::ownSnapshotRate);
+  print_distribution("input latency avg ms", reports, &BotReport::latencyAvgMs);
+  print_distribution("input latency max ms", reports, &BotReport::latencyMaxMs);
+  print_distribution("rtt ms", reports, &BotReport::rttMs);
+  print_distribution("loss %", reports, &BotReport::lossPercent);
+}
+
+int main(int argc, const char **argv)
+{
+  size_t numBots = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+  float durationSec = argc > 2 ? atof(argv[2]) : 30.f;
+  BotMode mode = argc > 3 && strcmp(argv[3], "script") == 0 ? BotMode::Script : BotMode::Random;
+  const char *hostName = argc > 4 ? argv[4] : "localhost";
+  uint16_t port = argc > 5 ? uint16_t(atoi(argv[5])) : 10131;
+  if (numBots == 0)
+  {
+    printf("usage: w7_bots [numBots] [durationSec] [random|script] [host] [port]\n");
+    return 1;
+  }
+
+  if (enet_initialize() != 0)
+  {
+    printf("Cannot init ENet");
+    return 1;
+  }
+
+  ENetAddress address;
+  if (enet_address_set_host(&address, hostName) != 0)
+  {
+    printf("Cannot resolve %s\n", hostName);
+    return 1;
+  }
+  address.port = port;
+
+  std::vector<ENetHost*> hosts;
+  for (size_t i = 0; i < numBots; i += botsPerHost)
+  {
+    ENetHost *host = enet_host_create(nullptr, std::min(botsPerHost, numBots - i), 2, 0, 0);
+    if (!host)
+    {
+      printf("Cannot create ENet client host\n");
+      return 1;
+    }
+    hosts.push_back(host);
+  }
+
+  std::vector<Bot> bots(numBots); // never resized, peers point into it
+  for (size_t i = 0; i < numBots; ++i)
+    bots[i].index = i;
+  srand(42);
+
+  printf("Running %zu %s bots against %s:%u for %.0f s\n", numBots,
+         mode == BotMode::Script ? "scripted" : "random", hostName, port, durationSec);
+
+  const auto tickPeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.f / botTickRate));
+  const Clock::time_point start = Clock::now();
+  Clock::time_point nextTick = start;
+  Clock::time_point nextReport = start + std::chrono::seconds(1);
+  size_t numStarted = 0;
+  while (Clock::now() - start < std::chrono::duration<float>(durationSec))
+  {
+    for (size_t i = 0; i < connectsPerTick && numStarted < numBots; ++i, ++numStarted)
+    {
+      Bot &bot = bots[numStarted];
+      bot.peer = enet_host_connect(hosts[numStarted / botsPerHost], &address, 2, 0);
+      if (!bot.peer)
+      {
+        bot.failed = true;
+        continue;
+      }
+      bot.peer->data = &bot;
+    }
+
+    for (ENetHost *host : hosts)
+      update_net(host);
+
+    for (Bot &bot : bots)
+    {
+      if (!bot.connected || bot.eid == invalid_entity)
+        continue;
+      update_input(bot, mode);
+      send_input(bot);
+      sample_peer_stats(bot);
+    }
+
+    for (ENetHost *host : hosts)
+      enet_host_flush(host);
+
+    if (Clock::now() >= nextReport)
+    {
+      size_t numJoined = 0;
+      uint64_t numSnapshots = 0;
+      for (const Bot &bot : bots)
+      {
+        numJoined += bot.eid != invalid_entity ? 1 : 0;
+        numSnapshots += bot.snapshots;
+      }
+      printf("%5.1f s: %zu/%zu joined, %llu snapshots received\n",
+             std::chrono::duration<float>(Clock::now() - start).count(), numJoined, numBots, (unsigned long long)numSnapshots);
+      nextReport += std::chrono::seconds(1);
+    }
+
+    nextTick += tickPeriod;
+    std::this_thread::sleep_until(nextTick);
+  }
+
+  print_report(bots);
+
+  for (Bot &bot : bots)
+    if (bot.connected)
+      enet_peer_disconnect(bot.peer, 0);
+  for (ENetHost *host : hosts)
+  {
+    enet_host_flush(host);
+    enet_host_destroy(host);
+  }
+
+  atexit(enet_deinitialize);
+  return 0;
+}
@@ -8,35 +8,43 @@
 #include <vector>
 #include "entity.h"
 #include "protocol.h"
+#include "messageStats.h"
+#include "rateMeter.h"
+#include "entityTable.h"
 
 
-static std::vector<Entity> entities;
-static std::unordered_map<uint16_t, size_t> indexMap;
+static EntityTable<Entity> entities;
 static uint16_t my_entity = invalid_entity;
 
-struct BandwidthAccumulator
-{
-  std::vector<std::pair<uint32_t, float>> inData;
-  std::vector<std::pair<uint32_t, float>> outData;
-  float curTime = 0.f;
-};
+// last few inputs are repeated in every input packet
+static uint32_t inputFrame = 0;
+static InputFrame inputHistory[inputRedundancy];
+static uint16_t lastAcknowledgedInput = 0;
+
+// Bandwidth shown on screen. Timed with the window clock, enet_time_get()
+// jumps whenever the server time is applied.
+static TrafficRates traffic;
 
-uint32_t get_delta_data(const std::vector<std::pair<uint32_t, float>>& data)
+static uint32_t rate_time_ms()
 {
-  if (data.empty())
-    return 0;
-  return data.back().first - data.front().first;
+  return uint32_t(GetTime() * 1000.0);
 }
 
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
-  deserialize_new_entity(packet, newEntity);
-  auto itf = indexMap.find(newEntity.eid);
-  if (itf != indexMap.end())
-    return; // don't need to do anything, we already have entity
-  indexMap[newEntity.eid] = entities.size();
-  entities.push_back(newEntity);
+  if (!deserialize_new_entity(packet, newEntity))
+    return;
+  entities.add(newEntity); // does nothing if we already have the entity
+}
+
+void on_world_state(ENetPacket *packet)
+{
+  std::vector<Entity> ents;
+  if (!deserialize_world_state(packet, ents))
+    return;
+  for (const Entity &ent : ents)
+    entities.add(ent);
 }
 
 void on_set_controlled_entity(ENetPacket *packet)
@@ -47,28 +55,44 @@ void on_set_controlled_entity(ENetPacket *packet)
 template<typename Callable>
 static void get_entity(uint16_t eid, Callable c)
 {
-  auto itf = indexMap.find(eid);
-  if (itf != indexMap.end())
-    c(entities[itf->second]);
+  if (Entity *e = entities.find(eid))
+    c(*e);
 }
 
 void on_snapshot(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f; float ori = 0.f;
-  deserialize_snapshot(packet, eid, x, y, ori);
+  float vx = 0.f; float vy = 0.f;
+  uint16_t lastInputFrame = 0;
+  if (!deserialize_snapshot(packet, eid, x, y, ori, vx, vy, lastInputFrame))
+    return;
+  if (eid == my_entity)
+    lastAcknowledgedInput = lastInputFrame;
   get_entity(eid, [&](Entity& e)
   {
       e.x = x;
       e.y = y;
       e.ori = ori;
+      e.vx = vx;
+      e.vy = vy;
   });
 }
 
+void on_destroy_entities(ENetPacket *packet)
+{
+  std::vector<uint16_t> eids;
+  if (!deserialize_destroy_entities(packet, eids))
+    return;
+  for (uint16_t eid : eids)
+    entities.remove(eid);
+}
+
 static void on_time(ENetPacket *packet, ENetPeer* peer)
 {
   uint32_t timeMsec;
-  deserialize_time_msec(packet, timeMsec);
+  if (!deserialize_time_msec(packet, timeMsec))
+    return;
   enet_time_set(timeMsec + peer->lastRoundTripTime / 2);
 }
 
@@ -103,6 +127,8 @@ static void update_net(ENetHost* client, ENetPeer* serverPeer)
       send_join(serverPeer);
       break;
     case ENET_EVENT_TYPE_RECEIVE:
+      message_stats_received(event.packet);
+      traffic.on_received(rate_time_ms(), event.channelID, event.packet);
       switch (get_packet_type(event.packet))
       {
       case E_SERVER_TO_CLIENT_NEW_ENTITY:
@@ -117,6 +143,12 @@ static void update_net(ENetHost* client, ENetPeer* serverPeer)
       case E_SERVER_TO_CLIENT_TIME_MSEC:
         on_time(event.packet, event.peer);
         break;
+      case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+        on_destroy_entities(event.packet);
+        break;
+      case E_SERVER_TO_CLIENT_WORLD_STATE:
+        on_world_state(event.packet);
+        break;
       };
       enet_packet_destroy(event.packet);
       break;
@@ -140,13 +172,19 @@ static void simulate_world(ENetPeer* serverPeer)
         float thr = (up ? 1.f : 0.f) + (down ? -1.f : 0.f);
         float steer = (left ? -1.f : 0.f) + (right ? 1.f : 0.f);
 
-        // Send
-        send_entity_input(serverPeer, my_entity, thr, steer);
+        // Send, newest first
+        inputHistory[inputFrame % inputRedundancy] = {inputFrame, thr, steer};
+        InputFrame inputs[inputRedundancy];
+        uint8_t count = 0;
+        for (; count < inputRedundancy && count <= inputFrame; ++count)
+          inputs[count] = inputHistory[(inputFrame - count) % inputRedundancy];
+        send_entity_input(serverPeer, my_entity, inputs, count);
+        inputFrame++;
     });
   }
 }
 
-static void draw_world(const Camera2D& camera, const BandwidthAccumulator& bw)
+static void draw_world(const Camera2D& camera)
 {
   BeginDrawing();
     ClearBackground(DARKGRAY);
@@ -165,8 +203,15 @@ static void draw_world(const Camera2D& camera, const BandwidthAccumulator& bw)
         draw_entity(e);
 
     EndMode2D();
-    DrawText(TextFormat("Bandwidth: in %0.2f kbit/s", get_delta_data(bw.inData) / 1024.f), 8, 8, 12, WHITE);
-    DrawText(TextFormat("Bandwidth: out %0.2f kbit/s", get_delta_data(bw.outData) / 1024.f), 8, 20, 12, WHITE);
+    uint32_t now = rate_time_ms();
+    DrawText(TextFormat("Bandwidth: in %0.2f kbit/s, %0.0f packets/s", TrafficRates::kbps(traffic.in.wireBytes, now),
+                        traffic.in.wirePackets.rate(now)), 8, 8, 12, WHITE);
+    DrawText(TextFormat("Bandwidth: out %0.2f kbit/s, %0.0f packets/s", TrafficRates::kbps(traffic.out.wireBytes, now),
+                        traffic.out.wirePackets.rate(now)), 8, 20, 12, WHITE);
+    DrawText(TextFormat("Reliable in: %0.2f kbit/s, unsequenced in: %0.2f kbit/s",
+                        TrafficRates::kbps(traffic.in.channelBytes[0], now),
+                        TrafficRates::kbps(traffic.in.channelBytes[1], now)), 8, 32, 12, WHITE);
+    DrawText(TextFormat("Input frame: %u, acked: %u", inputFrame, lastAcknowledgedInput), 8, 44, 12, WHITE);
   EndDrawing();
 }
 
@@ -184,22 +229,6 @@ static void update_camera(Camera2D& camera)
 }
 
 
-void update_bandwidth(float dt, ENetHost* host, BandwidthAccumulator& accum)
-{
-  constexpr float windowSize = 1.f; // 1 sec
-  accum.curTime += dt;
-  accum.inData.emplace_back(host->totalReceivedData, accum.curTime);
-  accum.outData.emplace_back(host->totalSentData, accum.curTime);
-
-  auto eraseOld = [&](std::vector<std::pair<uint32_t, float>>& data)
-  {
-    while (data.front().second < accum.curTime - windowSize)
-      data.erase(data.begin());
-  };
-  eraseOld(accum.inData);
-  eraseOld(accum.outData);
-}
-
 int main(int argc, const char **argv)
 {
   if (enet_initialize() != 0)
@@ -246,18 +275,15 @@ int main(int argc, const char **argv)
   camera.rotation = 0.f;
   camera.zoom = 10.f;
 
-  SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
+  SetTargetFPS(inputFrameRate);   // one input frame per rendered frame, see protocol.h
 
-  BandwidthAccumulator bandwidthAccumulator;
   while (!WindowShouldClose())
   {
-    float dt = GetFrameTime();
-
     update_net(client, serverPeer);
-    update_bandwidth(dt, client, bandwidthAccumulator);
+    traffic.update(rate_time_ms(), client);
     simulate_world(serverPeer);
     update_camera(camera);
-    draw_world(camera, bandwidthAccumulator);
+    draw_world(camera);
   }
 
   CloseWindow();
@@ -0,0 +1,82 @@
+#include "priorityScheduler.h"
+#include <algorithm>
+#include <math.h>
+
+// relevance weights, per second
+constexpr float basePriority = 1.f;
+constexpr float ownEntityPriority = 1000.f;
+constexpr float nearPriority = 20.f;
+constexpr float nearDistance = 20.f;
+constexpr float velocityChangePriority = 4.f;
+// unspent budget carried over to the next tick, in ticks
+constexpr float maxBudgetCarry = 2.f;
+
+static float wrapped_distance(float a, float b)
+{
+  float d = fabsf(a - b);
+  return d > worldSize ? 2.f * worldSize - d : d;
+}
+
+void PriorityScheduler::reset(uint16_t viewer_eid)
+{
+  entries.clear();
+  budgetBytes = 0.f;
+  viewerEid = viewer_eid;
+}
+
+void PriorityScheduler::forget(uint16_t eid)
+{
+  if (eid < entries.size())
+    entries[eid] = EntityPriority();
+}
+
+const std::vector<uint32_t> &PriorityScheduler::schedule(const EntityTable<Entity> &entities, float dt, float bytes_per_sec, size_t bytes_per_entity)
+{
+  const Entity *viewer = entities.find(viewerEid);
+
+  candidates.clear();
+  for (uint32_t i = 0; i < entities.size(); ++i)
+  {
+    const Entity &e = entities[i];
+    if (e.eid >= entries.size())
+      entries.resize(size_t(e.eid) + 1);
+    EntityPriority &entry = entries[e.eid];
+
+    float relevance = basePriority;
+    if (&e == viewer)
+      relevance += ownEntityPriority;
+    else if (viewer)
+    {
+      float dx = wrapped_distance(e.x, viewer->x);
+      float dy = wrapped_distance(e.y, viewer->y);
+      relevance += nearPriority * nearDistance / (nearDistance + sqrtf(dx * dx + dy * dy));
+    }
+    relevance += velocityChangePriority * (fabsf(e.vx - entry.sentVx) + fabsf(e.vy - entry.sentVy));
+    entry.priority += relevance * dt;
+    candidates.push_back(i);
+  }
+
+  float tickBudget = bytes_per_sec * dt;
+  budgetBytes = std::min(budgetBytes + tickBudget, std::max(tickBudget * maxBudgetCarry, float(bytes_per_entity)));
+  size_t slots = budgetBytes > 0.f ? size_t(budgetBytes / bytes_per_entity) : 0;
+  slots = std::min(slots, candidates.size());
+
+  auto byPriority = [&](uint32_t a, uint32_t b)
+  {
+    return entries[entities[a].eid].priority > entries[entities[b].eid].priority;
+  };
+  if (slots < candidates.size())
+    std::nth_element(candidates.begin(), candidates.begin() + slots, candidates.end(), byPriority);
+
+  selected.assign(candidates.begin(), candidates.begin() + slots);
+  for (uint32_t i : selected)
+  {
+    const Entity &e = entities[i];
+    EntityPriority &entry = entries[e.eid];
+    entry.priority = 0.f;
+    entry.sentVx = e.vx;
+    entry.sentVy = e.vy;
+  }
+  budgetBytes -= float(slots * bytes_per_entity);
+  return selected;
+}
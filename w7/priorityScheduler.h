@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "entity.h"
+#include "entityTable.h"
+
+// Per-peer snapshot scheduler with a priority accumulator.
+// Every tick each entity gains priority according to how relevant it is to
+// the peer (distance to the peer's own ship, how much its velocity changed
+// since it was last sent), so entities that were skipped keep gaining until
+// they win a slot. The tick's byte budget is then filled with the highest
+// priority entities, whose priority starts over from zero.
+class PriorityScheduler
+{
+public:
+  void reset(uint16_t viewer_eid);
+  void forget(uint16_t eid);
+
+  /**
+   * Picks the entities to send this tick.
+   * @param bytes_per_sec Bandwidth budget for this peer
+   * @param bytes_per_entity Wire cost of one entity update, protocol overhead included
+   * @return Indices into entities, valid until the next call
+   */
+  const std::vector<uint32_t> &schedule(const EntityTable<Entity> &entities, float dt, float bytes_per_sec, size_t bytes_per_entity);
+
+  uint16_t viewer() const { return viewerEid; }
+
+private:
+  struct EntityPriority
+  {
+    float priority = 0.f;
+    float sentVx = 0.f;
+    float sentVy = 0.f;
+  };
+
+  std::vector<EntityPriority> entries; // indexed by eid
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> selected;
+  float budgetBytes = 0.f;
+  uint16_t viewerEid = invalid_entity;
+};
@@ -1,5 +1,11 @@
 #include "protocol.h"
 #include "quantisation.h"
+#include "shipState.h"
+#include "lz4Block.h"
+#include "wireFormat.h"
+#include "messageStats.h"
+#include <cmath>
+#include <cstddef>
 #include <cstring> // memcpy
 #include <iostream>
 
@@ -8,137 +14,372 @@ void send_join(ENetPeer *peer)
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
   *packet->data = E_CLIENT_TO_SERVER_JOIN;
 
+  message_stats_sent(packet);
   enet_peer_send(peer, 0, packet);
 }
 
-void send_new_entity(ENetPeer *peer, const Entity &ent)
+// Wire encoding of an Entity in 18 bytes, little-endian:
+//   eid                2 bytes
+//   color              4 bytes
+//   serverControlled   1 byte   0 or 1
+//   x, y, ori, vx, vy  6 bytes  PackedShipState, the same precision as snapshots
+//   omega              4 bytes  float, unbounded so it is not quantised
+//   thr, steer         1 byte   ControlQuantiser codes, high and low nibble as in inputs
+constexpr size_t entityWireSize = sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint8_t) +
+                                  packedShipStateSize + sizeof(float) + sizeof(uint8_t);
+// the same fields as they are in memory, eid, color, serverControlled and eight floats
+constexpr size_t entityRawBits = (sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint8_t) + 8 * sizeof(float)) * 8;
+
+static void store_entity(uint8_t *&ptr, const Entity &ent)
+{
+  store_le<uint16_t>(ptr, ent.eid);
+  store_le<uint32_t>(ptr, ent.color);
+  store_le<uint8_t>(ptr, ent.serverControlled ? 1 : 0);
+  ShipState state = {ent.x, ent.y, ent.ori, ent.vx, ent.vy};
+  pack_ship_state(state, ptr); ptr += packedShipStateSize;
+  store_le<float>(ptr, ent.omega);
+  store_le<uint8_t>(ptr, uint8_t((ControlQuantiser::pack(ent.thr) << 4) | ControlQuantiser::pack(ent.steer)));
+}
+
+ENetPacket *create_new_entity_packet(const Entity &ent)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(Entity),
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + entityWireSize,
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
+  store_entity(ptr, ent);
+  message_stats_sent(packet, 8 + entityRawBits);
+  return packet;
+}
 
-  enet_peer_send(peer, 0, packet);
+void send_new_entity(ENetPeer *peer, const Entity &ent)
+{
+  enet_peer_send(peer, 0, create_new_entity_packet(ent));
 }
 
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+ENetPacket *create_set_controlled_entity_packet(uint16_t eid)
 {
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t),
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  message_stats_sent(packet);
+  return packet;
+}
 
-  enet_peer_send(peer, 0, packet);
+void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+{
+  enet_peer_send(peer, 0, create_set_controlled_entity_packet(eid));
 }
 
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer)
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputFrame *inputs, uint8_t count)
 {
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
+                                                   sizeof(uint8_t) + sizeof(uint32_t) +
+                                                   count * sizeof(uint8_t),
                                                    ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
   *ptr = E_CLIENT_TO_SERVER_INPUT; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  float4bitsQuantized thrPacked(thr, -1.f, 1.f);
-  float4bitsQuantized steerPacked(steer, -1.f, 1.f);
-  uint8_t thrSteerPacked = (thrPacked.packedVal << 4) | steerPacked.packedVal;
-  memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  /*
-  memcpy(ptr, &thrPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
+  uint32_t newestFrame = count > 0 ? inputs[0].frameNumber : invalid_input_frame;
+  memcpy(ptr, &count, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  memcpy(ptr, &newestFrame, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    float controls[2] = {inputs[i].thr, inputs[i].steer};
+    uint8_t packed[2];
+    ControlQuantiser::pack_array(controls, packed, 2);
+    uint8_t thrSteerPacked = (packed[0] << 4) | packed[1];
+    memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  }
 
+  // thr and steer as two floats per frame
+  message_stats_sent(packet, (packet->dataLength - count * sizeof(uint8_t) + count * 2 * sizeof(float)) * 8);
   enet_peer_send(peer, 1, packet);
 }
 
-typedef PackedFloat<uint16_t, 11> PositionXQuantized;
-typedef PackedFloat<uint16_t, 10> PositionYQuantized;
+size_t snapshot_size()
+{
+  return sizeof(uint8_t) + sizeof(uint16_t) + packedShipStateSize + sizeof(uint16_t);
+}
+
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori, float vx, float vy, uint32_t lastInputFrame)
+{
+  ShipState state = {x, y, ori, vx, vy};
+  PackedShipState packed;
+  pack_ship_state(state, packed);
+  return create_snapshot_packet(eid, packed, lastInputFrame);
+}
 
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
+ENetPacket *create_snapshot_packet(uint16_t eid, const uint8_t *packed_state, uint32_t lastInputFrame)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
+  ENetPacket *packet = enet_packet_create(nullptr, snapshot_size(), ENET_PACKET_FLAG_UNSEQUENCED);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
   memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  PositionXQuantized xPacked(x, -worldSize, worldSize);
-  PositionYQuantized yPacked(y, -worldSize, worldSize);
-  uint8_t oriPacked = pack_float<uint8_t>(ori, -PI, PI, 8);
-  //printf("xPacked/unpacked %d %f\n", xPacked, x);
-  memcpy(ptr, &xPacked.packedVal, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &yPacked.packedVal, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  memcpy(ptr, packed_state, packedShipStateSize); ptr += packedShipStateSize;
+  uint16_t inputAck = uint16_t(lastInputFrame);
+  memcpy(ptr, &inputAck, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  // five floats and the full 32 bit frame number
+  message_stats_sent(packet, (sizeof(uint8_t) + sizeof(uint16_t) + 5 * sizeof(float) + sizeof(uint32_t)) * 8);
+  return packet;
+}
 
-  enet_peer_send(peer, 1, packet);
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, uint32_t lastInputFrame)
+{
+  enet_peer_send(peer, 1, create_snapshot_packet(eid, x, y, ori, vx, vy, lastInputFrame));
 }
 
-void send_time_msec(ENetPeer *peer, uint32_t timeMsec)
+ENetPacket *create_time_msec_packet(uint32_t timeMsec)
 {
   ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint32_t),
                                                    ENET_PACKET_FLAG_RELIABLE);
   uint8_t *ptr = packet->data;
   *ptr = E_SERVER_TO_CLIENT_TIME_MSEC; ptr += sizeof(uint8_t);
   memcpy(ptr, &timeMsec, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  message_stats_sent(packet);
+  return packet;
+}
 
-  enet_peer_send(peer, 0, packet);
+void send_time_msec(ENetPeer *peer, uint32_t timeMsec)
+{
+  enet_peer_send(peer, 0, create_time_msec_packet(timeMsec));
+}
+
+ENetPacket *create_destroy_entities_packet(const uint16_t *eids, uint16_t count)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) + count * sizeof(uint16_t),
+                                                   ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = packet->data;
+  *ptr = E_SERVER_TO_CLIENT_DESTROY_ENTITY; ptr += sizeof(uint8_t);
+  memcpy(ptr, &count, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  memcpy(ptr, eids, count * sizeof(uint16_t)); ptr += count * sizeof(uint16_t);
+  message_stats_sent(packet);
+  return packet;
+}
+
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count)
+{
+  enet_peer_send(peer, 0, create_destroy_entities_packet(eids, count));
+}
+
+// type | entity count (uint16) | uncompressed size (uint32) | LZ4 block of the encoded entities back to back
+constexpr size_t worldStateHeaderSize = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+
+ENetPacket *create_world_state_packet(const Entity *ents, size_t count)
+{
+  uint16_t num = uint16_t(count);
+  uint32_t rawSize = uint32_t(num * entityWireSize);
+  std::vector<uint8_t> raw(rawSize);
+  uint8_t *rawPtr = raw.data();
+  for (uint16_t i = 0; i < num; ++i)
+    store_entity(rawPtr, ents[i]);
+  // allocated for the worst case, trimmed to what the compressor produced
+  ENetPacket *packet = enet_packet_create(nullptr, worldStateHeaderSize + lz4_compress_bound(rawSize),
+                                                   ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = packet->data;
+  *ptr = E_SERVER_TO_CLIENT_WORLD_STATE; ptr += sizeof(uint8_t);
+  store_le<uint16_t>(ptr, num);
+  store_le<uint32_t>(ptr, rawSize);
+  ptr += lz4_compress(raw.data(), rawSize, ptr, lz4_compress_bound(rawSize));
+  packet->dataLength = ptr - packet->data;
+  message_stats_sent(packet, worldStateHeaderSize * 8 + num * entityRawBits);
+  return packet;
+}
+
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count)
+{
+  enet_peer_send(peer, 0, create_world_state_packet(ents, count));
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0 || *packet->data >= E_MESSAGE_TYPE_COUNT)
+    return E_MESSAGE_TYPE_COUNT;
   return (MessageType)*packet->data;
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+const char *message_type_name(MessageType type)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  ent = *(Entity*)(ptr); ptr += sizeof(Entity);
+  switch (type)
+  {
+  case E_CLIENT_TO_SERVER_JOIN: return "join";
+  case E_SERVER_TO_CLIENT_NEW_ENTITY: return "new_entity";
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: return "set_controlled_entity";
+  case E_CLIENT_TO_SERVER_INPUT: return "input";
+  case E_SERVER_TO_CLIENT_SNAPSHOT: return "snapshot";
+  case E_SERVER_TO_CLIENT_TIME_MSEC: return "time_msec";
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY: return "destroy_entity";
+  case E_SERVER_TO_CLIENT_WORLD_STATE: return "world_state";
+  case E_MESSAGE_TYPE_COUNT: break;
+  };
+  return "unknown";
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+// Packet payloads have no alignment guarantees, every load goes through memcpy.
+template<typename T>
+static T load(const uint8_t *&ptr)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  T value;
+  memcpy(&value, ptr, sizeof(T));
+  ptr += sizeof(T);
+  return value;
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+static bool has_size(const ENetPacket *packet, size_t size)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  /*
-  uint8_t thrPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  */
-  static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, 4);
-  static uint8_t nominalPackedValue = pack_float<uint8_t>(1.f, 0.f, 1.2f, 4);
-  float4bitsQuantized thrPacked(thrSteerPacked >> 4);
-  float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
-  thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
-  steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
+  return packet->dataLength >= size;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
+// `ptr` must have entityWireSize bytes left.
+static bool load_entity(const uint8_t *&ptr, Entity &ent)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t xPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t yPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  PositionXQuantized xPackedVal(xPacked);
-  PositionYQuantized yPackedVal(yPacked);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  x = xPackedVal.unpack(-worldSize, worldSize);
-  y = yPackedVal.unpack(-worldSize, worldSize);
-  ori = unpack_float<uint8_t>(oriPacked, -PI, PI, 8);
+  Entity e;
+  e.eid = load_le<uint16_t>(ptr);
+  e.color = load_le<uint32_t>(ptr);
+  uint8_t serverControlled = load_le<uint8_t>(ptr);
+  // quantised fields, every bit pattern decodes to an in-range value
+  ShipState state;
+  unpack_ship_state(ptr, state); ptr += packedShipStateSize;
+  e.omega = load_le<float>(ptr);
+  uint8_t thrSteerPacked = load_le<uint8_t>(ptr);
+  e.thr = ControlQuantiser::unpack(uint8_t(thrSteerPacked >> 4));
+  e.steer = ControlQuantiser::unpack(uint8_t(thrSteerPacked & 0x0f));
+  if (e.eid == invalid_entity || serverControlled > 1 || !std::isfinite(e.omega) ||
+      fabsf(e.thr) > 1.f || fabsf(e.steer) > 1.f)
+    return false;
+  e.serverControlled = serverControlled != 0;
+  e.x = state.x;
+  e.y = state.y;
+  e.ori = state.ori;
+  e.vx = state.vx;
+  e.vy = state.vy;
+  ent = e;
+  return true;
 }
 
-void deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec)
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  timeMsec = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  if (!has_size(packet, sizeof(uint8_t) + entityWireSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  return load_entity(ptr, ent);
 }
 
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+{
+  if (!has_size(packet, sizeof(uint8_t) + sizeof(uint16_t)))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  if (id == invalid_entity)
+    return false;
+  eid = id;
+  return true;
+}
+
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputFrame (&inputs)[inputRedundancy], uint8_t &count)
+{
+  constexpr size_t headerSize = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint32_t);
+  if (!has_size(packet, headerSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  uint8_t num = load<uint8_t>(ptr);
+  uint32_t newestFrame = load<uint32_t>(ptr);
+  if (id == invalid_entity || num == 0 || num > inputRedundancy || newestFrame == invalid_input_frame ||
+      !has_size(packet, headerSize + num * sizeof(uint8_t)))
+    return false;
+  InputFrame decoded[inputRedundancy];
+  for (uint8_t i = 0; i < num; ++i)
+  {
+    uint8_t thrSteerPacked = load<uint8_t>(ptr);
+    uint8_t packed[2] = {uint8_t(thrSteerPacked >> 4), uint8_t(thrSteerPacked & 0x0f)};
+    float controls[2];
+    ControlQuantiser::unpack_array(packed, controls, 2);
+    // the zero-anchored grid leaves the top code past 1, a real client never sends it
+    if (fabsf(controls[0]) > 1.f || fabsf(controls[1]) > 1.f)
+      return false;
+    decoded[i].frameNumber = newestFrame - i;
+    decoded[i].thr = controls[0];
+    decoded[i].steer = controls[1];
+  }
+  for (uint8_t i = 0; i < num; ++i)
+    inputs[i] = decoded[i];
+  eid = id;
+  count = num;
+  return true;
+}
+
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, uint16_t &lastInputFrame)
+{
+  if (!has_size(packet, snapshot_size()))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t id = load<uint16_t>(ptr);
+  if (id == invalid_entity)
+    return false;
+  // quantised fields, every bit pattern decodes to an in-range value
+  ShipState state;
+  unpack_ship_state(ptr, state); ptr += packedShipStateSize;
+  lastInputFrame = load<uint16_t>(ptr);
+  eid = id;
+  x = state.x;
+  y = state.y;
+  ori = state.ori;
+  vx = state.vx;
+  vy = state.vy;
+  return true;
+}
+
+bool deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec)
+{
+  if (!has_size(packet, sizeof(uint8_t) + sizeof(uint32_t)))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  timeMsec = load<uint32_t>(ptr);
+  return true;
+}
+
+bool deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids)
+{
+  constexpr size_t headerSize = sizeof(uint8_t) + sizeof(uint16_t);
+  if (!has_size(packet, headerSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t num = load<uint16_t>(ptr);
+  if (num == 0 || !has_size(packet, headerSize + num * sizeof(uint16_t)))
+    return false;
+  std::vector<uint16_t> decoded(num);
+  for (uint16_t i = 0; i < num; ++i)
+  {
+    decoded[i] = load<uint16_t>(ptr);
+    if (decoded[i] == invalid_entity)
+      return false;
+  }
+  eids.swap(decoded);
+  return true;
+}
+
+bool deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents)
+{
+  if (!has_size(packet, worldStateHeaderSize))
+    return false;
+  const uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  uint16_t num = load_le<uint16_t>(ptr);
+  uint32_t rawSize = load_le<uint32_t>(ptr);
+  // the size follows from the count, so a forged header cannot ask for more than a few MB
+  if (rawSize != num * entityWireSize)
+    return false;
+  std::vector<uint8_t> raw(rawSize);
+  if (!lz4_decompress(ptr, packet->dataLength - worldStateHeaderSize, raw.data(), rawSize))
+    return false;
+  std::vector<Entity> decoded(num);
+  const uint8_t *rawPtr = raw.data();
+  for (Entity &e : decoded)
+    if (!load_entity(rawPtr, e))
+      return false;
+  ents.swap(decoded);
+  return true;
+}
@@ -1,7 +1,14 @@
 #pragma once
 #include <enet/enet.h>
 #include <cstdint>
+#include <vector>
 #include "entity.h"
+#include "inputQueue.h"
+
+// Clients send one input frame per rendered frame at this rate, the server
+// simulates one tick of the same length per input it consumes.
+constexpr int inputFrameRate = 60;
+constexpr float fixedDt = 1.f / inputFrameRate;
 
 enum MessageType : uint8_t
 {
@@ -10,21 +17,50 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
   E_CLIENT_TO_SERVER_INPUT,
   E_SERVER_TO_CLIENT_SNAPSHOT,
-  E_SERVER_TO_CLIENT_TIME_MSEC
+  E_SERVER_TO_CLIENT_TIME_MSEC,
+  E_SERVER_TO_CLIENT_DESTROY_ENTITY,
+  E_SERVER_TO_CLIENT_WORLD_STATE,
+  E_MESSAGE_TYPE_COUNT // also returned for empty and unknown packets
 };
 
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori);
+// inputs are ordered newest first and must have consecutive frame numbers
+void send_entity_input(ENetPeer *peer, uint16_t eid, const InputFrame *inputs, uint8_t count);
+// only the low 16 bits of lastInputFrame go on the wire
+void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori, float vx, float vy, uint32_t lastInputFrame);
+// The create_*_packet functions build the packet without touching any peer, safe to call
+// from worker threads. Reliable messages go on channel 0, unsequenced ones on channel 1.
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori, float vx, float vy, uint32_t lastInputFrame);
+// Same packet from a PackedShipState already quantised, see pack_ship_states() in shipState.h.
+ENetPacket *create_snapshot_packet(uint16_t eid, const uint8_t *packed_state, uint32_t lastInputFrame);
 void send_time_msec(ENetPeer *peer, uint32_t timeMsec);
+ENetPacket *create_new_entity_packet(const Entity &ent);
+ENetPacket *create_set_controlled_entity_packet(uint16_t eid);
+ENetPacket *create_time_msec_packet(uint32_t timeMsec);
+// Entities that left the game, all of a tick's removals go in one message.
+void send_destroy_entities(ENetPeer *peer, const uint16_t *eids, uint16_t count);
+ENetPacket *create_destroy_entities_packet(const uint16_t *eids, uint16_t count);
+// Every entity a joining client needs, LZ4 compressed into one reliable message
+// that ENet fragments as needed. At most 65535 entities.
+void send_world_state(ENetPeer *peer, const Entity *ents, size_t count);
+ENetPacket *create_world_state_packet(const Entity *ents, size_t count);
+
+// Size of one snapshot packet payload in bytes
+size_t snapshot_size();
 
 MessageType get_packet_type(ENetPacket *packet);
+// Short name for stats, "unknown" for E_MESSAGE_TYPE_COUNT.
+const char *message_type_name(MessageType type);
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
-void deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec);
+// Every decoder checks the packet length once up front and returns false for
+// truncated packets, non-finite values and invalid eids, leaving the outputs untouched.
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent);
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, InputFrame (&inputs)[inputRedundancy], uint8_t &count);
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori, float &vx, float &vy, uint16_t &lastInputFrame);
+bool deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec);
+bool deserialize_destroy_entities(ENetPacket *packet, std::vector<uint16_t> &eids);
+bool deserialize_world_state(ENetPacket *packet, std::vector<Entity> &ents);
 
@@ -1,32 +1,59 @@
 #pragma once
 #include "mathUtils.h"
-#include <limits>
+#include <cstddef>
+#include <cstdint>
 
-template<typename T>
-T pack_float(float v, float lo, float hi, int num_bits)
+// ceil() that ignores float noise in the last few ulps, usable in constant expressions
+constexpr uint32_t ceil_code(float v)
 {
-  T range = (1 << num_bits) - 1;//std::numeric_limits<T>::max();
-  return range * ((clamp(v, lo, hi) - lo) / (hi - lo));
+  uint32_t c = uint32_t(v);
+  return v - float(c) > 1e-4f ? c + 1 : c;
 }
 
-template<typename T>
-float unpack_float(T c, float lo, float hi, int num_bits)
+// Quantiser with the range and bit count fixed at compile time.
+// Rounds to nearest, uses a precomputed reciprocal instead of dividing and
+// round-trips every code bit-exactly: pack(unpack(c)) == c.
+// If the range contains zero, the grid is anchored at zero so 0 (and, for
+// symmetric ranges, both bounds) is represented exactly. This costs one code
+// of precision compared to the plain [lo, hi] grid.
+template<typename T, int num_bits, float lo, float hi>
+struct Quantiser
 {
-  T range = (1 << num_bits) - 1;//std::numeric_limits<T>::max();
-  return float(c) / range * (hi - lo) + lo;
-}
+  static_assert(num_bits > 0 && num_bits <= int(sizeof(T) * 8) && num_bits <= 23, "Bit count doesn't fit the storage type or float mantissa");
+  static_assert(lo < hi, "Empty quantisation range");
 
-template<typename T, int num_bits>
-struct PackedFloat
-{
-  T packedVal;
+  static constexpr bool hasZero = lo < 0.f && hi > 0.f;
+  static constexpr uint32_t maxCode = (uint32_t(1) << num_bits) - 1;
+  static constexpr float step = hasZero ? (hi - lo) / float(maxCode - 1) : (hi - lo) / float(maxCode);
+  static constexpr float invStep = 1.f / step;
+  static constexpr float origin = hasZero ? 0.f : lo;
+  // code of `origin`, ceil(-lo / step) so that code 0 is not above lo
+  static constexpr uint32_t originCode = hasZero ? ceil_code(-lo * invStep) : 0;
 
-  PackedFloat(float v, float lo, float hi) { pack(v, lo, hi); }
-  PackedFloat(T compressed_val) : packedVal(compressed_val) {}
+  static constexpr T pack(float v)
+  {
+    float c = (v - origin) * invStep + float(originCode);
+    c = c < 0.f ? 0.f : c > float(maxCode) ? float(maxCode) : c;
+    return T(c + 0.5f);
+  }
 
-  void pack(float v, float lo, float hi) { packedVal = pack_float<T>(v, lo, hi, num_bits); }
-  float unpack(float lo, float hi) { return unpack_float<T>(packedVal, lo, hi, num_bits); }
-};
+  static constexpr float unpack(T c)
+  {
+    return float(int32_t(c) - int32_t(originCode)) * step + origin;
+  }
 
-typedef PackedFloat<uint8_t, 4> float4bitsQuantized;
+  // Batch kernels, plain loops without branches so the compiler vectorises them.
+  static void pack_array(const float *in, T *out, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = pack(in[i]);
+  }
+
+  static void unpack_array(const T *in, float *out, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = unpack(in[i]);
+  }
+};
 
+typedef Quantiser<uint8_t, 4, -1.f, 1.f> ControlQuantiser;
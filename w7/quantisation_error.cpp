@@ -0,0 +1,89 @@
+// Reports the error distribution of the packed ship state against the float reference.
+// usage: w7_quant_error [num_samples]
+#include "shipState.h"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static float angle_diff(float a, float b)
+{
+  float d = a - b;
+  while (d > PI)
+    d -= 2.f * PI;
+  while (d < -PI)
+    d += 2.f * PI;
+  return d;
+}
+
+static void report(const char *name, const char *unit, std::vector<float> &errors)
+{
+  std::sort(errors.begin(), errors.end());
+  double sum = 0.0;
+  for (float e : errors)
+    sum += e;
+  auto pct = [&](double p) { return errors[size_t(p * (errors.size() - 1))]; };
+  printf("%-12s mean %9.5f  p50 %9.5f  p99 %9.5f  p999 %9.5f  max %9.5f %s\n",
+         name, sum / errors.size(), pct(0.5), pct(0.99), pct(0.999), errors.back(), unit);
+}
+
+int main(int argc, const char **argv)
+{
+  size_t numSamples = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  if (numSamples == 0)
+    numSamples = 1;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> pos(-worldSize, worldSize);
+  std::uniform_real_distribution<float> ang(-PI, PI);
+  // most ships cruise slowly, some are fast enough to hit the coarse velocity range
+  std::normal_distribution<float> vel(0.f, 3.f);
+  std::bernoulli_distribution atRest(0.1);
+
+  std::vector<ShipState> states(numSamples);
+  for (ShipState &s : states)
+  {
+    s.x = pos(gen);
+    s.y = pos(gen);
+    s.ori = ang(gen);
+    bool rest = atRest(gen);
+    s.vx = rest ? 0.f : vel(gen);
+    s.vy = rest ? 0.f : vel(gen);
+  }
+
+  std::vector<PackedShipState> packed(numSamples);
+  std::vector<ShipState> unpacked(numSamples);
+  pack_ship_states(states.data(), packed.data(), numSamples);
+  unpack_ship_states(packed.data(), unpacked.data(), numSamples);
+
+  std::vector<float> posErr(numSamples), oriErr(numSamples), velErr(numSamples), fineVelErr, coarseVelErr;
+  size_t exactRest = 0, numRest = 0;
+  for (size_t i = 0; i < numSamples; ++i)
+  {
+    const ShipState &a = states[i];
+    const ShipState &b = unpacked[i];
+    posErr[i] = hypotf(a.x - b.x, a.y - b.y);
+    oriErr[i] = fabsf(angle_diff(a.ori, b.ori)) * 180.f / PI;
+    velErr[i] = hypotf(a.vx - b.vx, a.vy - b.vy);
+    bool coarse = fabsf(a.vx) > fineVelocityRange || fabsf(a.vy) > fineVelocityRange;
+    (coarse ? coarseVelErr : fineVelErr).push_back(velErr[i]);
+    if (a.vx == 0.f && a.vy == 0.f)
+    {
+      numRest++;
+      exactRest += b.vx == 0.f && b.vy == 0.f;
+    }
+  }
+
+  printf("%zu samples, %zu bytes per ship (%zu bytes as raw floats)\n",
+         numSamples, packedShipStateSize, sizeof(float) * 5);
+  report("position", "units", posErr);
+  report("orientation", "deg", oriErr);
+  report("velocity", "units/s", velErr);
+  if (!fineVelErr.empty())
+    report("  fine", "units/s", fineVelErr);
+  if (!coarseVelErr.empty())
+    report("  coarse", "units/s", coarseVelErr);
+  printf("ships at rest decoded with zero velocity: %zu/%zu\n", exactRest, numRest);
+  return 0;
+}
@@ -0,0 +1,148 @@
+// Headless client replay: runs what the server sent in a capture through the
+// client's decoders, one client state per peer slot, as fast as it goes, and
+// reports what each client ended up with and every packet it had to reject.
+//   w7_replay <capture> [peer]
+// Captures come from w7_server --capture <path>.
+#include <enet/enet.h>
+#include <chrono>
+#include <stdlib.h>
+#include <vector>
+#include "entity.h"
+#include "protocol.h"
+#include "messageStats.h"
+#include "entityTable.h"
+#include "packetCapture.h"
+
+struct ReplayClient
+{
+  EntityTable<Entity> entities;
+  uint16_t myEntity = invalid_entity;
+  uint16_t lastAcknowledgedInput = 0;
+  uint32_t serverTimeMsec = 0;
+  size_t packets = 0;
+  size_t rejected = 0;
+  size_t connections = 0;
+};
+
+// The same decoding the windowed client does, false if the packet is rejected.
+static bool on_packet(ReplayClient &client, ENetPacket *packet)
+{
+  switch (get_packet_type(packet))
+  {
+  case E_SERVER_TO_CLIENT_NEW_ENTITY:
+  {
+    Entity ent;
+    if (!deserialize_new_entity(packet, ent))
+      return false;
+    client.entities.add(ent);
+    return true;
+  }
+  case E_SERVER_TO_CLIENT_WORLD_STATE:
+  {
+    std::vector<Entity> ents;
+    if (!deserialize_world_state(packet, ents))
+      return false;
+    for (const Entity &ent : ents)
+      client.entities.add(ent);
+    return true;
+  }
+  case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+    return deserialize_set_controlled_entity(packet, client.myEntity);
+  case E_SERVER_TO_CLIENT_SNAPSHOT:
+  {
+    uint16_t eid = invalid_entity;
+    float x, y, ori, vx, vy;
+    uint16_t lastInputFrame = 0;
+    if (!deserialize_snapshot(packet, eid, x, y, ori, vx, vy, lastInputFrame))
+      return false;
+    if (eid == client.myEntity)
+      client.lastAcknowledgedInput = lastInputFrame;
+    if (Entity *e = client.entities.find(eid))
+    {
+      e->x = x;
+      e->y = y;
+      e->ori = ori;
+      e->vx = vx;
+      e->vy = vy;
+    }
+    return true;
+  }
+  case E_SERVER_TO_CLIENT_TIME_MSEC:
+    return deserialize_time_msec(packet, client.serverTimeMsec);
+  case E_SERVER_TO_CLIENT_DESTROY_ENTITY:
+  {
+    std::vector<uint16_t> eids;
+    if (!deserialize_destroy_entities(packet, eids))
+      return false;
+    for (uint16_t eid : eids)
+      client.entities.remove(eid);
+    return true;
+  }
+  default:
+    return false;
+  };
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: w7_replay <capture> [peer]\n");
+    return 1;
+  }
+  PacketCaptureReader capture;
+  if (!capture.open(argv[1]))
+  {
+    printf("Cannot read capture %s\n", argv[1]);
+    return 1;
+  }
+  long onlyPeer = argc > 2 ? strtol(argv[2], nullptr, 10) : -1;
+
+  std::vector<ReplayClient> clients(capture.peer_count());
+  size_t numRecords = 0;
+  uint32_t lastTime = 0;
+  auto start = std::chrono::steady_clock::now();
+  CaptureRecord record;
+  while (capture.next(record))
+  {
+    numRecords++;
+    lastTime = record.timeMs;
+    if (record.peer >= clients.size() || (onlyPeer >= 0 && record.peer != onlyPeer))
+      continue;
+    ReplayClient &client = clients[record.peer];
+    if (record.kind == CaptureKind::Connect)
+    {
+      // a new connection in the slot starts from an empty world
+      size_t connections = client.connections + 1;
+      client = ReplayClient();
+      client.connections = connections;
+    }
+    if (record.kind != CaptureKind::Sent)
+      continue;
+    // the decoders take an ENetPacket, this one only borrows the mapped bytes
+    ENetPacket packet = {};
+    packet.data = (enet_uint8*)record.data;
+    packet.dataLength = record.size;
+    message_stats_received(&packet);
+    client.packets++;
+    if (!on_packet(client, &packet))
+      client.rejected++;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%zu records, %.1f s of capture replayed in %.1f ms\n", numRecords, lastTime * 0.001, ms);
+  printf("%6s %12s %10s %10s %10s %10s\n", "peer", "connections", "packets", "rejected", "entities", "controls");
+  for (size_t i = 0; i < clients.size(); ++i)
+  {
+    const ReplayClient &c = clients[i];
+    if (c.connections == 0 && c.packets == 0)
+      continue;
+    printf("%6zu %12zu %10zu %10zu %10zu %10d\n", i, c.connections, c.packets, c.rejected, c.entities.size(),
+           c.myEntity == invalid_entity ? -1 : int(c.myEntity));
+  }
+  std::vector<const char*> typeNames;
+  for (int type = 0; type <= E_MESSAGE_TYPE_COUNT; ++type)
+    typeNames.push_back(message_type_name(MessageType(type)));
+  print_message_stats(stdout, typeNames);
+  return 0;
+}
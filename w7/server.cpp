@@ -2,25 +2,145 @@
 #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "shipState.h"
+#include "messageStats.h"
+#include "rateMeter.h"
 #include "mathUtils.h"
+#include "inputQueue.h"
+#include "idAllocator.h"
+#include "peerEntities.h"
+#include "entityTable.h"
+#include "priorityScheduler.h"
+#include "jobPool.h"
+#include "netThread.h"
+#include "peerStats.h"
+#include "metricsServer.h"
+#include "serverBench.h"
+#include "tickProfiler.h"
+#include "packetCapture.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <chrono>
 
-static std::vector<Entity> entities;
-static std::map<uint16_t, ENetPeer*> controlledMap;
+static EntityTable<Entity> entities;
+static IdAllocator entityIds;
+
+// two client input frames are buffered before the server starts consuming them
+using PlayerInputQueue = InputQueue<64>;
+constexpr uint32_t inputJitterFrames = 2;
+static std::map<uint16_t, PlayerInputQueue> inputQueues;
+
+// snapshot bandwidth per client, overridable from the command line
+static float peerBandwidthKbps = 256.f;
+// ENet header of an unsequenced send command on top of the snapshot payload
+constexpr size_t enetCommandOverhead = 8;
+static std::vector<PriorityScheduler> peerSchedulers; // indexed like host->peers
+// off in --bench mode, printing would dominate the timings
+static bool logConnections = true;
+
+constexpr size_t numServerShips = 100;
+
+// Snapshot stage: workers build every peer's packets in parallel while the
+// world stays unchanged, then the main thread hands them to ENet.
+static JobPool serializePool;
+static std::vector<uint32_t> lastInputFrames; // indexed like entities
+// every ship is quantised once a tick in one batch, the peers' packets copy the bytes
+static std::vector<ShipState> shipStates; // indexed like entities
+static std::vector<uint8_t> packedShipStates; // packedShipStateSize bytes per entity
+static std::vector<std::vector<ENetPacket*>> peerPackets; // indexed like host->peers
+
+// ENet is serviced on its own thread, the simulation only sees its events and
+// queues packets for it. Connection state is tracked from the events, since
+// peer->state belongs to the network thread.
+static NetThread net;
+static std::vector<uint8_t> peerConnected; // indexed like host->peers
+
+// Prometheus metrics, loopback only, the port is overridable from the command
+// line: per peer traffic by message type plus the link stats of the network
+// thread, published once a second.
+static uint16_t metricsPort = 10132;
+static PeerTrafficStats peerTraffic;
+static std::vector<PeerLinkStats> linkStats;
+static MetricsServer metricsServer;
+// Process wide message counts of the protocol layer, also printed every so often
+static std::vector<const char*> messageTypeNames;
+constexpr uint32_t messageStatsIntervalMs = 10000;
+// Game traffic per channel over the last second, as the simulation hands it
+// over. Wire totals stay with the network thread, which owns the host.
+static TrafficRates traffic;
+
+// Every packet to a peer goes through here so its bytes are accounted.
+static void send_to_peer(ENetPeer *peer, enet_uint8 channel, ENetPacket *packet)
+{
+  peerTraffic.on_sent(peer - peer->host->peers, packet);
+  traffic.on_sent(enet_time_get(), channel, packet);
+  net.send(peer, channel, packet);
+}
+
+static void init_peer_stats(ENetHost *server)
+{
+  messageTypeNames.clear();
+  for (int type = 0; type <= E_MESSAGE_TYPE_COUNT; ++type)
+    messageTypeNames.push_back(message_type_name(MessageType(type)));
+  peerTraffic.resize(server->peerCount, messageTypeNames);
+}
+
+static void write_channel_rates(std::string &text)
+{
+  struct Series
+  {
+    const char *name;
+    const char *help;
+    RateMeter (TrafficRates::Direction::*meters)[TrafficRates::maxChannels];
+  };
+  const Series series[] = {
+    {"netserver_channel_bytes_per_second", "Game payload over the last second by channel.", &TrafficRates::Direction::channelBytes},
+    {"netserver_channel_packets_per_second", "Game packets over the last second by channel.", &TrafficRates::Direction::channelPackets},
+  };
+  uint32_t now = enet_time_get();
+  char buf[256];
+  for (const Series &s : series)
+  {
+    snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s gauge\n", s.name, s.help, s.name);
+    text += buf;
+    for (size_t ch = 0; ch < TrafficRates::maxChannels; ++ch)
+    {
+      snprintf(buf, sizeof(buf),
+               "%s{server=\"w7\",direction=\"out\",channel=\"%zu\"} %.1f\n"
+               "%s{server=\"w7\",direction=\"in\",channel=\"%zu\"} %.1f\n",
+               s.name, ch, (traffic.out.*s.meters)[ch].rate(now), s.name, ch, (traffic.in.*s.meters)[ch].rate(now));
+      text += buf;
+    }
+  }
+}
+
+static void publish_metrics()
+{
+  net.link_stats(linkStats);
+  std::string text;
+  write_peer_metrics(text, "w7", linkStats, peerTraffic);
+  write_message_metrics(text, "w7", messageTypeNames);
+  write_channel_rates(text);
+  metricsServer.set_metrics(std::move(text));
+}
+
+// ship of every peer slot, see peerEntities.h
+static PeerEntities peerEntities(entityIds); // indexed like host->peers
 
 void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
-  // send all entities
-  for (const Entity &ent : entities)
-    send_new_entity(peer, ent);
+  // a peer controls one ship at most
+  if (peerEntities.get(peer - host->peers) != invalid_entity)
+    return;
+  uint16_t newEid = entityIds.allocate();
+  if (newEid == invalid_entity)
+    return; // every eid is taken
+  // send all entities in one message
+  if (!entities.empty())
+    send_to_peer(peer, 0, create_world_state_packet(entities.data(), entities.size()));
 
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
   uint32_t color = 0x000000ff +
                    0x44000000 * (rand() % 4 + 1) +
                    0x00440000 * (rand() % 4 + 1) +
@@ -28,25 +148,25 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
   float x = (rand() % 4) * 5.f;
   float y = (rand() % 4) * 5.f;
   Entity ent = {color, false, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, 0.f, 0.f, newEid};
-  entities.push_back(ent);
-
-  controlledMap[newEid] = peer;
+  entities.add(ent);
 
+  inputQueues.emplace(newEid, PlayerInputQueue(inputJitterFrames));
+  peerSchedulers[peer - host->peers].reset(newEid);
+  peerEntities.set(peer - host->peers, newEid);
 
   // send info about new entity to everyone
   for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+    if (peerConnected[i])
+      send_to_peer(&host->peers[i], 0, create_new_entity_packet(ent));
   // send info about controlled entity
-  send_set_controlled_entity(peer, newEid);
+  send_to_peer(peer, 0, create_set_controlled_entity_packet(newEid));
 }
 
 void create_server_entity(ENetHost *host)
 {
-  // find max eid
-  uint16_t maxEid = entities.empty() ? invalid_entity : entities[0].eid;
-  for (const Entity &e : entities)
-    maxEid = std::max(maxEid, e.eid);
-  uint16_t newEid = maxEid + 1;
+  uint16_t newEid = entityIds.allocate();
+  if (newEid == invalid_entity)
+    return;
   uint32_t color = 0xff000000 +
                    0x00440000 * (rand() % 5) +
                    0x00004400 * (rand() % 5) +
@@ -54,45 +174,86 @@ void create_server_entity(ENetHost *host)
   float x = rand() % int(worldSize * 2) - worldSize;
   float y = rand() % int(worldSize * 2) - worldSize;
   Entity ent = {color, true, x, y, 0.f, (rand() / RAND_MAX) * 3.141592654f, 0.f, 0.f, 0.f, 0.f, newEid};
-  entities.push_back(ent);
+  entities.add(ent);
 
   // send info about new entity to everyone
   for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+    if (peerConnected[i])
+      send_to_peer(&host->peers[i], 0, create_new_entity_packet(ent));
 }
 
 
-void on_input(ENetPacket *packet)
+void on_input(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 {
   uint16_t eid = invalid_entity;
-  float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
-  for (Entity &e : entities)
-    if (e.eid == eid)
-    {
-      e.thr = thr;
-      e.steer = steer;
-    }
+  InputFrame inputs[inputRedundancy];
+  uint8_t count = 0;
+  if (!deserialize_entity_input(packet, eid, inputs, count))
+    return;
+  // a client may only steer its own ship
+  if (eid == invalid_entity || eid != peerEntities.get(peer - host->peers))
+    return;
+  auto itf = inputQueues.find(eid);
+  if (itf == inputQueues.end())
+    return;
+  for (uint8_t i = 0; i < count; ++i)
+    itf->second.push(inputs[i]);
+}
+
+static void despawn_peer_entity(size_t peer_idx)
+{
+  uint16_t eid = peerEntities.despawn(peer_idx);
+  if (eid == invalid_entity)
+    return;
+  entities.remove(eid);
+  inputQueues.erase(eid);
+  for (PriorityScheduler &scheduler : peerSchedulers)
+    scheduler.forget(eid);
+}
+
+static void send_despawns(ENetHost* server)
+{
+  const std::vector<uint16_t> &despawnedEids = peerEntities.despawned();
+  if (despawnedEids.empty())
+    return;
+  for (size_t i = 0; i < server->peerCount; ++i)
+    if (peerConnected[i])
+      send_to_peer(&server->peers[i], 0, create_destroy_entities_packet(despawnedEids.data(), uint16_t(despawnedEids.size())));
+  peerEntities.free_despawned();
 }
 
 static void update_net(ENetHost* server)
 {
-  ENetEvent event;
-  while (enet_host_service(server, &event, 0) > 0)
+  NetEvent event;
+  while (net.poll(event))
   {
     switch (event.type)
     {
     case ENET_EVENT_TYPE_CONNECT:
-      printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+      if (logConnections)
+        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+      peerSchedulers[event.peer - server->peers].reset(invalid_entity);
+      peerConnected[event.peer - server->peers] = 1;
+      peerTraffic.reset_peer(event.peer - server->peers);
+      break;
+    case ENET_EVENT_TYPE_DISCONNECT:
+      if (logConnections)
+        printf("Peer %zu disconnected\n", size_t(event.peer - server->peers));
+      peerConnected[event.peer - server->peers] = 0;
+      peerSchedulers[event.peer - server->peers].reset(invalid_entity);
+      despawn_peer_entity(event.peer - server->peers);
       break;
     case ENET_EVENT_TYPE_RECEIVE:
+      peerTraffic.on_received(event.peer - server->peers, event.packet);
+      traffic.on_received(enet_time_get(), event.channelID, event.packet);
+      message_stats_received(event.packet);
       switch (get_packet_type(event.packet))
       {
         case E_CLIENT_TO_SERVER_JOIN:
           on_join(event.packet, event.peer, server);
           break;
         case E_CLIENT_TO_SERVER_INPUT:
-          on_input(event.packet);
+          on_input(event.packet, event.peer, server);
           break;
       };
       enet_packet_destroy(event.packet);
@@ -101,6 +262,7 @@ static void update_net(ENetHost* server)
       break;
     };
   }
+  send_despawns(server);
 }
 
 static void update_ai(Entity& e, float dt)
@@ -113,22 +275,70 @@ static void update_ai(Entity& e, float dt)
     e.steer = e.steer != 0.f ? 0.f : ((rand() % 2) * 2.f - 1.f);
 }
 
-static void simulate_world(ENetHost* server, float dt)
+static void simulate_world(float dt)
 {
   for (Entity &e : entities)
   {
     if (e.serverControlled)
       update_ai(e, dt);
-    // simulate
-    simulate_entity(e, dt);
-    // send
-    for (size_t i = 0; i < server->peerCount; ++i)
+    else
     {
-      ENetPeer *peer = &server->peers[i];
-      // skip this here in this implementation
-      //if (controlledMap[e.eid] != peer)
-      send_snapshot(peer, e.eid, e.x, e.y, e.ori);
+      // consume exactly one buffered input per tick, keep the previous one if none arrived
+      auto itf = inputQueues.find(e.eid);
+      if (itf != inputQueues.end())
+      {
+        InputFrame input;
+        if (itf->second.pop(input))
+        {
+          e.thr = input.thr;
+          e.steer = input.steer;
+        }
+      }
     }
+    // simulate
+    simulate_entity(e, dt);
+  }
+}
+
+static void serialize_snapshots(ENetHost* server, float dt)
+{
+  lastInputFrames.assign(entities.size(), invalid_input_frame);
+  for (size_t i = 0; i < entities.size(); ++i)
+  {
+    auto itf = inputQueues.find(entities[i].eid);
+    if (itf != inputQueues.end())
+      lastInputFrames[i] = itf->second.last_processed_frame();
+  }
+  shipStates.resize(entities.size());
+  for (size_t i = 0; i < entities.size(); ++i)
+  {
+    const Entity &e = entities[i];
+    shipStates[i] = {e.x, e.y, e.ori, e.vx, e.vy};
+  }
+  packedShipStates.resize(entities.size() * packedShipStateSize);
+  PackedShipState *packed = (PackedShipState*)packedShipStates.data();
+  pack_ship_states(shipStates.data(), packed, entities.size());
+
+  const float bytesPerSec = peerBandwidthKbps * 1000.f / 8.f;
+  const size_t bytesPerEntity = snapshot_size() + enetCommandOverhead;
+  peerPackets.resize(server->peerCount);
+  serializePool.parallel_for(server->peerCount, [&](size_t i)
+  {
+    // each peer gets the most relevant entities that fit its bandwidth budget
+    if (!peerConnected[i])
+      return;
+    for (uint32_t idx : peerSchedulers[i].schedule(entities, dt, bytesPerSec, bytesPerEntity))
+      peerPackets[i].push_back(create_snapshot_packet(entities[idx].eid, packed[idx], lastInputFrames[idx]));
+  });
+}
+
+static void send_snapshots(ENetHost* server)
+{
+  for (size_t i = 0; i < peerPackets.size(); ++i)
+  {
+    for (ENetPacket *packet : peerPackets[i])
+      send_to_peer(&server->peers[i], 1, packet);
+    peerPackets[i].clear();
   }
 }
 
@@ -136,7 +346,225 @@ static void update_time(ENetHost* server, uint32_t curTime)
 {
   // We can send it less often too
   for (size_t i = 0; i < server->peerCount; ++i)
-    send_time_msec(&server->peers[i], curTime);
+    if (peerConnected[i])
+      send_to_peer(&server->peers[i], 0, create_time_msec_packet(curTime));
+}
+
+static int run_bench(const ServerBenchConfig &cfg)
+{
+  ENetHost *server = create_loopback_server_host(cfg.numPeers);
+  if (!server)
+  {
+    printf("Cannot create ENet server\n");
+    return 1;
+  }
+  logConnections = false;
+  peerSchedulers.resize(server->peerCount);
+  peerConnected.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
+  init_peer_stats(server);
+  for (size_t i = 0; i < cfg.numEntities; ++i)
+    create_server_entity(server);
+  // the clients stay on this thread, the server host goes to the network thread
+  net.start(server);
+
+  {
+    LoopbackClients clients(server->address, cfg.numPeers);
+    if (!clients.valid())
+    {
+      printf("Cannot create ENet client host\n");
+      net.stop();
+      enet_host_destroy(server);
+      return 1;
+    }
+    std::vector<uint16_t> clientEids(clients.size(), invalid_entity);
+    std::vector<uint32_t> clientFrames(clients.size(), 0);
+    auto on_connect = [](size_t, ENetPeer *peer) { send_join(peer); };
+    auto on_receive = [&](size_t idx, ENetPacket *packet)
+    {
+      if (get_packet_type(packet) == E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY)
+        deserialize_set_controlled_entity(packet, clientEids[idx]);
+    };
+
+    // everyone joins before the measurement starts
+    size_t numJoined = 0;
+    for (uint32_t start = enet_time_get(); numJoined < clients.size() && enet_time_get() - start < 10000;)
+    {
+      update_net(server);
+      clients.update(on_connect, on_receive);
+      numJoined = clients.size() - std::count(clientEids.begin(), clientEids.end(), invalid_entity);
+      usleep(1000);
+    }
+
+    constexpr float benchDt = fixedDt;
+    TickProfiler profiler({"net receive", "simulate", "serialize", "send"});
+    for (uint32_t tick = 0; tick < cfg.numTicks; ++tick)
+    {
+      // the clients' side is not part of the tick
+      for (size_t i = 0; i < clients.size(); ++i)
+      {
+        if (clientEids[i] == invalid_entity)
+          continue;
+        InputFrame input = {clientFrames[i]++, 1.f, (tick + i) % 60 < 30 ? 1.f : -1.f};
+        send_entity_input(clients.peer(i), clientEids[i], &input, 1);
+      }
+      clients.flush();
+
+      profiler.begin_tick();
+      {
+        TickProfiler::Scope scope(profiler, 0);
+        update_net(server);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 1);
+        simulate_world(benchDt);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 2);
+        serialize_snapshots(server, benchDt);
+      }
+      {
+        TickProfiler::Scope scope(profiler, 3);
+        send_snapshots(server);
+        update_time(server, enet_time_get());
+      }
+      profiler.end_tick();
+
+      clients.update(on_connect, on_receive);
+    }
+
+    printf("w7 server bench: %zu/%zu peers joined, %zu entities, %u ticks\n",
+           numJoined, clients.size(), entities.size(), cfg.numTicks);
+    profiler.print(stdout);
+    print_message_stats(stdout, messageTypeNames);
+  }
+
+  net.stop();
+  enet_host_destroy(server);
+  return 0;
+}
+
+// Feeds a capture through update_net and the rest of the tick as fast as it
+// goes, with the clock stepped a fixed tick at a time and every recorded event
+// delivered at its tick. The same capture replays the same way every time.
+// What the server sends is dropped, the captured sends are only counted.
+static int run_replay(const char *path)
+{
+  PacketCaptureReader capture;
+  if (!capture.open(path))
+  {
+    printf("Cannot read capture %s\n", path);
+    return 1;
+  }
+  ENetHost *server = create_loopback_server_host(capture.peer_count());
+  if (!server)
+  {
+    printf("Cannot create ENet server\n");
+    return 1;
+  }
+  logConnections = false;
+  peerSchedulers.resize(server->peerCount);
+  peerConnected.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
+  init_peer_stats(server);
+  for (size_t i = 0; i < numServerShips; ++i)
+    create_server_entity(server);
+  net.start_replay(server);
+
+  size_t numRecords = 0;
+  size_t numCapturedSends = 0;
+  uint32_t numTicks = 0;
+  uint32_t curTime = 0;
+  auto start = std::chrono::steady_clock::now();
+  CaptureRecord record;
+  bool more = capture.next(record);
+  while (more)
+  {
+    // whole ms, the ticks land at the same times as in a live run
+    curTime = uint32_t(uint64_t(numTicks + 1) * 1000 / inputFrameRate);
+    enet_time_set(curTime);
+    for (; more && record.timeMs <= curTime; more = capture.next(record))
+    {
+      numRecords++;
+      if (record.peer >= server->peerCount)
+        continue;
+      NetEvent event;
+      event.peer = &server->peers[record.peer];
+      event.channelID = record.channel;
+      switch (record.kind)
+      {
+      case CaptureKind::Connect: event.type = ENET_EVENT_TYPE_CONNECT; break;
+      case CaptureKind::Disconnect: event.type = ENET_EVENT_TYPE_DISCONNECT; break;
+      case CaptureKind::Received:
+        event.type = ENET_EVENT_TYPE_RECEIVE;
+        event.packet = enet_packet_create(record.data, record.size, 0);
+        break;
+      default:
+        numCapturedSends++;
+        continue;
+      };
+      // a tick's worth of events can outgrow the queue, hand them over early then
+      while (!net.inject(event))
+        update_net(server);
+    }
+    update_net(server);
+    simulate_world(fixedDt);
+    serialize_snapshots(server, fixedDt);
+    send_snapshots(server);
+    update_time(server, curTime);
+    numTicks++;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  printf("w7 replay of %s: %zu records, %u ticks (%.1f s of capture) in %.1f ms, %zu entities at the end\n",
+         path, numRecords, numTicks, curTime * 0.001, ms, entities.size());
+  printf("captured sends: %zu\n", numCapturedSends);
+  print_message_stats(stdout, messageTypeNames);
+  net.stop();
+  enet_host_destroy(server);
+  return 0;
+}
+
+// Options of a live or replayed run, every one named:
+//   w7_server [--kbps N] [--max-clients N] [--metrics-port N] [--capture <path>]
+//   w7_server --replay <capture>
+//   w7_server --bench [peers] [entities] [ticks]
+struct ServerArgs
+{
+  size_t maxClients = 32; // load tests with w7_bots need more
+  const char *capturePath = nullptr;
+  const char *replayPath = nullptr;
+};
+
+// Returns false and prints the usage on an unknown option or a missing value.
+static bool parse_server_args(int argc, const char **argv, ServerArgs &args)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool known = true;
+    if (strcmp(argv[i], "--kbps") == 0 && value)
+      peerBandwidthKbps = atof(value);
+    else if (strcmp(argv[i], "--max-clients") == 0 && value)
+      args.maxClients = strtoul(value, nullptr, 10);
+    else if (strcmp(argv[i], "--metrics-port") == 0 && value)
+      metricsPort = uint16_t(atoi(value));
+    else if (strcmp(argv[i], "--capture") == 0 && value)
+      args.capturePath = value;
+    else if (strcmp(argv[i], "--replay") == 0 && value)
+      args.replayPath = value;
+    else
+      known = false;
+    if (!known)
+    {
+      printf("usage: w7_server [--kbps N] [--max-clients N] [--metrics-port N] [--capture <path>]\n"
+             "       w7_server --replay <capture>\n"
+             "       w7_server --bench [peers] [entities] [ticks]\n");
+      return false;
+    }
+    ++i;
+  }
+  return true;
 }
 
 int main(int argc, const char **argv)
@@ -146,12 +574,21 @@ int main(int argc, const char **argv)
     printf("Cannot init ENet");
     return 1;
   }
+
+  ServerBenchConfig benchConfig;
+  if (parse_server_bench_args(argc, argv, benchConfig))
+    return run_bench(benchConfig);
+  ServerArgs args;
+  if (!parse_server_args(argc, argv, args))
+    return 1;
+  if (args.replayPath)
+    return run_replay(args.replayPath);
   ENetAddress address;
 
   address.host = ENET_HOST_ANY;
   address.port = 10131;
 
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  ENetHost *server = enet_host_create(&address, args.maxClients, 2, 0, 0);
 
   if (!server)
   {
@@ -159,23 +596,64 @@ int main(int argc, const char **argv)
     return 1;
   }
 
-  constexpr size_t numShips = 100;
-  for (size_t i = 0; i < numShips; ++i)
+  printf("Snapshot budget: %.0f kbit/s per client\n", peerBandwidthKbps);
+  peerSchedulers.resize(server->peerCount);
+  peerConnected.resize(server->peerCount);
+  peerEntities.resize(server->peerCount);
+  init_peer_stats(server);
+
+  for (size_t i = 0; i < numServerShips; ++i)
     create_server_entity(server);
+  if (args.capturePath)
+  {
+    if (net.open_capture(args.capturePath, server->peerCount))
+      printf("Capturing traffic to %s\n", args.capturePath);
+    else
+      printf("Cannot open capture %s\n", args.capturePath);
+  }
+  net.start(server);
+  if (metricsServer.start(metricsPort))
+    printf("Metrics at http://127.0.0.1:%u/metrics\n", metricsPort);
+  else
+    printf("Cannot listen for metrics on port %u\n", metricsPort);
 
   uint32_t lastTime = enet_time_get();
+  uint32_t lastMetricsTime = lastTime;
+  uint32_t lastMessageStatsTime = lastTime;
+  float accumulatedTime = 0.f;
   while (true)
   {
     uint32_t curTime = enet_time_get();
-    float dt = (curTime - lastTime) * 0.001f;
+    accumulatedTime += curTime - lastTime;
     lastTime = curTime;
 
-    update_net(server);
-    simulate_world(server, dt);
-    update_time(server, curTime);
-    usleep(10000);
+    // one tick per client input frame, catching up on every tick that is due
+    while (accumulatedTime >= fixedDt * 1000.f)
+    {
+      update_net(server);
+      simulate_world(fixedDt);
+      serialize_snapshots(server, fixedDt);
+      send_snapshots(server);
+      update_time(server, curTime);
+      accumulatedTime -= fixedDt * 1000.f;
+    }
+    if (curTime - lastMetricsTime >= 1000)
+    {
+      publish_metrics();
+      lastMetricsTime = curTime;
+    }
+    if (curTime - lastMessageStatsTime >= messageStatsIntervalMs)
+    {
+      print_message_stats(stdout, messageTypeNames);
+      lastMessageStatsTime = curTime;
+    }
+    metricsServer.poll();
+    // sleep until the next tick is due
+    usleep(useconds_t((fixedDt * 1000.f - accumulatedTime) * 1000.f));
   }
 
+  metricsServer.stop();
+  net.stop();
   enet_host_destroy(server);
 
   atexit(enet_deinitialize);
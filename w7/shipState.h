@@ -0,0 +1,115 @@
+#pragma once
+#include "quantisation.h"
+#include "entity.h"
+#include <cstddef>
+#include <cstdint>
+
+// Wire encoding of the full ship state in 6 bytes (48 bits, little-endian):
+//   cell      4 bits  world split into 4x4 cells, positions are sent relative to the cell origin
+//   x, y   2x10 bits  position inside the cell, ~0.06 units
+//   ori       9 bits  wrap-aware angle, ~0.7 degrees, -PI and PI share a code
+//   velScale  1 bit   selects fine (+-4, ~0.06) or coarse (+-32, ~0.5) velocity range
+//   vx, vy  2x7 bits  velocity, exactly zero when the ship is at rest
+struct ShipState
+{
+  float x = 0.f;
+  float y = 0.f;
+  float ori = 0.f;
+  float vx = 0.f;
+  float vy = 0.f;
+};
+
+constexpr size_t packedShipStateSize = 6;
+typedef uint8_t PackedShipState[packedShipStateSize];
+
+constexpr int shipCellsPerAxis = 4;
+constexpr float shipCellSize = 2.f * worldSize / shipCellsPerAxis;
+constexpr float fineVelocityRange = 4.f;
+constexpr float coarseVelocityRange = 32.f;
+
+typedef Quantiser<uint16_t, 10, 0.f, shipCellSize> CellPositionQuantiser;
+typedef Quantiser<uint8_t, 7, -fineVelocityRange, fineVelocityRange> FineVelocityQuantiser;
+typedef Quantiser<uint8_t, 7, -coarseVelocityRange, coarseVelocityRange> CoarseVelocityQuantiser;
+
+// Angle quantiser on the circle: no clamping, codes wrap around.
+template<int num_bits>
+struct AngleQuantiser
+{
+  static constexpr uint32_t numCodes = uint32_t(1) << num_bits;
+  static constexpr float step = 2.f * PI / numCodes;
+  static constexpr float invStep = numCodes / (2.f * PI);
+
+  static uint32_t pack(float a)
+  {
+    // round to nearest, negative angles wrap through the mask
+    return uint32_t(int32_t(floorf(a * invStep + 0.5f))) & (numCodes - 1);
+  }
+
+  static float unpack(uint32_t c)
+  {
+    float a = float(c & (numCodes - 1)) * step;
+    return a > PI ? a - 2.f * PI : a;
+  }
+};
+
+typedef AngleQuantiser<9> ShipAngleQuantiser;
+
+inline int ship_cell_coord(float v)
+{
+  int c = int(floorf((v + worldSize) * (1.f / shipCellSize)));
+  return c < 0 ? 0 : c >= shipCellsPerAxis ? shipCellsPerAxis - 1 : c;
+}
+
+inline void pack_ship_state(const ShipState &s, PackedShipState out)
+{
+  int cx = ship_cell_coord(s.x);
+  int cy = ship_cell_coord(s.y);
+  float originX = -worldSize + cx * shipCellSize;
+  float originY = -worldSize + cy * shipCellSize;
+
+  bool coarse = fabsf(s.vx) > fineVelocityRange || fabsf(s.vy) > fineVelocityRange;
+  uint64_t vx = coarse ? CoarseVelocityQuantiser::pack(s.vx) : FineVelocityQuantiser::pack(s.vx);
+  uint64_t vy = coarse ? CoarseVelocityQuantiser::pack(s.vy) : FineVelocityQuantiser::pack(s.vy);
+
+  uint64_t bits = uint64_t(cy * shipCellsPerAxis + cx);
+  bits |= uint64_t(CellPositionQuantiser::pack(s.x - originX)) << 4;
+  bits |= uint64_t(CellPositionQuantiser::pack(s.y - originY)) << 14;
+  bits |= uint64_t(ShipAngleQuantiser::pack(s.ori)) << 24;
+  bits |= uint64_t(coarse ? 1 : 0) << 33;
+  bits |= vx << 34;
+  bits |= vy << 41;
+  for (size_t i = 0; i < packedShipStateSize; ++i)
+    out[i] = uint8_t(bits >> (8 * i));
+}
+
+inline void unpack_ship_state(const PackedShipState in, ShipState &s)
+{
+  uint64_t bits = 0;
+  for (size_t i = 0; i < packedShipStateSize; ++i)
+    bits |= uint64_t(in[i]) << (8 * i);
+
+  uint32_t cell = bits & 0xf;
+  float originX = -worldSize + (cell % shipCellsPerAxis) * shipCellSize;
+  float originY = -worldSize + (cell / shipCellsPerAxis) * shipCellSize;
+  s.x = originX + CellPositionQuantiser::unpack(uint16_t((bits >> 4) & 0x3ff));
+  s.y = originY + CellPositionQuantiser::unpack(uint16_t((bits >> 14) & 0x3ff));
+  s.ori = ShipAngleQuantiser::unpack(uint32_t((bits >> 24) & 0x1ff));
+  bool coarse = (bits >> 33) & 1;
+  uint8_t vx = (bits >> 34) & 0x7f;
+  uint8_t vy = (bits >> 41) & 0x7f;
+  s.vx = coarse ? CoarseVelocityQuantiser::unpack(vx) : FineVelocityQuantiser::unpack(vx);
+  s.vy = coarse ? CoarseVelocityQuantiser::unpack(vy) : FineVelocityQuantiser::unpack(vy);
+}
+
+// Batch versions for quantising a whole snapshot in one pass.
+inline void pack_ship_states(const ShipState *in, PackedShipState *out, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    pack_ship_state(in[i], out[i]);
+}
+
+inline void unpack_ship_states(const PackedShipState *in, ShipState *out, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    unpack_ship_state(in[i], out[i]);
+}